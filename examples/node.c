@@ -1,6 +1,7 @@
 /********** Libraries ***********/
 #include "contiki.h"
 #include "net/ipv6/simple-udp.h"
+#include "net/ipv6/uip-ds6-route.h"
 #include "net/mac/tsch/tsch.h"
 #include "lib/random.h"
 #include "sys/node-id.h"
@@ -8,6 +9,7 @@
 #include "net/queuebuf.h"
 #include "federated-learning.h"
 #include "slot-configuration.h"
+#include "checkpoint.h"
 
 #include "sys/log.h"
 #define LOG_MODULE "App"
@@ -23,16 +25,19 @@
 // period to update Q-values
 #define Q_TABLE_INTERVAL (120 * CLOCK_SECOND)
 
-// epsilon for epsilon-greedy exploration (0.15 = 15% exploration, 85% exploitation)
-#define EPSILON_GREEDY_INITIAL 0.15
-#define EPSILON_DECAY 0.995  // decay factor (multiply epsilon each cycle)
-#define EPSILON_MIN 0.01     // minimum epsilon (always keep some exploration)
-
-// Global epsilon value (starts at initial, decays over time)
-float current_epsilon = EPSILON_GREEDY_INITIAL;
+// exploration (epsilon-greedy by default, 0.15 decaying to 0.01) is selected
+// with Q_LEARNING_CONF_POLICY and decayed by the q-learning module
 
 // period for federated synchronization
-// FEDERATED_SYNC_INTERVAL is 180 seconds by default
+// FEDERATED_SYNC_INTERVAL is 180 seconds by default, with
+// FEDERATED_CONF_TRICKLE the period is driven by a Trickle timer instead
+
+// neighbors silent for this long are dropped (2x the longest sync period)
+#if FEDERATED_TRICKLE
+#define FEDERATED_NEIGHBOR_TIMEOUT (2 * FED_TRICKLE_IMAX)
+#else
+#define FEDERATED_NEIGHBOR_TIMEOUT (2 * FEDERATED_SYNC_INTERVAL)
+#endif
 
 // period to finish setting up Minimal Scheduling 
 #define SET_UP_MINIMAL_SCHEDULE (120 * CLOCK_SECOND)
@@ -60,7 +65,54 @@ struct tsch_link *custom_links[TSCH_SCHEDULE_CONF_MAX_LENGTH];
 // Current slotframe size (adaptive)
 uint8_t current_slotframe_size = TSCH_SCHEDULE_DEFAULT_LENGTH;
 
+#if FEDERATED_SLOTFRAME
+// secondary slotframe carrying the model exchange
+static struct tsch_slotframe *sf_federated;
+// set while a federated message is handed to the stack
+static uint8_t federated_tx;
+#endif
+
+#if FEDERATED_TRICKLE
+// Trickle timer of the federated sync process, reset from the scheduler and
+// the receive callback (all zero, and inert, until the sync process starts)
+static fed_trickle_t sync_trickle;
+#endif
+
 /********** Scheduler Setup ***********/
+#if FEDERATED_SLOTFRAME
+// Function adds the model exchange slotframe (again after the data slotframe
+// is rebuilt, as all slotframes are removed)
+static void init_federated_slotframe(void)
+{
+  sf_federated = tsch_schedule_add_slotframe(FEDERATED_SLOTFRAME_HANDLE, FEDERATED_SLOTFRAME_LENGTH);
+  tsch_schedule_add_link(sf_federated, LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+                         LINK_TYPE_NORMAL, &tsch_broadcast_address,
+                         FEDERATED_SLOTFRAME_TIMESLOT, FEDERATED_SLOTFRAME_CHANNEL_OFFSET, 1);
+}
+
+/**
+ * TSCH packet-ready callback (TSCH_CALLBACK_PACKET_READY): the federated
+ * messages may only use the model exchange cell, everything else the data
+ * slotframe (EBs its advertising cell)
+ */
+int federated_packet_ready(void)
+{
+  uint16_t slotframe = 0;
+  uint16_t timeslot = 0xffff;
+
+  if (federated_tx) {
+    slotframe = FEDERATED_SLOTFRAME_HANDLE;
+    timeslot = FEDERATED_SLOTFRAME_TIMESLOT;
+  } else if (packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) == FRAME802154_BEACONFRAME) {
+    timeslot = 0;
+  }
+  packetbuf_set_attr(PACKETBUF_ATTR_TSCH_SLOTFRAME, slotframe);
+  packetbuf_set_attr(PACKETBUF_ATTR_TSCH_TIMESLOT, timeslot);
+  packetbuf_set_attr(PACKETBUF_ATTR_TSCH_CHANNEL_OFFSET, 0xffff);
+  return slotframe;
+}
+#endif
+
 // Function starts Minimal Scheduler
 static void init_tsch_schedule(void)
 {
@@ -79,6 +131,9 @@ static void init_tsch_schedule(void)
     custom_links[i] = tsch_schedule_add_link(sf_min, LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
                            LINK_TYPE_NORMAL, &tsch_broadcast_address, i, 0, 1);
   }
+#if FEDERATED_SLOTFRAME
+  init_federated_slotframe();
+#endif
   LOG_INFO("Initial slotframe created with %u slots\n", current_slotframe_size);
 }
 
@@ -126,6 +181,9 @@ void adaptive_slotframe_resize(uint8_t new_size) {
                            LINK_TYPE_NORMAL, 
                            &tsch_broadcast_address, i, 0, 1);
   }
+#if FEDERATED_SLOTFRAME
+  init_federated_slotframe();
+#endif
   
   LOG_INFO("Slotframe resized successfully to %u slots\n", current_slotframe_size);
 }
@@ -152,11 +210,28 @@ void set_up_new_schedule(uint8_t action) {
   
   LOG_INFO("Q-Learning action=%u maps to slotframe_size=%u\n", action, target_size);
   
+#if Q_LEARNING_HIERARCHICAL
+  // Coarse phase acts at bin centres, fine phase inside the refined bin
+  LOG_INFO("Hierarchical search: phase=%s bin=%u (refining bin %u)\n",
+           get_search_phase() == Q_SEARCH_COARSE ? "coarse" : "fine",
+           get_action_bin(action), get_refine_bin());
+#endif
+  
   // Adaptively resize the slotframe
+#if SLOT_BANDIT
+  uint8_t resized = target_size != current_slotframe_size;
+#endif
   adaptive_slotframe_resize(target_size);
   
   // Update slot configuration manager with new size
   update_slotframe_size(target_size);
+#if SLOT_BANDIT
+  // The resize rebuilt every cell as shared: reinstall the configurations
+  // the cell bandits chose so each arm is credited with its own reward
+  if (resized) {
+    apply_slot_configuration(sf_min, custom_links);
+  }
+#endif
   
   // Note: Slot reconfiguration moved to main loop after statistics collection
 }
@@ -209,14 +284,14 @@ void create_payload() {
 // Structure to hold transmission statistics
 typedef struct {
   uint8_t count;
-  float avg_retransmissions;
+  q_value_t avg_retransmissions;
 } transmission_stats;
 
 // function to empty the queue and/or print the statistics
 transmission_stats empty_schedule_records(uint8_t tx_rx) {
   transmission_stats stats;
   stats.count = 0;
-  stats.avg_retransmissions = 1.0;  // default: no retransmissions
+  stats.avg_retransmissions = Q_ONE;  // default: no retransmissions
   
   queue_packet_status *queue;
   if (tx_rx == 0) {
@@ -233,7 +308,7 @@ transmission_stats empty_schedule_records(uint8_t tx_rx) {
     for(int i = 0; i < queue->size; i++) {
       total_retrans += queue->packets[i].transmission_count;
     }
-    stats.avg_retransmissions = (float)total_retrans / queue->size;
+    stats.avg_retransmissions = Q_FROM_RATIO(total_retrans, queue->size);
   }
   
   #if PRINT_TRANSMISSION_RECORDS
@@ -250,6 +325,30 @@ transmission_stats empty_schedule_records(uint8_t tx_rx) {
   return stats;
 }
 
+/**
+ * Warm start: restore the Q-table, sample count and slot configuration from
+ * the newest valid checkpoint together with the exploration parameter and
+ * the slotframe size
+ * Returns 0 when checkpoints are disabled or none is valid
+ */
+static uint8_t restore_checkpoint(void)
+{
+#if CHECKPOINT_ENABLED
+  checkpoint_app_state_t app;
+  if (checkpoint_restore(&app)) {
+    if (app.policy == get_exploration_policy()) {
+      set_exploration(app.exploration);
+    }
+    if (app.slotframe_size >= TSCH_SCHEDULE_CONF_MIN_LENGTH &&
+        app.slotframe_size <= TSCH_SCHEDULE_CONF_MAX_LENGTH) {
+      current_slotframe_size = app.slotframe_size;
+    }
+    return 1;
+  }
+#endif
+  return 0;
+}
+
 /********** UDP Communication Process - Start **********/
 PROCESS_THREAD(node_udp_process, ev, data)
 {
@@ -266,22 +365,33 @@ PROCESS_THREAD(node_udp_process, ev, data)
   create_payload();
   LOG_INFO("Payload created: %d bytes\n", (int)sizeof(custom_payload));
   
-  // generate random q-values
-  generate_random_q_values();
-  LOG_INFO("Q-values initialized\n");
-  
   // Initialize federated learning
-  federated_learning_init(WEIGHTED_FEDAVG);  // Use weighted averaging
+  federated_learning_init(FEDERATED_METHOD);  // weighted averaging unless configured
   LOG_INFO("Federated learning initialized\n");  
   // Initialize slot configuration manager
   slot_config_init(TSCH_SCHEDULE_DEFAULT_LENGTH);
   LOG_INFO("Slot configuration manager initialized\n");
+
+  // warm start from the last checkpoint, otherwise generate random q-values
+  if (restore_checkpoint()) {
+    LOG_INFO("Q-values restored from checkpoint\n");
+  } else {
+    generate_random_q_values();
+    LOG_INFO("Q-values initialized\n");
+  }
+  LOG_INFO("Exploration policy: %s\n", get_exploration_policy_name(get_exploration_policy()));
   /* Initialization; `rx_packet` is the function for packet reception */
   simple_udp_register(&udp_conn, UDP_PORT, NULL, UDP_PORT, rx_packet);
 
   // Start TSCH with custom schedule
   init_tsch_schedule();
   LOG_INFO("Custom TSCH schedule initialized\n");
+#if CHECKPOINT_ENABLED
+  if (checkpoint_get_sequence() > 0) {
+    // re-apply the restored cell configuration to the new schedule
+    apply_slot_configuration(sf_min, custom_links);
+  }
+#endif
   
   if (node_id == 1)
   { /* node_id is 1, then start as root*/
@@ -331,6 +441,10 @@ PROCESS_THREAD(scheduler_process, ev, data)
   static struct etimer q_table_update_timer;
   // timer to check if the minimal schedule finished setting-up
   static struct etimer minimal_schedule_setup_timer; 
+#if CHECKPOINT_ENABLED
+  // learning cycles since the last checkpoint
+  static uint8_t cycles_since_checkpoint;
+#endif
 
   PROCESS_BEGIN();
   
@@ -347,12 +461,13 @@ PROCESS_THREAD(scheduler_process, ev, data)
   /* Main Scheduler Loop */
   while (1)
   {
-    // getting the action using epsilon-greedy strategy (exploration + exploitation)
-    uint8_t action = get_action_epsilon_greedy(current_epsilon);
+    // getting the action with the exploration policy (exploration + exploitation)
+    uint8_t action = select_action();
     uint8_t best_action = get_highest_q_val();
     LOG_INFO("============ Q-Learning Cycle Start ============\n");
+    // "epsilon" is the exploration parameter: epsilon, temperature or UCB1 c
     LOG_INFO("Selected action: %u (best: %u, epsilon: %.3f)\n", 
-             action, best_action, (double)current_epsilon);
+             action, best_action, (double)Q_TO_FLOAT(get_exploration()));
     LOG_INFO("Slotframe will be resized\n");
     set_up_new_schedule(action);
 
@@ -378,24 +493,34 @@ PROCESS_THREAD(scheduler_process, ev, data)
     transmission_stats rx_stats = empty_schedule_records(1);
 
     // Analyze slot-level performance
-    float avg_slot_reward = analyze_slot_performance();
-    float slot_efficiency_bonus = compute_slot_efficiency_reward();
+    slot_reward_t avg_slot_reward = analyze_slot_performance();
+    q_value_t slot_efficiency_bonus = compute_slot_efficiency_reward();
     
     // calculate the reward using TSCH reward function with retransmissions
-    float new_reward = tsch_reward_function(tx_stats.count, rx_stats.count, buffer_len_before, 
-                                           buffer_len_after, tx_stats.avg_retransmissions);
+    q_value_t new_reward = tsch_reward_function(tx_stats.count, rx_stats.count, buffer_len_before, 
+                                               buffer_len_after, tx_stats.avg_retransmissions);
+    q_value_t base_reward = new_reward;
     
     // Add slot-level efficiency bonus to overall reward
     new_reward += slot_efficiency_bonus;
     
     LOG_INFO("Reward: tx=%u rx=%u avg_retrans=%.2f base_reward=%.2f slot_bonus=%.2f total=%.2f\n", 
              tx_stats.count, rx_stats.count, 
-             (double)tx_stats.avg_retransmissions, (double)new_reward - slot_efficiency_bonus,
-             (double)slot_efficiency_bonus, (double)new_reward);
+             (double)Q_TO_FLOAT(tx_stats.avg_retransmissions), (double)Q_TO_FLOAT(base_reward),
+             (double)Q_TO_FLOAT(slot_efficiency_bonus), (double)Q_TO_FLOAT(new_reward));
     
-    LOG_INFO("Slot performance: avg_slot_reward=%.2f\n", (double)avg_slot_reward);
+    LOG_INFO("Slot performance: avg_slot_reward=%.2f\n", (double)SLOT_REWARD_TO_FLOAT(avg_slot_reward));
+    
+    // observe the state reached (queue occupancy x retransmissions) and
+    // update Q(previous state, action) towards it
+    uint16_t q_index = (uint16_t)get_current_state()->index * Q_VALUE_LIST_SIZE + action;
+    uint8_t state = observe_state(buffer_len_after, tx_stats.avg_retransmissions);
+    LOG_INFO("Observed state: %u (buffer=%u avg_retrans=%.2f)\n", 
+             state, buffer_len_after, (double)Q_TO_FLOAT(tx_stats.avg_retransmissions));
     
     update_q_table(action, new_reward);
+    LOG_INFO("Q-update: action=%u visits=%u step_size=%.3f\n", action, get_visit_count(q_index),
+             (double)Q_TO_FLOAT(get_step_size(get_visit_count(q_index))));
     
     // Print slot summary and apply adaptive reconfiguration periodically (BEFORE reset!)
     if (should_reconfigure_slots()) {
@@ -410,11 +535,30 @@ PROCESS_THREAD(scheduler_process, ev, data)
     // Increment local sample count for federated learning
     increment_local_samples();
     
-    // Apply epsilon decay (reduce exploration over time)
-    current_epsilon *= EPSILON_DECAY;
-    if (current_epsilon < EPSILON_MIN) {
-      current_epsilon = EPSILON_MIN;
+    // Apply epsilon / temperature decay (reduce exploration over time)
+    decay_exploration();
+    
+#if FEDERATED_EB_SUMMARY
+    // Advertised in the next EBs
+    fed_update_summary(node_id, get_current_state()->index);
+#endif
+    
+#if FEDERATED_TRICKLE
+    // A new best action is news for the neighbors: back to the fast interval
+    if (fed_trickle_check_local(&sync_trickle)) {
+      process_poll(&federated_sync_process);
+    }
+#endif
+    
+#if CHECKPOINT_ENABLED
+    // Persist the learned state every CHECKPOINT_INTERVAL cycles
+    if (++cycles_since_checkpoint >= CHECKPOINT_INTERVAL) {
+      checkpoint_app_state_t app = { get_exploration(), get_exploration_policy(),
+                                     current_slotframe_size };
+      checkpoint_save(&app);
+      cycles_since_checkpoint = 0;
     }
+#endif
     
     LOG_INFO("============ Q-Learning Cycle End ============\n\n");
   }
@@ -424,15 +568,30 @@ PROCESS_THREAD(scheduler_process, ev, data)
 
 /********** Federated Learning Synchronization Process - Start ***********/
 
-// Structure to encapsulate Q-table message
-typedef struct {
-    uint16_t node_id;
-    uint8_t num_samples;
-    uint16_t q_table_size;
-    float q_values[Q_VALUE_LIST_SIZE];
-} q_table_message_t;
+/**
+ * Hand a federated message to the stack (with FEDERATED_SLOTFRAME the
+ * packet-ready callback steers it, fragments included, to the model
+ * exchange cell)
+ */
+static void federated_send(struct simple_udp_connection *c, const void *data,
+                           uint16_t datalen, const uip_ipaddr_t *to)
+{
+#if FEDERATED_SLOTFRAME
+    federated_tx = 1;
+#endif
+    simple_udp_sendto(c, data, datalen, to);
+#if FEDERATED_SLOTFRAME
+    federated_tx = 0;
+#endif
+}
 
-// Callback for receiving Q-table messages
+// Callback for receiving federated messages (fed_message_t)
+// Full snapshots in any of the three encodings are accepted, so nodes built
+// with different FEDERATED_CONF_QUANT_BITS interoperate, as do float and
+// fixed-point builds (values travel as Q16.16); a delta that does not apply
+// to the version held for its sender triggers a request for a full snapshot.
+// The UDP payload has no alignment guarantee: the header is copied out and
+// the values are decoded byte-wise where they are
 static void rx_qtable_packet(struct simple_udp_connection *c,
                               const uip_ipaddr_t *sender_addr,
                               uint16_t sender_port,
@@ -441,21 +600,120 @@ static void rx_qtable_packet(struct simple_udp_connection *c,
                               const uint8_t *data,
                               uint16_t datalen)
 {
-    if (datalen == sizeof(q_table_message_t)) {
-        q_table_message_t *msg = (q_table_message_t *)data;
-        
-        LOG_INFO("Received Q-table from node %u (samples=%u)\n", 
-                 msg->node_id, msg->num_samples);
-        
-        // Store neighbor's Q-table
-        if (store_neighbor_q_table(msg->node_id, msg->q_values, msg->num_samples)) {
-            LOG_INFO("Successfully stored Q-table from node %u\n", msg->node_id);
-        } else {
-            LOG_WARN("Failed to store Q-table from node %u\n", msg->node_id);
-        }
+    static fed_message_t msg;
+    const uint8_t *values = data + FED_MESSAGE_HEADER_LEN;
+    uint8_t stored = 0;
+    
+    if (datalen < FED_MESSAGE_HEADER_LEN) {
+        LOG_WARN("Received malformed Q-table message (size=%u)\n", datalen);
+        return;
+    }
+    memcpy(&msg, data, FED_MESSAGE_HEADER_LEN);
+    
+#if FEDERATED_TRICKLE
+    // Every table heard counts towards suppression, or resets the interval
+    // when it disagrees with ours
+    if (msg.type != FED_MSG_REQUEST && fed_trickle_heard(&sync_trickle, msg.best_actions)) {
+        process_poll(&federated_sync_process);
+    }
+#endif
+    
+    switch (msg.type) {
+        case FED_MSG_FULL:
+        case FED_MSG_PARTIAL:
+            // a child's subtree aggregate is stored like a neighbor's table,
+            // weighted by the samples of the whole subtree
+            if ((msg.encoding != 0 && msg.encoding != 8 && msg.encoding != 16) ||
+                msg.count != Q_TABLE_SIZE || datalen != FED_MESSAGE_LEN_FULL(msg.encoding)) {
+                LOG_WARN("Received malformed Q-table message (size=%u, expected=%lu)\n", 
+                         datalen, (unsigned long)FED_MESSAGE_LEN_FULL(FEDERATED_QUANT_BITS));
+                return;
+            }
+            LOG_INFO("Received Q-table from node %u (samples=%u)\n", 
+                     msg.node_id, msg.num_samples);
+            
+            // Same table as the one held: no copy, and nothing new to aggregate
+            if (fed_neighbor_unchanged(msg.node_id, msg.version, msg.checksum,
+                                       msg.num_samples)) {
+                return;
+            }
+            
+            // Store neighbor's Q-table, decoded from the byte buffer
+            if (msg.encoding != 0) {
+                LOG_INFO("Q-table from node %u: bits=%u step=%.4f\n", msg.node_id,
+                         msg.encoding, (double)Q_TO_FLOAT(fed_from_wire(msg.quant.scale)));
+            }
+            stored = store_neighbor_q_table_quantized(msg.node_id, values, msg.encoding,
+                                                      &msg.quant, msg.num_samples);
+            if (stored) {
+                set_neighbor_table_version(msg.node_id, msg.version);
+                set_neighbor_table_checksum(msg.node_id, msg.checksum);
+            }
+            break;
+            
+        case FED_MSG_DELTA:
+            if (datalen != FED_MESSAGE_LEN_DELTA(msg.count)) {
+                LOG_WARN("Received malformed Q-table delta (size=%u)\n", datalen);
+                return;
+            }
+            stored = store_neighbor_q_delta(msg.node_id, msg.base_version, msg.version,
+                                            values, msg.count, msg.num_samples);
+            if (stored) {
+                LOG_INFO("Received Q-table from node %u (samples=%u)\n", 
+                         msg.node_id, msg.num_samples);
+                set_neighbor_table_checksum(msg.node_id, msg.checksum);
+            } else {
+                // version gap: ask the sender for a full snapshot
+                static fed_message_t request;
+                request.type = FED_MSG_REQUEST;
+                request.node_id = node_id;
+                request.count = 0;
+                LOG_INFO("Requesting full Q-table from node %u\n", msg.node_id);
+                federated_send(c, &request, FED_MESSAGE_HEADER_LEN, sender_addr);
+                return;
+            }
+            break;
+            
+        case FED_MSG_REQUEST:
+            LOG_INFO("Node %u requested a full Q-table\n", msg.node_id);
+            fed_request_full();
+            return;
+            
+        case FED_MSG_GLOBAL:
+#if FEDERATED_TREE
+            {
+                // only the model coming down from the preferred parent is
+                // adopted and forwarded, which keeps the flood on the tree
+                uip_ipaddr_t *parent = uip_ds6_defrt_choose();
+                if (msg.count != Q_TABLE_SIZE || datalen != FED_MESSAGE_LEN_FULL(msg.encoding)) {
+                    LOG_WARN("Received malformed network model (size=%u)\n", datalen);
+                    return;
+                }
+                if (parent == NULL || !uip_ipaddr_cmp(parent, sender_addr)) {
+                    return;
+                }
+                if (fed_apply_global_model(&msg, values)) {
+                    // re-encoded when the root used another encoding, msg
+                    // only has room for the local one
+                    uint16_t len = fed_prepare_forward(&msg, values, node_id);
+                    uip_ipaddr_t broadcast_addr;
+                    uip_create_linklocal_allnodes_mcast(&broadcast_addr);
+                    LOG_INFO("Forwarding network model %u\n", msg.version);
+                    federated_send(c, &msg, len, &broadcast_addr);
+                }
+            }
+#endif
+            return;
+            
+        default:
+            LOG_WARN("Unknown federated message type %u\n", msg.type);
+            return;
+    }
+    
+    if (stored) {
+        LOG_INFO("Successfully stored Q-table from node %u\n", msg.node_id);
     } else {
-        LOG_WARN("Received malformed Q-table message (size=%u, expected=%lu)\n", 
-                 datalen, (unsigned long)sizeof(q_table_message_t));
+        LOG_WARN("Failed to store Q-table from node %u\n", msg.node_id);
     }
 }
 
@@ -464,7 +722,8 @@ PROCESS_THREAD(federated_sync_process, ev, data)
     static struct simple_udp_connection federated_conn;
     static struct etimer sync_timer;
     static struct etimer minimal_schedule_setup_timer;
-    static q_table_message_t q_msg;
+    static fed_message_t q_msg;
+    static uint8_t transmit;
     
     PROCESS_BEGIN();
     
@@ -478,51 +737,123 @@ PROCESS_THREAD(federated_sync_process, ev, data)
     simple_udp_register(&federated_conn, UDP_FEDERATED_PORT, NULL, 
                        UDP_FEDERATED_PORT, rx_qtable_packet);
     
+#if FEDERATED_TRICKLE
+    // The random transmission point of the first interval desynchronizes
+    // the nodes
+    fed_trickle_init(&sync_trickle);
+#else
     // Set initial sync timer with small random delay to avoid synchronization
     etimer_set(&sync_timer, (FEDERATED_SYNC_INTERVAL * CLOCK_SECOND) + 
                (random_rand() % (30 * CLOCK_SECOND)));
+#endif
     
     /* Main Federated Sync Loop */
     while (1) {
+#if FEDERATED_TRICKLE
+        // Wait for the next Trickle event; a reset polls the process so the
+        // timer is set again for the new, earlier event
+        {
+            uint32_t next = fed_trickle_next_event(&sync_trickle);
+            uint32_t now = clock_seconds();
+            etimer_set(&sync_timer, next > now ? (next - now) * CLOCK_SECOND : 0);
+        }
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sync_timer) || ev == PROCESS_EVENT_POLL);
+        if (clock_seconds() < fed_trickle_next_event(&sync_trickle)) {
+            continue;
+        }
+        
+        fed_trickle_event_t event = fed_trickle_expired(&sync_trickle);
+        if (event == FED_TRICKLE_WAIT) {
+            LOG_INFO("Trickle interval %lu s (tx=%u suppressed=%u resets=%u)\n",
+                     (unsigned long)sync_trickle.interval, sync_trickle.transmissions,
+                     sync_trickle.suppressions, sync_trickle.resets);
+            continue;
+        }
+        transmit = event == FED_TRICKLE_TRANSMIT;
+#else
         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sync_timer));
+        transmit = 1;
+#endif
         
-        // Clean up stale neighbors (timeout: 2x sync interval)
-        cleanup_stale_neighbors(FEDERATED_SYNC_INTERVAL * 2);
+        // Clean up stale neighbors
+        cleanup_stale_neighbors(FEDERATED_NEIGHBOR_TIMEOUT);
         
-        // Broadcast local Q-table to neighbors
-        if (NETSTACK_ROUTING.node_is_reachable()) {
-            // Prepare Q-table message
-            q_msg.node_id = node_id;
-            q_msg.num_samples = get_local_sample_count();
-            q_msg.q_table_size = Q_VALUE_LIST_SIZE;
-            
-            float *local_q = get_local_q_table_for_sharing();
-            memcpy(q_msg.q_values, local_q, Q_VALUE_LIST_SIZE * sizeof(float));
-            
-            // Broadcast to all nodes (use broadcast address)
+#if FEDERATED_TREE
+        // Tree mode: the root publishes the network-wide model, every other
+        // node sends its subtree aggregate up to its preferred parent
+        if (NETSTACK_ROUTING.node_is_root()) {
+            uint16_t len = fed_prepare_global(&q_msg, node_id);
             uip_ipaddr_t broadcast_addr;
             uip_create_linklocal_allnodes_mcast(&broadcast_addr);
             
-            LOG_INFO("Broadcasting Q-table (samples=%u)\n", q_msg.num_samples);
-            simple_udp_sendto(&federated_conn, &q_msg, sizeof(q_msg), &broadcast_addr);
+            LOG_INFO("Broadcasting network model %u (samples=%u)\n", q_msg.version, q_msg.num_samples);
+            federated_send(&federated_conn, &q_msg, len, &broadcast_addr);
+            
+            uint8_t neighbors;
+            uint16_t samples;
+            fed_aggregation_method_t method;
+            get_federated_stats(&neighbors, &samples, &method);
+            LOG_INFO("Federated aggregation complete: neighbors=%u, method=%u, local_samples=%u\n",
+                     neighbors, method, samples);
+        } else if (NETSTACK_ROUTING.node_is_reachable()) {
+            uip_ipaddr_t *parent = uip_ds6_defrt_choose();
+            if (parent != NULL) {
+                uint16_t len = fed_prepare_partial(&q_msg, node_id);
+                LOG_INFO("Sending subtree aggregate to parent (samples=%u)\n", q_msg.num_samples);
+                federated_send(&federated_conn, &q_msg, len, parent);
+            }
+        }
+#else
+        // Broadcast local Q-table to neighbors
+        if (NETSTACK_ROUTING.node_is_reachable()) {
+#if FEDERATED_EB_SUMMARY
+            // The full table only goes out when the EB summaries heard since
+            // the last sync show a diverging neighbor
+            {
+                fed_summary_t summary;
+                while (pop_eb_summary(&summary)) {
+                    fed_summary_heard(&summary);
+                }
+                transmit = fed_summary_broadcast_needed() && transmit;
+            }
+#endif
+            if (transmit) {
+                // Prepare Q-table message (delta or full snapshot)
+                uint16_t len = fed_prepare_broadcast(&q_msg, node_id);
+                
+                // Broadcast to all nodes (use broadcast address)
+                uip_ipaddr_t broadcast_addr;
+                uip_create_linklocal_allnodes_mcast(&broadcast_addr);
+                
+                LOG_INFO("Broadcasting Q-table (samples=%u)\n", q_msg.num_samples);
+                federated_send(&federated_conn, &q_msg, len, &broadcast_addr);
+            }
             
             // Perform federated aggregation
             uint8_t num_aggregated = federated_aggregate();
             
             if (num_aggregated > 0) {
-                uint8_t neighbors, samples;
+                uint8_t neighbors;
+                uint16_t samples;
                 fed_aggregation_method_t method;
                 get_federated_stats(&neighbors, &samples, &method);
                 
                 LOG_INFO("Federated aggregation complete: neighbors=%u, method=%u, local_samples=%u\n",
                          neighbors, method, samples);
-            } else {
+#if FEDERATED_EB_SUMMARY
+                fed_update_summary(node_id, get_current_state()->index);
+#endif
+            } else if (get_federated_state()->num_active_neighbors == 0) {
+                // otherwise skipped, the stored tables were already mixed in
                 LOG_INFO("No neighbors to aggregate with\n");
             }
         }
+#endif /* FEDERATED_TREE */
         
+#if !FEDERATED_TRICKLE
         // Reset timer for next sync cycle
         etimer_set(&sync_timer, FEDERATED_SYNC_INTERVAL * CLOCK_SECOND);
+#endif
     }
     
     PROCESS_END();
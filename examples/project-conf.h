@@ -28,8 +28,8 @@
 #define TSCH_SCHEDULE_CONF_MAX_LENGTH 101
 #define TSCH_SCHEDULE_CONF_MIN_LENGTH 8
 
-// Maximum number of TSCH links
-#define TSCH_SCHEDULE_CONF_MAX_LINKS 101
+// Maximum number of TSCH links (plus the model exchange cell)
+#define TSCH_SCHEDULE_CONF_MAX_LINKS (101 + FEDERATED_CONF_SLOTFRAME)
 
 // packet buffer length
 #define QUEUEBUF_CONF_NUM 8
@@ -47,6 +47,43 @@
 // To start RL-TSCH
 #define RL_TSCH_ENABLED_CONF 1
 
+// Q-learning arithmetic: 1 = fixed point Q16.16 (motes without FPU), 0 = float
+#define Q_LEARNING_CONF_FIXED_POINT 0
+
+// Q-learning state buckets (queue occupancy x avg retransmissions), 1 x 1 = stateless.
+// The Q-table (and each federated message) grows to buckets x 101 values.
+// #define Q_STATE_BUFFER_BUCKETS 3
+// #define Q_STATE_RETRANS_BUCKETS 2
+
+// Coarse-to-fine action search: 8 bins of slotframe sizes, then refine the best bin
+#define Q_LEARNING_CONF_HIERARCHICAL 0
+
+// Step size of the Q-update per (state, action) visit count:
+// Q_STEP_CONSTANT, Q_STEP_HARMONIC (1/n), Q_STEP_POLYNOMIAL (1/n^0.6), Q_STEP_DECAY_FLOOR
+#define Q_LEARNING_CONF_STEP_SIZE Q_STEP_CONSTANT
+
+// Exploration policy: Q_POLICY_EPSILON_GREEDY, Q_POLICY_UCB1 or Q_POLICY_SOFTMAX
+#define Q_LEARNING_CONF_POLICY Q_POLICY_EPSILON_GREEDY
+
+// Persist Q-table, sample count and slot configuration to CFS every
+// CHECKPOINT_INTERVAL cycles and warm-start from them after a reboot
+#define CHECKPOINT_CONF_ENABLED 1
+// #define CHECKPOINT_INTERVAL 5
+// #define CHECKPOINT_SLOTS 3
+
+// Exchange the Q-tables in a secondary 31-slot slotframe with one shared
+// cell, so they neither take data cells nor show up in the learner's tx/rx
+// counts and buffer occupancy (see federated-learning.h)
+#define FEDERATED_CONF_SLOTFRAME 0
+#if FEDERATED_CONF_SLOTFRAME
+#define TSCH_CONF_WITH_LINK_SELECTOR 1
+#define TSCH_CALLBACK_PACKET_READY federated_packet_ready
+// getCustomBuffLen() skips packets queued for FEDERATED_SLOTFRAME_HANDLE,
+// defined here so queuebuf.c sees the same handle as federated-learning.h
+#define FEDERATED_SLOTFRAME_HANDLE 1
+#define QUEUEBUF_CONF_UNMEASURED_SLOTFRAME FEDERATED_SLOTFRAME_HANDLE
+#endif
+
 // hopping sequence
 #define TSCH_CONF_DEFAULT_HOPPING_SEQUENCE TSCH_HOPPING_SEQUENCE_2_2
 
@@ -485,6 +485,12 @@ uint8_t getCustomBuffLen(){
   uint8_t len = 0;
   struct queuebuf *q;
   for(q = list_head(queuebuf_list); q != NULL; q = list_item_next(q)) {
+#if defined(QUEUEBUF_CONF_UNMEASURED_SLOTFRAME) && TSCH_WITH_LINK_SELECTOR
+    /* packets of a slotframe kept out of the measurements */
+    if(queuebuf_attr(q, PACKETBUF_ATTR_TSCH_SLOTFRAME) == QUEUEBUF_CONF_UNMEASURED_SLOTFRAME) {
+      continue;
+    }
+#endif
     len++;
   }
   return len;
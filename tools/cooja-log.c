@@ -0,0 +1,482 @@
+/*
+ * Parallel parser for Cooja log listener output (see cooja-log.h)
+ */
+#define _GNU_SOURCE
+#include "cooja-log.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *event_names[LOG_EV_COUNT] = {
+    "packet_sent", "packet_received", "cycle_start", "buffer", "action",
+    "reward", "resize", "qtable_rx", "qtable_tx", "fed_aggregate",
+    "enqueue", "app_send", "app_receive"
+};
+
+typedef struct {
+    const char *start;
+    const char *end;
+    unsigned chunk;
+    unsigned long mask;
+    log_event_handler_t handler;
+    unsigned long handler_mask;
+    void *ctx;
+    log_events_t out;
+    size_t capacity;
+} parser_chunk_t;
+
+/********** Field Parsing **********/
+// all helpers stop at `end`: the mapping is not NUL-terminated
+
+static const char *find(const char *p, const char *end, const char *key) {
+    return memmem(p, end - p, key, strlen(key));
+}
+
+static int starts_with(const char *p, const char *end, const char *key) {
+    size_t len = strlen(key);
+    return (size_t)(end - p) >= len && memcmp(p, key, len) == 0;
+}
+
+static int parse_uint(const char **pp, const char *end, unsigned long *value) {
+    const char *p = *pp;
+    unsigned long v = 0;
+    if(p >= end || *p < '0' || *p > '9') {
+        return 0;
+    }
+    while(p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+    }
+    *value = v;
+    *pp = p;
+    return 1;
+}
+
+static int parse_hex(const char **pp, const char *end, unsigned long *value) {
+    const char *p = *pp;
+    unsigned long v = 0;
+    int digits = 0;
+    for(; p < end; p++, digits++) {
+        int d;
+        if(*p >= '0' && *p <= '9') d = *p - '0';
+        else if(*p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+        else if(*p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+        else break;
+        v = (v << 4) | d;
+    }
+    if(digits == 0) {
+        return 0;
+    }
+    *value = v;
+    *pp = p;
+    return 1;
+}
+
+static int parse_float(const char **pp, const char *end, float *value) {
+    const char *p = *pp;
+    int negative = 0;
+    unsigned long integer;
+    float v, scale = 0.1f;
+
+    if(p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    if(!parse_uint(&p, end, &integer)) {
+        return 0;
+    }
+    v = (float)integer;
+    if(p < end && *p == '.') {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1f) {
+            v += (*p - '0') * scale;
+        }
+    }
+    *value = negative ? -v : v;
+    *pp = p;
+    return 1;
+}
+
+// number right after `key`, searched from p
+static int field_uint(const char *p, const char *end, const char *key, unsigned long *value) {
+    const char *f = find(p, end, key);
+    if(f == NULL) {
+        return 0;
+    }
+    f += strlen(key);
+    return parse_uint(&f, end, value);
+}
+
+static int field_float(const char *p, const char *end, const char *key, float *value) {
+    const char *f = find(p, end, key);
+    if(f == NULL) {
+        return 0;
+    }
+    f += strlen(key);
+    return parse_float(&f, end, value);
+}
+
+// node ID from a link-layer address "0009.0009.0009.0009"
+static int field_addr(const char *p, const char *end, const char *key, unsigned long *node) {
+    const char *f = find(p, end, key);
+    if(f == NULL) {
+        return 0;
+    }
+    f += strlen(key);
+    return parse_hex(&f, end, node);
+}
+
+// node ID from the last group of an IPv6 address "fd00::204:4:4:4"
+static int field_ipv6_node(const char *p, const char *end, const char *key, unsigned long *node) {
+    const char *f = find(p, end, key);
+    if(f == NULL) {
+        return 0;
+    }
+    f += strlen(key);
+    const char *last = NULL;
+    for(; f < end && *f != ',' && *f != ' '; f++) {
+        if(*f == ':') {
+            last = f + 1;
+        }
+    }
+    return last != NULL && parse_hex(&last, end, node);
+}
+
+// "[H:]MM:SS.mmm" -> milliseconds
+static int parse_time(const char **pp, const char *end, uint32_t *ms) {
+    const char *p = *pp;
+    unsigned long fields[3], millis;
+    int n = 0;
+
+    while(n < 3 && parse_uint(&p, end, &fields[n])) {
+        n++;
+        if(p < end && *p == ':') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    if(n < 2 || p >= end || *p != '.') {
+        return 0;
+    }
+    p++;
+    if(!parse_uint(&p, end, &millis)) {
+        return 0;
+    }
+    unsigned long seconds = n == 3 ? fields[0] * 3600 + fields[1] * 60 + fields[2]
+                                   : fields[0] * 60 + fields[1];
+    *ms = (uint32_t)(seconds * 1000 + millis);
+    *pp = p;
+    return 1;
+}
+
+/********** Line Parsing **********/
+static int parse_message(const char *msg, const char *end, log_event_t *ev) {
+    unsigned long a, b, c;
+    float f;
+
+    if(starts_with(msg, end, "packet sent to ")) {
+        if(!field_addr(msg, end, "to ", &a) || !field_uint(msg, end, "status ", &b) ||
+           !field_uint(msg, end, "tx ", &c)) {
+            return -1;
+        }
+        ev->type = LOG_EV_PACKET_SENT;
+        ev->u.sent.dest = a;
+        ev->u.sent.status = b;
+        ev->u.sent.tx = c;
+        ev->u.sent.seqno = field_uint(msg, end, "seqno ", &a) ? a : 0;
+    } else if(starts_with(msg, end, "received from ")) {
+        if(!field_addr(msg, end, "from ", &a)) {
+            return -1;
+        }
+        ev->type = LOG_EV_PACKET_RECEIVED;
+        ev->u.received.src = a;
+        ev->u.received.seqno = field_uint(msg, end, "seqno ", &b) ? b : 0;
+    } else if(starts_with(msg, end, "Selected action: ")) {
+        if(!field_uint(msg, end, "action: ", &a)) {
+            return -1;
+        }
+        ev->type = LOG_EV_CYCLE_START;
+        ev->u.cycle.action = a;
+        ev->u.cycle.best = field_uint(msg, end, "best: ", &b) ? b : a;
+        ev->u.cycle.epsilon = field_float(msg, end, "epsilon: ", &f) ? f : 0.0f;
+    } else if(starts_with(msg, end, "Buffer Size: ")) {
+        if(!field_uint(msg, end, "before=", &a) || !field_uint(msg, end, "after=", &b)) {
+            return -1;
+        }
+        ev->type = LOG_EV_BUFFER;
+        ev->u.buffer.before = a;
+        ev->u.buffer.after = b;
+        ev->u.buffer.current = field_uint(msg, end, "current=", &c) ? c : b;
+    } else if(starts_with(msg, end, "Chosen Action: ")) {
+        if(!field_uint(msg, end, "Action: ", &a) || !field_uint(msg, end, "Size: ", &b)) {
+            return -1;
+        }
+        ev->type = LOG_EV_ACTION;
+        ev->u.action.action = a;
+        ev->u.action.slotframe = b;
+    } else if(starts_with(msg, end, "Reward: ")) {
+        if(!field_uint(msg, end, "tx=", &a) || !field_uint(msg, end, "rx=", &b) ||
+           !field_float(msg, end, "avg_retrans=", &ev->u.reward.avg_retrans)) {
+            return -1;
+        }
+        ev->type = LOG_EV_REWARD;
+        ev->u.reward.tx = a;
+        ev->u.reward.rx = b;
+        // older runs only print " reward=" (no slot bonus)
+        if(field_float(msg, end, "total=", &ev->u.reward.total)) {
+            if(!field_float(msg, end, "base_reward=", &ev->u.reward.base)) {
+                ev->u.reward.base = ev->u.reward.total;
+            }
+            if(!field_float(msg, end, "slot_bonus=", &ev->u.reward.bonus)) {
+                ev->u.reward.bonus = 0.0f;
+            }
+        } else if(field_float(msg, end, " reward=", &ev->u.reward.total)) {
+            ev->u.reward.base = ev->u.reward.total;
+            ev->u.reward.bonus = 0.0f;
+        } else {
+            return -1;
+        }
+    } else if(starts_with(msg, end, "Resizing slotframe: ")) {
+        if(!field_uint(msg, end, ": ", &a) || !field_uint(msg, end, "-> ", &b)) {
+            return -1;
+        }
+        ev->type = LOG_EV_RESIZE;
+        ev->u.resize.from = a;
+        ev->u.resize.to = b;
+    } else if(starts_with(msg, end, "Received Q-table from node ")) {
+        if(!field_uint(msg, end, "node ", &a)) {
+            return -1;
+        }
+        ev->type = LOG_EV_QTABLE_RX;
+        ev->u.qtable.from = a;
+        ev->u.qtable.samples = field_uint(msg, end, "samples=", &b) ? b : 0;
+    } else if(starts_with(msg, end, "Broadcasting Q-table")) {
+        ev->type = LOG_EV_QTABLE_TX;
+        ev->u.qtable.from = ev->node;
+        ev->u.qtable.samples = field_uint(msg, end, "samples=", &b) ? b : 0;
+    } else if(starts_with(msg, end, "Federated aggregation complete")) {
+        if(!field_uint(msg, end, "neighbors=", &a)) {
+            return -1;
+        }
+        ev->type = LOG_EV_FED_AGGREGATE;
+        ev->u.fed.neighbors = a;
+        ev->u.fed.method = field_uint(msg, end, "method=", &b) ? b : 0;
+        ev->u.fed.samples = field_uint(msg, end, "local_samples=", &c) ? c : 0;
+    } else if(starts_with(msg, end, "send packet to ")) {
+        const char *q = find(msg, end, "queue ");
+        if(!field_addr(msg, end, "to ", &a) || q == NULL) {
+            return -1;
+        }
+        q += 6;
+        // "queue n/N g/N": neighbour queue then global queue
+        if(!parse_uint(&q, end, &b) || q >= end || *q++ != '/' || !parse_uint(&q, end, &c)) {
+            return -1;
+        }
+        ev->type = LOG_EV_ENQUEUE;
+        ev->u.enqueue.dest = a;
+        ev->u.enqueue.neighbor_queue = b;
+        ev->u.enqueue.capacity = c;
+        ev->u.enqueue.global_queue = (q < end && *q++ == ' ' && parse_uint(&q, end, &a)) ? a : b;
+    } else if(starts_with(msg, end, "Send to ")) {
+        if(!field_uint(msg, end, "packet number ", &a)) {
+            return -1;
+        }
+        ev->type = LOG_EV_APP_SEND;
+        ev->u.app_send.seqno = a;
+    } else if(starts_with(msg, end, "Received from ")) {
+        if(!field_ipv6_node(msg, end, "from ", &a)) {
+            return -1;
+        }
+        ev->type = LOG_EV_APP_RECEIVE;
+        ev->u.app_receive.src = a;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// returns 1 for an event, 0 for a valid line without event, -1 for garbage
+static int parse_line(const char *p, const char *end, log_event_t *ev) {
+    unsigned long id;
+
+    if(!parse_time(&p, end, &ev->time_ms) || p >= end || *p++ != '\t' ||
+       !starts_with(p, end, "ID:")) {
+        return -1;
+    }
+    p += 3;
+    if(!parse_uint(&p, end, &id) || p >= end || *p++ != '\t') {
+        return -1;
+    }
+    ev->node = id;
+
+    // "[INFO: Module    ] message"; anything else is payload garbage
+    if(p >= end || *p != '[') {
+        return -1;
+    }
+    const char *tag_end = memchr(p, ']', end - p);
+    if(tag_end == NULL || tag_end + 2 > end) {
+        return -1;
+    }
+    return parse_message(tag_end + 2, end, ev) == 0 ? 1 : 0;
+}
+
+static void *parse_chunk(void *arg) {
+    parser_chunk_t *chunk = arg;
+    const char *p = chunk->start;
+    log_event_t ev;
+
+    while(p < chunk->end) {
+        const char *eol = memchr(p, '\n', chunk->end - p);
+        const char *line_end = eol != NULL ? eol : chunk->end;
+        if(line_end > p && line_end[-1] == '\r') {
+            line_end--;
+        }
+
+        chunk->out.lines++;
+        memset(&ev, 0, sizeof(ev));
+        int r = parse_line(p, line_end, &ev);
+        if(r < 0) {
+            chunk->out.skipped++;
+        } else if(ev.node > chunk->out.max_node) {
+            chunk->out.max_node = ev.node;
+        }
+        if(r > 0 && chunk->handler != NULL && (chunk->handler_mask & LOG_EV_MASK(ev.type))) {
+            chunk->handler(&ev, chunk->chunk, chunk->ctx);
+        }
+        if(r > 0 && (chunk->mask & LOG_EV_MASK(ev.type))) {
+            if(chunk->out.count == chunk->capacity) {
+                chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 4096;
+                log_event_t *grown = realloc(chunk->out.events, chunk->capacity * sizeof(log_event_t));
+                if(grown == NULL) {
+                    return NULL;  // keep what was parsed so far
+                }
+                chunk->out.events = grown;
+            }
+            chunk->out.events[chunk->out.count++] = ev;
+        }
+        p = eol != NULL ? eol + 1 : chunk->end;
+    }
+    return NULL;
+}
+
+/********** Public Functions **********/
+int cooja_log_parse(const char *path, unsigned long type_mask, unsigned threads,
+                    log_events_t *out) {
+    return cooja_log_scan(path, type_mask, threads, NULL, 0, NULL, out);
+}
+
+int cooja_log_scan(const char *path, unsigned long keep_mask, unsigned threads,
+                   log_event_handler_t handler, unsigned long handler_mask, void *ctx,
+                   log_events_t *out) {
+    parser_chunk_t chunks[COOJA_LOG_MAX_THREADS];
+    pthread_t tids[COOJA_LOG_MAX_THREADS];
+    struct stat st;
+
+    memset(out, 0, sizeof(*out));
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return -1;
+    }
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if(st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return -1;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    if(threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if(threads > COOJA_LOG_MAX_THREADS) {
+        threads = COOJA_LOG_MAX_THREADS;
+    }
+    // no point in chunks smaller than 1 MiB
+    if((size_t)st.st_size / threads < (1 << 20)) {
+        threads = st.st_size / (1 << 20) + 1;
+    }
+
+    // split at line boundaries
+    const char *end = data + st.st_size;
+    const char *p = data;
+    for(unsigned t = 0; t < threads; t++) {
+        memset(&chunks[t], 0, sizeof(chunks[t]));
+        chunks[t].chunk = t;
+        chunks[t].mask = keep_mask;
+        chunks[t].handler = handler;
+        chunks[t].handler_mask = handler_mask;
+        chunks[t].ctx = ctx;
+        chunks[t].start = p;
+        const char *split = t + 1 == threads ? end : data + (st.st_size / threads) * (t + 1);
+        if(split < p) {
+            split = p;
+        }
+        if(split < end) {
+            const char *eol = memchr(split, '\n', end - split);
+            split = eol != NULL ? eol + 1 : end;
+        }
+        chunks[t].end = split;
+        p = split;
+    }
+
+    for(unsigned t = 1; t < threads; t++) {
+        if(pthread_create(&tids[t], NULL, parse_chunk, &chunks[t]) != 0) {
+            parse_chunk(&chunks[t]);
+            tids[t] = 0;
+        }
+    }
+    parse_chunk(&chunks[0]);
+    for(unsigned t = 1; t < threads; t++) {
+        if(tids[t] != 0) {
+            pthread_join(tids[t], NULL);
+        }
+    }
+    munmap((void *)data, st.st_size);
+
+    // concatenate in chunk order
+    size_t total = 0;
+    for(unsigned t = 0; t < threads; t++) {
+        total += chunks[t].out.count;
+    }
+    out->events = malloc((total ? total : 1) * sizeof(log_event_t));
+    if(out->events == NULL) {
+        for(unsigned t = 0; t < threads; t++) {
+            free(chunks[t].out.events);
+        }
+        return -1;
+    }
+    for(unsigned t = 0; t < threads; t++) {
+        memcpy(out->events + out->count, chunks[t].out.events,
+               chunks[t].out.count * sizeof(log_event_t));
+        out->count += chunks[t].out.count;
+        out->lines += chunks[t].out.lines;
+        out->skipped += chunks[t].out.skipped;
+        if(chunks[t].out.max_node > out->max_node) {
+            out->max_node = chunks[t].out.max_node;
+        }
+        free(chunks[t].out.events);
+    }
+    return 0;
+}
+
+void cooja_log_free(log_events_t *ev) {
+    free(ev->events);
+    memset(ev, 0, sizeof(*ev));
+}
+
+const char *cooja_log_event_name(uint8_t type) {
+    return type < LOG_EV_COUNT ? event_names[type] : "unknown";
+}
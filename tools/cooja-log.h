@@ -0,0 +1,105 @@
+#ifndef COOJA_LOG_HEADER
+#define COOJA_LOG_HEADER
+
+/*
+ * Parallel parser for Cooja log listener output
+ *   "<[H:]MM:SS.mmm>\tID:<n>\t[<LEVEL>: <module>] <message>"
+ *
+ * The file is mmap'ed and split at line boundaries into one chunk per
+ * thread; every thread turns the lines it recognises into fixed-size events
+ * and the per-chunk arrays are concatenated, so events keep file order.
+ * Lines without the time/ID prefix or without a "[LEVEL: module]" tag (the
+ * binary payload continuation lines printed by rx_packet()) are skipped.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/********** Events **********/
+typedef enum {
+    LOG_EV_PACKET_SENT,       // TSCH "packet sent to X, seqno S, status s, tx N"
+    LOG_EV_PACKET_RECEIVED,   // TSCH "received from X with seqno S"
+    LOG_EV_CYCLE_START,       // App "Selected action: A (best: B, epsilon: E)"
+    LOG_EV_BUFFER,            // App "Buffer Size: before=B after=A current=C"
+    LOG_EV_ACTION,            // App "Chosen Action: A, Current Slotframe Size: S"
+    LOG_EV_REWARD,            // App "Reward: tx= rx= avg_retrans= base_reward= slot_bonus= total="
+    LOG_EV_RESIZE,            // App "Resizing slotframe: A -> B slots"
+    LOG_EV_QTABLE_RX,         // App "Received Q-table from node M (samples=S)"
+    LOG_EV_QTABLE_TX,         // App "Broadcasting Q-table (samples=S)"
+    LOG_EV_FED_AGGREGATE,     // App "Federated aggregation complete: neighbors=N, method=M, local_samples=S"
+    LOG_EV_ENQUEUE,           // TSCH "send packet to X with seqno S, queue n/N g/N, len ..."
+    LOG_EV_APP_SEND,          // App "Send to <ipv6>, application packet number N"
+    LOG_EV_APP_RECEIVE,       // App "Received from <ipv6>, seqnum ..."
+    LOG_EV_COUNT
+} log_event_type_t;
+
+#define LOG_EV_MASK(type) (1UL << (type))
+#define LOG_EV_MASK_ALL   ((1UL << LOG_EV_COUNT) - 1)
+
+typedef struct {
+    uint32_t time_ms;         // simulation time of the line
+    uint16_t node;            // Cooja mote ID
+    uint8_t type;             // log_event_type_t
+    union {
+        struct { uint16_t dest; uint16_t seqno; uint8_t status; uint8_t tx; } sent;
+        struct { uint16_t src; uint16_t seqno; } received;
+        struct { uint8_t action; uint8_t best; float epsilon; } cycle;
+        struct { uint8_t before; uint8_t after; uint8_t current; } buffer;
+        struct { uint8_t action; uint8_t slotframe; } action;
+        struct { uint8_t tx; uint8_t rx; float avg_retrans; float base; float bonus; float total; } reward;
+        struct { uint8_t from; uint8_t to; } resize;
+        struct { uint16_t from; uint16_t samples; } qtable;
+        struct { uint8_t neighbors; uint8_t method; uint16_t samples; } fed;
+        struct { uint16_t dest; uint8_t neighbor_queue; uint8_t global_queue; uint8_t capacity; } enqueue;
+        struct { uint32_t seqno; } app_send;
+        struct { uint16_t src; } app_receive;
+    } u;
+} log_event_t;
+
+typedef struct {
+    log_event_t *events;      // all recognised events, in file order
+    size_t count;
+    size_t lines;             // lines scanned
+    size_t skipped;           // lines without a valid prefix (garbage)
+    uint16_t max_node;        // highest mote ID seen
+} log_events_t;
+
+/********** Functions **********/
+
+/**
+ * Parse a Cooja log, keeping the event types selected in type_mask
+ * (LOG_EV_MASK() bits). threads == 0 uses one thread per online CPU.
+ * Returns 0 on success, -1 if the file cannot be opened or mapped.
+ */
+int cooja_log_parse(const char *path, unsigned long type_mask, unsigned threads,
+                    log_events_t *out);
+
+/**
+ * Callback for cooja_log_scan(): runs on the parser thread that owns
+ * `chunk` (0 .. COOJA_LOG_MAX_THREADS - 1), so per-chunk accumulators can
+ * be updated without locking and merged afterwards
+ */
+typedef void (*log_event_handler_t)(const log_event_t *ev, unsigned chunk, void *ctx);
+
+#define COOJA_LOG_MAX_THREADS 64
+
+/**
+ * As cooja_log_parse(), additionally passing every event selected in
+ * handler_mask to handler. Events only needed by the handler should be left
+ * out of keep_mask so they are never stored.
+ */
+int cooja_log_scan(const char *path, unsigned long keep_mask, unsigned threads,
+                   log_event_handler_t handler, unsigned long handler_mask, void *ctx,
+                   log_events_t *out);
+
+/**
+ * Release the events returned by cooja_log_parse()
+ */
+void cooja_log_free(log_events_t *ev);
+
+/**
+ * Printable name of an event type
+ */
+const char *cooja_log_event_name(uint8_t type);
+
+#endif /* COOJA_LOG_HEADER */
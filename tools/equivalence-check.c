@@ -0,0 +1,170 @@
+/*
+ * Check that the fixed-point and float learners pick the same actions.
+ *
+ * The transition traces in fixtures/ (written by replay-trainer -o from the
+ * Cooja logs in ../logs) are replayed node by node through q-learning.c:
+ * each transition observes the recorded state and applies the logged
+ * reward to the logged action, then the greedy action of the new state is
+ * recorded. The Makefile builds this file twice; the float build writes
+ * its greedy actions with -w, the fixed-point build replays the same
+ * traces and compares with -c. A different action only counts as a
+ * mismatch when the float learner's best action led the runner-up by more
+ * than -g (near ties may break either way within the fixed-point
+ * resolution). Exits non-zero on any mismatch.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "q-learning.h"
+
+#define CHECK_MAX_NODES 256
+
+typedef struct {
+    q_value_t q[Q_TABLE_SIZE];
+    uint16_t visits[Q_TABLE_SIZE];
+    uint8_t last_buffer;
+    q_value_t last_retrans;
+    uint8_t seen;
+} check_node_t;
+
+static check_node_t nodes[CHECK_MAX_NODES];
+
+static void load_learner(check_node_t *n) {
+    if(!n->seen) {
+        memset(n, 0, sizeof(*n));
+        n->last_retrans = Q_ONE;
+        n->seen = 1;
+    }
+    for(uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        set_q_value(i, n->q[i]);
+        set_visit_count(i, n->visits[i]);
+    }
+    observe_state(n->last_buffer, n->last_retrans);
+}
+
+static void save_learner(check_node_t *n) {
+    memcpy(n->q, get_q_table(), sizeof(n->q));
+    memcpy(n->visits, get_visit_counts(), sizeof(n->visits));
+}
+
+// Lead of the greedy action over the best other action of the current state
+static float greedy_gap(uint8_t greedy) {
+    const q_value_t *row = get_q_table() + get_current_state()->index * Q_VALUE_LIST_SIZE;
+    q_value_t runner_up = 0;
+    uint8_t found = 0;
+    for(uint8_t a = 0; a < Q_VALUE_LIST_SIZE; a++) {
+        if(a != greedy && (!found || row[a] > runner_up)) {
+            runner_up = row[a];
+            found = 1;
+        }
+    }
+    return Q_TO_FLOAT(row[greedy] - runner_up);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s (-w OUT | -c REF) [-g GAP] TRACE...\n"
+           "  -w OUT       write the greedy action after every transition\n"
+           "  -c REF       compare with the actions written by the other build\n"
+           "  -g GAP       lead below which a different action is a tie (default 0.01)\n",
+           prog);
+}
+
+int main(int argc, char **argv) {
+    const char *write_path = NULL;
+    const char *ref_path = NULL;
+    float tolerance = 0.01f;
+    unsigned transitions = 0, ties = 0, mismatches = 0;
+    FILE *out = NULL;
+    FILE *ref = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "w:c:g:h")) != -1) {
+        switch(opt) {
+        case 'w': write_path = optarg; break;
+        case 'c': ref_path = optarg; break;
+        case 'g': tolerance = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if((write_path == NULL) == (ref_path == NULL) || optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(write_path != NULL && (out = fopen(write_path, "w")) == NULL) {
+        perror(write_path);
+        return 1;
+    }
+    if(ref_path != NULL && (ref = fopen(ref_path, "r")) == NULL) {
+        perror(ref_path);
+        return 1;
+    }
+
+    for(int t = optind; t < argc; t++) {
+        FILE *f = fopen(argv[t], "r");
+        char line[256];
+        if(f == NULL) {
+            perror(argv[t]);
+            return 1;
+        }
+        memset(nodes, 0, sizeof(nodes));
+        while(fgets(line, sizeof(line), f) != NULL) {
+            unsigned long time_ms;
+            unsigned node, cycle, action, slotframe, tx, rx, buffer_before, buffer_after;
+            float avg_retrans, slot_bonus, reward;
+            if(sscanf(line, "%lu,%u,%u,%u,%u,%u,%u,%u,%u,%f,%f,%f", &time_ms, &node, &cycle,
+                      &action, &slotframe, &tx, &rx, &buffer_before, &buffer_after,
+                      &avg_retrans, &slot_bonus, &reward) != 12 ||
+               node >= CHECK_MAX_NODES || action >= Q_VALUE_LIST_SIZE) {
+                continue;  // header
+            }
+
+            check_node_t *n = &nodes[node];
+            load_learner(n);
+            observe_state(buffer_after, Q_FROM_FLOAT(avg_retrans));
+            update_q_table(action, Q_FROM_FLOAT(reward));
+            save_learner(n);
+            n->last_buffer = buffer_after;
+            n->last_retrans = Q_FROM_FLOAT(avg_retrans);
+
+            uint8_t greedy = get_highest_q_val();
+            float gap = greedy_gap(greedy);
+            transitions++;
+            if(out != NULL) {
+                fprintf(out, "%u,%u,%u,%.6f\n", node, cycle, greedy, (double)gap);
+                continue;
+            }
+
+            unsigned ref_node, ref_cycle, ref_greedy;
+            float ref_gap;
+            if(fgets(line, sizeof(line), ref) == NULL ||
+               sscanf(line, "%u,%u,%u,%f", &ref_node, &ref_cycle, &ref_greedy, &ref_gap) != 4 ||
+               ref_node != node || ref_cycle != cycle) {
+                printf("FAIL: %s: reference out of step at node %u cycle %u\n", argv[t], node, cycle);
+                return 1;
+            }
+            if(ref_greedy != greedy) {
+                if(ref_gap > tolerance) {
+                    printf("FAIL: %s: node %u cycle %u: action %u, reference %u (lead %.4f)\n",
+                           argv[t], node, cycle, greedy, ref_greedy, (double)ref_gap);
+                    mismatches++;
+                } else {
+                    ties++;
+                }
+            }
+        }
+        fclose(f);
+    }
+
+    if(out != NULL) {
+        fclose(out);
+        return 0;
+    }
+    fclose(ref);
+    printf("equivalence-check: transitions=%u near_ties=%u mismatches=%u\n",
+           transitions, ties, mismatches);
+    return mismatches ? 1 : 0;
+}
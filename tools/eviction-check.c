@@ -0,0 +1,66 @@
+/*
+ * Check of the neighbor eviction policy of federated-learning.c.
+ *
+ * The neighbor table is filled with MAX_FEDERATED_NEIGHBORS nodes whose
+ * sample counts grow with their ID; node 1 is then refreshed with a single
+ * sample, so it is both the most recently updated entry and the one with
+ * the fewest samples. The newcomers that follow must replace node 2 under
+ * FED_EVICT_LRU and node 1 under FED_EVICT_QUALITY, which also drops a
+ * newcomer poorer than every entry. Exits non-zero if any expectation fails.
+ */
+#include <stdio.h>
+
+#include "federated-learning.h"
+
+#if !FEDERATED_STREAMING
+static q_value_t table[Q_TABLE_SIZE];
+static unsigned failures;
+
+static void expect(int condition, const char *what) {
+    if(!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static int present(uint16_t node_id) {
+    return get_neighbor_q_table(node_id) != NULL;
+}
+#endif
+
+int main(void) {
+#if FEDERATED_STREAMING
+    // streaming keeps no tables, presence can't be observed from outside
+    printf("eviction-check: skipped with FEDERATED_STREAMING\n");
+    return 0;
+#else
+    federated_learning_init(FEDAVG);
+    for(uint16_t id = 1; id <= MAX_FEDERATED_NEIGHBORS; id++) {
+        expect(store_neighbor_q_table(id, table, 100 + id), "filling the table");
+    }
+    expect(get_neighbor_evictions() == 0, "no eviction before the table is full");
+    store_neighbor_q_table(1, table, 1);
+
+#if FEDERATED_EVICTION == FED_EVICT_QUALITY
+    expect(!store_neighbor_q_table(1000, table, 0), "newcomer poorer than every entry dropped");
+    expect(!present(1000) && get_neighbor_evictions() == 0, "dropped newcomer evicted nothing");
+    expect(store_neighbor_q_table(1001, table, 500), "newcomer stored");
+    expect(!present(1), "fewest samples evicted");
+    expect(present(2), "least recently updated kept");
+#else
+    expect(store_neighbor_q_table(1000, table, 0), "newcomer stored");
+    expect(!present(2), "least recently updated evicted");
+    expect(present(1), "refreshed entry kept");
+    expect(store_neighbor_q_table(1001, table, 0), "second newcomer stored");
+    expect(!present(3), "next least recently updated evicted");
+    expect(present(1000), "previous newcomer kept");
+#endif
+    expect(get_neighbor_evictions() == 1 + (FEDERATED_EVICTION != FED_EVICT_QUALITY),
+           "eviction count");
+
+    printf("eviction-check: policy=%s neighbors=%u failures=%u\n",
+           FEDERATED_EVICTION == FED_EVICT_QUALITY ? "quality" : "lru",
+           MAX_FEDERATED_NEIGHBORS, failures);
+    return failures ? 1 : 0;
+#endif
+}
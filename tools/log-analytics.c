@@ -0,0 +1,378 @@
+/*
+ * Cooja log analytics for RL-TSCH runs.
+ *
+ * The log is mmap'ed and split across threads by cooja-log.c. Per-node
+ * counters (PDR, retransmission histogram from "packet sent ... tx N",
+ * queue occupancy from "queue a/8 b/8", federated event counts) are
+ * accumulated per parser thread without locking and merged at the end; only
+ * the sparse per-cycle events (slotframe, reward, federated) are kept in
+ * order to write the time series. "ID:n" prefixes give the node; the binary
+ * payload continuation lines printed by rx_packet() are skipped.
+ *
+ * The application PDR counts "Send to" lines against root receptions in
+ * the same log, so a log cut mid-run can show receptions of packets sent
+ * before its first line.
+ *
+ * Output: a per-node summary on stdout and, with -o PREFIX, the CSV files
+ *   PREFIX-nodes.csv      per-node statistics and histograms
+ *   PREFIX-slotframe.csv  slotframe size per cycle and at every resize
+ *   PREFIX-rewards.csv    reward terms per node and cycle
+ *   PREFIX-federated.csv  Q-table broadcasts, receptions and aggregations
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cooja-log.h"
+
+#define ANALYTICS_MAX_NODES   256
+#define TX_HIST_BINS          9     // tx 1..8, last bin is 9 or more
+#define QUEUE_HIST_BINS       17    // occupancy 0..16
+
+#define COUNTER_EVENTS (LOG_EV_MASK(LOG_EV_PACKET_SENT) | LOG_EV_MASK(LOG_EV_PACKET_RECEIVED) | \
+                        LOG_EV_MASK(LOG_EV_ENQUEUE) | LOG_EV_MASK(LOG_EV_APP_SEND) | \
+                        LOG_EV_MASK(LOG_EV_APP_RECEIVE))
+#define SERIES_EVENTS  (LOG_EV_MASK(LOG_EV_ACTION) | LOG_EV_MASK(LOG_EV_REWARD) | \
+                        LOG_EV_MASK(LOG_EV_RESIZE) | LOG_EV_MASK(LOG_EV_QTABLE_TX) | \
+                        LOG_EV_MASK(LOG_EV_QTABLE_RX) | LOG_EV_MASK(LOG_EV_FED_AGGREGATE))
+
+typedef struct {
+    // end-to-end (application) and link layer
+    uint32_t app_sent;
+    uint32_t app_received;        // at the root, attributed to the source
+    uint32_t link_ok;
+    uint32_t link_fail;
+    uint32_t link_rx;
+    uint32_t tx_hist[TX_HIST_BINS + 1];   // successful packets by transmissions
+    uint64_t tx_sum;
+
+    // queue occupancy sampled at every enqueue
+    uint32_t queue_hist[QUEUE_HIST_BINS];
+    uint64_t queue_sum;
+    uint32_t queue_samples;
+    uint8_t queue_max;
+    uint8_t queue_capacity;
+
+    // learning and federated (from the ordered series)
+    uint32_t cycles;
+    double reward_sum;
+    uint32_t resizes;
+    uint8_t slotframe;
+    uint32_t qtable_tx;
+    uint32_t qtable_rx;
+    uint32_t aggregations;
+    uint32_t aggregated_neighbors;
+} node_stats_t;
+
+static node_stats_t *chunk_stats[COOJA_LOG_MAX_THREADS];
+static node_stats_t stats[ANALYTICS_MAX_NODES];
+
+/********** Per-Thread Counters **********/
+static void count_event(const log_event_t *ev, unsigned chunk, void *ctx) {
+    if(chunk_stats[chunk] == NULL) {
+        chunk_stats[chunk] = calloc(ANALYTICS_MAX_NODES, sizeof(node_stats_t));
+        if(chunk_stats[chunk] == NULL) {
+            return;
+        }
+    }
+    if(ev->node >= ANALYTICS_MAX_NODES) {
+        return;
+    }
+    node_stats_t *n = &chunk_stats[chunk][ev->node];
+
+    switch(ev->type) {
+    case LOG_EV_PACKET_SENT:
+        if(ev->u.sent.status == 0) {
+            uint8_t bin = ev->u.sent.tx < 1 ? 1 : ev->u.sent.tx;
+            n->link_ok++;
+            n->tx_hist[bin > TX_HIST_BINS ? TX_HIST_BINS : bin]++;
+            n->tx_sum += ev->u.sent.tx;
+        } else {
+            n->link_fail++;
+        }
+        break;
+    case LOG_EV_PACKET_RECEIVED:
+        n->link_rx++;
+        break;
+    case LOG_EV_ENQUEUE: {
+        uint8_t q = ev->u.enqueue.global_queue;
+        n->queue_hist[q >= QUEUE_HIST_BINS ? QUEUE_HIST_BINS - 1 : q]++;
+        n->queue_sum += q;
+        n->queue_samples++;
+        if(q > n->queue_max) {
+            n->queue_max = q;
+        }
+        if(ev->u.enqueue.capacity > n->queue_capacity) {
+            n->queue_capacity = ev->u.enqueue.capacity;
+        }
+        break;
+    }
+    case LOG_EV_APP_SEND:
+        n->app_sent++;
+        break;
+    case LOG_EV_APP_RECEIVE:
+        if(ev->u.app_receive.src < ANALYTICS_MAX_NODES) {
+            chunk_stats[chunk][ev->u.app_receive.src].app_received++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void merge_counters(void) {
+    for(unsigned c = 0; c < COOJA_LOG_MAX_THREADS; c++) {
+        if(chunk_stats[c] == NULL) {
+            continue;
+        }
+        for(unsigned id = 0; id < ANALYTICS_MAX_NODES; id++) {
+            node_stats_t *src = &chunk_stats[c][id];
+            node_stats_t *dst = &stats[id];
+            dst->app_sent += src->app_sent;
+            dst->app_received += src->app_received;
+            dst->link_ok += src->link_ok;
+            dst->link_fail += src->link_fail;
+            dst->link_rx += src->link_rx;
+            dst->tx_sum += src->tx_sum;
+            for(int b = 0; b <= TX_HIST_BINS; b++) {
+                dst->tx_hist[b] += src->tx_hist[b];
+            }
+            for(int b = 0; b < QUEUE_HIST_BINS; b++) {
+                dst->queue_hist[b] += src->queue_hist[b];
+            }
+            dst->queue_sum += src->queue_sum;
+            dst->queue_samples += src->queue_samples;
+            if(src->queue_max > dst->queue_max) {
+                dst->queue_max = src->queue_max;
+            }
+            if(src->queue_capacity > dst->queue_capacity) {
+                dst->queue_capacity = src->queue_capacity;
+            }
+        }
+        free(chunk_stats[c]);
+        chunk_stats[c] = NULL;
+    }
+}
+
+/********** Ordered Series **********/
+static FILE *open_output(const char *prefix, const char *suffix, const char *header) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s-%s.csv", prefix, suffix);
+    FILE *f = fopen(path, "w");
+    if(f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs(header, f);
+    return f;
+}
+
+static void process_series(const log_events_t *log, const char *prefix) {
+    FILE *sf = NULL, *rw = NULL, *fed = NULL;
+    uint8_t action[ANALYTICS_MAX_NODES] = { 0 };
+
+    if(prefix != NULL) {
+        sf = open_output(prefix, "slotframe", "time_ms,node,slotframe,source\n");
+        rw = open_output(prefix, "rewards",
+                         "time_ms,node,cycle,action,slotframe,tx,rx,avg_retrans,base_reward,slot_bonus,total\n");
+        fed = open_output(prefix, "federated", "time_ms,node,event,peer,samples,neighbors\n");
+    }
+
+    for(size_t i = 0; i < log->count; i++) {
+        const log_event_t *ev = &log->events[i];
+        if(ev->node >= ANALYTICS_MAX_NODES) {
+            continue;
+        }
+        node_stats_t *n = &stats[ev->node];
+
+        switch(ev->type) {
+        case LOG_EV_ACTION:
+            action[ev->node] = ev->u.action.action;
+            n->slotframe = ev->u.action.slotframe;
+            if(sf) {
+                fprintf(sf, "%lu,%u,%u,cycle\n", (unsigned long)ev->time_ms, ev->node, n->slotframe);
+            }
+            break;
+        case LOG_EV_RESIZE:
+            n->resizes++;
+            n->slotframe = ev->u.resize.to;
+            if(sf) {
+                fprintf(sf, "%lu,%u,%u,resize\n", (unsigned long)ev->time_ms, ev->node, n->slotframe);
+            }
+            break;
+        case LOG_EV_REWARD:
+            if(rw) {
+                fprintf(rw, "%lu,%u,%lu,%u,%u,%u,%u,%.2f,%.2f,%.2f,%.2f\n",
+                        (unsigned long)ev->time_ms, ev->node, (unsigned long)n->cycles,
+                        action[ev->node], n->slotframe, ev->u.reward.tx, ev->u.reward.rx,
+                        (double)ev->u.reward.avg_retrans, (double)ev->u.reward.base,
+                        (double)ev->u.reward.bonus, (double)ev->u.reward.total);
+            }
+            n->cycles++;
+            n->reward_sum += ev->u.reward.total;
+            break;
+        case LOG_EV_QTABLE_TX:
+            n->qtable_tx++;
+            if(fed) {
+                fprintf(fed, "%lu,%u,broadcast,,%u,\n", (unsigned long)ev->time_ms, ev->node,
+                        ev->u.qtable.samples);
+            }
+            break;
+        case LOG_EV_QTABLE_RX:
+            n->qtable_rx++;
+            if(fed) {
+                fprintf(fed, "%lu,%u,receive,%u,%u,\n", (unsigned long)ev->time_ms, ev->node,
+                        ev->u.qtable.from, ev->u.qtable.samples);
+            }
+            break;
+        case LOG_EV_FED_AGGREGATE:
+            n->aggregations++;
+            n->aggregated_neighbors += ev->u.fed.neighbors;
+            if(fed) {
+                fprintf(fed, "%lu,%u,aggregate,,%u,%u\n", (unsigned long)ev->time_ms, ev->node,
+                        ev->u.fed.samples, ev->u.fed.neighbors);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if(sf) fclose(sf);
+    if(rw) fclose(rw);
+    if(fed) fclose(fed);
+}
+
+/********** Node Table **********/
+static uint8_t node_present(const node_stats_t *n) {
+    return n->app_sent || n->app_received || n->link_ok || n->link_fail || n->link_rx ||
+           n->queue_samples || n->cycles || n->qtable_tx || n->qtable_rx;
+}
+
+static void write_nodes(const char *prefix, uint8_t queue_bins) {
+    FILE *f = open_output(prefix, "nodes",
+                          "node,app_sent,app_received,pdr,link_ok,link_fail,link_pdr,link_rx,avg_tx");
+    for(int b = 1; b <= TX_HIST_BINS; b++) {
+        fprintf(f, b == TX_HIST_BINS ? ",tx%d_plus" : ",tx%d", b);
+    }
+    fprintf(f, ",queue_mean,queue_max");
+    for(int b = 0; b < queue_bins; b++) {
+        fprintf(f, ",queue%d", b);
+    }
+    fprintf(f, ",cycles,mean_reward,resizes,last_slotframe,qtable_tx,qtable_rx,aggregations,mean_neighbors\n");
+
+    for(unsigned id = 0; id < ANALYTICS_MAX_NODES; id++) {
+        const node_stats_t *n = &stats[id];
+        if(!node_present(n)) {
+            continue;
+        }
+        uint32_t link_total = n->link_ok + n->link_fail;
+        fprintf(f, "%u,%lu,%lu,%.4f,%lu,%lu,%.4f,%lu,%.3f", id,
+                (unsigned long)n->app_sent, (unsigned long)n->app_received,
+                n->app_sent ? (double)n->app_received / n->app_sent : 0.0,
+                (unsigned long)n->link_ok, (unsigned long)n->link_fail,
+                link_total ? (double)n->link_ok / link_total : 0.0,
+                (unsigned long)n->link_rx,
+                n->link_ok ? (double)n->tx_sum / n->link_ok : 0.0);
+        for(int b = 1; b <= TX_HIST_BINS; b++) {
+            fprintf(f, ",%lu", (unsigned long)n->tx_hist[b]);
+        }
+        fprintf(f, ",%.3f,%u", n->queue_samples ? (double)n->queue_sum / n->queue_samples : 0.0,
+                n->queue_max);
+        for(int b = 0; b < queue_bins; b++) {
+            fprintf(f, ",%lu", (unsigned long)n->queue_hist[b]);
+        }
+        fprintf(f, ",%lu,%.3f,%lu,%u,%lu,%lu,%lu,%.2f\n", (unsigned long)n->cycles,
+                n->cycles ? n->reward_sum / n->cycles : 0.0, (unsigned long)n->resizes,
+                n->slotframe, (unsigned long)n->qtable_tx, (unsigned long)n->qtable_rx,
+                (unsigned long)n->aggregations,
+                n->aggregations ? (double)n->aggregated_neighbors / n->aggregations : 0.0);
+    }
+    fclose(f);
+}
+
+static void print_summary(void) {
+    printf("node  app_pdr link_pdr avg_tx queue_mean/max cycles mean_reward slotframe fed_tx/rx/agg\n");
+    for(unsigned id = 0; id < ANALYTICS_MAX_NODES; id++) {
+        const node_stats_t *n = &stats[id];
+        if(!node_present(n)) {
+            continue;
+        }
+        uint32_t link_total = n->link_ok + n->link_fail;
+        printf("%4u  ", id);
+        if(n->app_sent) {
+            printf("%7.3f ", (double)n->app_received / n->app_sent);
+        } else {
+            printf("%7s ", "-");
+        }
+        printf("%8.3f %6.2f %7.2f/%-6u %6lu %11.2f %9u %lu/%lu/%lu\n",
+               link_total ? (double)n->link_ok / link_total : 0.0,
+               n->link_ok ? (double)n->tx_sum / n->link_ok : 0.0,
+               n->queue_samples ? (double)n->queue_sum / n->queue_samples : 0.0, n->queue_max,
+               (unsigned long)n->cycles, n->cycles ? n->reward_sum / n->cycles : 0.0, n->slotframe,
+               (unsigned long)n->qtable_tx, (unsigned long)n->qtable_rx,
+               (unsigned long)n->aggregations);
+    }
+}
+
+/********** Main **********/
+static void usage(const char *prog) {
+    printf("Usage: %s [options] LOG\n"
+           "  -o PREFIX    write PREFIX-{nodes,slotframe,rewards,federated}.csv\n"
+           "  -j THREADS   parser threads (default: one per CPU)\n",
+           prog);
+}
+
+int main(int argc, char **argv) {
+    const char *prefix = NULL;
+    unsigned threads = 0;
+    log_events_t log;
+    struct timespec t0, t1;
+    int opt;
+
+    while((opt = getopt(argc, argv, "o:j:h")) != -1) {
+        switch(opt) {
+        case 'o': prefix = optarg; break;
+        case 'j': threads = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if(cooja_log_scan(argv[optind], SERIES_EVENTS, threads, count_event, COUNTER_EVENTS,
+                      NULL, &log) != 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    merge_counters();
+    process_series(&log, prefix);
+
+    if(prefix != NULL) {
+        uint8_t queue_bins = 0;
+        for(unsigned id = 0; id < ANALYTICS_MAX_NODES; id++) {
+            uint8_t top = stats[id].queue_capacity > stats[id].queue_max ?
+                          stats[id].queue_capacity : stats[id].queue_max;
+            if(top + 1 > queue_bins) {
+                queue_bins = top + 1 > QUEUE_HIST_BINS ? QUEUE_HIST_BINS : top + 1;
+            }
+        }
+        write_nodes(prefix, queue_bins);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("%s: %zu lines (%zu garbage), %zu series events, %.3f s\n", argv[optind],
+           log.lines, log.skipped, log.count,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    print_summary();
+
+    cooja_log_free(&log);
+    return 0;
+}
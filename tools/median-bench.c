@@ -0,0 +1,138 @@
+/*
+ * Benchmark of the coordinate-wise median used by FedMedian.
+ *
+ * For every neighborhood size N (1 .. -n, local table included) one
+ * aggregation takes the median of each of the Q_TABLE_SIZE columns of an
+ * N x Q_TABLE_SIZE table. The previous path (copy the column, qsort() it
+ * with a comparison callback) is timed against fed_median(), which works in
+ * place with median networks for small N and quickselect above. Every
+ * column result of both paths is compared.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "federated-learning.h"
+#include "lib/random.h"
+
+#define BENCH_MAX_COUNT 255
+
+static q_value_t table[BENCH_MAX_COUNT][Q_TABLE_SIZE];
+
+/********** Previous Path **********/
+static int compare_q_value(const void *a, const void *b) {
+    q_value_t fa = *(const q_value_t *)a;
+    q_value_t fb = *(const q_value_t *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static q_value_t qsort_median(q_value_t *values, uint8_t count) {
+    q_value_t temp[BENCH_MAX_COUNT];
+    if(count == 0) return 0;
+    memcpy(temp, values, count * sizeof(q_value_t));
+    qsort(temp, count, sizeof(q_value_t), compare_q_value);
+    if(count % 2 == 0) {
+        return (temp[count / 2 - 1] + temp[count / 2]) / 2;
+    }
+    return temp[count / 2];
+}
+
+/********** Benchmark **********/
+static double elapsed_ns(const struct timespec *t0, const struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+// One aggregation over the first count rows; returns a checksum so the
+// work is not optimised away
+static q_accum_t aggregate(uint8_t count, uint8_t fast, q_value_t *out) {
+    q_value_t column[BENCH_MAX_COUNT];
+    q_accum_t sum = 0;
+    for(int j = 0; j < Q_TABLE_SIZE; j++) {
+        for(int i = 0; i < count; i++) {
+            column[i] = table[i][j];
+        }
+        out[j] = fast ? fed_median(column, count) : qsort_median(column, count);
+        sum += out[j];
+    }
+    return sum;
+}
+
+static void fill_table(uint8_t duplicates) {
+    for(int i = 0; i < BENCH_MAX_COUNT; i++) {
+        for(int j = 0; j < Q_TABLE_SIZE; j++) {
+            // few distinct values with -d, to exercise equal keys
+            int r = duplicates ? random_rand() % 4 : (int)random_rand() - 32768;
+            table[i][j] = Q_FROM_FLOAT((float)r / 256.0f);
+        }
+    }
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -n MAX       largest neighborhood, local table included (default 65)\n"
+           "  -i ROUNDS    aggregations timed per size (default 2000)\n"
+           "  -d           draw values from 4 levels (many equal keys)\n",
+           prog);
+}
+
+int main(int argc, char **argv) {
+    static q_value_t expected[Q_TABLE_SIZE];
+    static q_value_t result[Q_TABLE_SIZE];
+    unsigned max_count = MAX_FEDERATED_NEIGHBORS > 64 ? MAX_FEDERATED_NEIGHBORS + 1 : 65;
+    unsigned rounds = 2000;
+    uint8_t duplicates = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:i:dh")) != -1) {
+        switch(opt) {
+        case 'n': max_count = atoi(optarg); break;
+        case 'i': rounds = atoi(optarg); break;
+        case 'd': duplicates = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(max_count < 1 || max_count > BENCH_MAX_COUNT || rounds == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    random_init(1);
+    fill_table(duplicates);
+
+    printf("values  qsort_us  fed_median_us  speedup\n");
+    unsigned mismatches = 0;
+    volatile q_accum_t sink = 0;
+    for(unsigned count = 1; count <= max_count; count++) {
+        struct timespec t0, t1, t2;
+
+        aggregate(count, 0, expected);
+        aggregate(count, 1, result);
+        for(int j = 0; j < Q_TABLE_SIZE; j++) {
+            if(result[j] != expected[j]) {
+                mismatches++;
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(unsigned r = 0; r < rounds; r++) {
+            sink += aggregate(count, 0, result);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        for(unsigned r = 0; r < rounds; r++) {
+            sink += aggregate(count, 1, result);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        double slow = elapsed_ns(&t0, &t1) / rounds / 1000.0;
+        double fast = elapsed_ns(&t1, &t2) / rounds / 1000.0;
+        if(count <= 8 || count % 8 == 1 || count == max_count) {
+            printf("%6u  %8.2f  %13.2f  %6.1fx\n", count, slow, fast, fast > 0 ? slow / fast : 0.0);
+        }
+    }
+    printf("mismatches: %u\n", mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,582 @@
+/*
+ * Offline replay trainer for RL-TSCH.
+ *
+ * Parses a Cooja log (cooja-log.c, mmap + one thread per core) into
+ * per-node, per-cycle transition records
+ *   (action, slotframe, tx, rx, buffer before/after, avg retransmissions,
+ *    reward)
+ * and replays them, in log order, through the unchanged q-learning.c and
+ * federated-learning.c:
+ * - every transition runs observe_state() + update_q_table() on the node's
+ *   own Q-table (swapped into the learner around each update);
+ * - every "Received Q-table from node M" snapshots M's replayed table for
+ *   the receiver and every "Federated aggregation complete" re-runs the
+ *   aggregation with the snapshots that receiver holds.
+ *
+ * Rewards are taken from the "Reward:" lines, or recomputed with
+ * tsch_reward_function() (-R) so other theta1..theta4 can be evaluated on
+ * recorded traffic. Cycles without a "Reward:" line are rebuilt from the
+ * "packet sent ... tx N" and "received from" lines of that cycle.
+ *
+ * The replayed tables can be written out (-q) and loaded again (-i) to
+ * warm-start a later replay; node 0 in those files is the mean table of all
+ * nodes. The report compares each node's logged actions with the greedy
+ * action of its replayed table.
+ */
+#include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "sys/log.h"
+#include "q-learning.h"
+#include "federated-learning.h"
+#include "cooja-log.h"
+
+#define REPLAY_MAX_NODES      256
+#define REPLAY_RECORD_CAP     20    // MAX_NUMBER_OF_CUSTOM_QUEUE
+#define REPLAY_SF_MIN         8     // TSCH_SCHEDULE_CONF_MIN_LENGTH
+#define REPLAY_SF_MAX         101   // TSCH_SCHEDULE_CONF_MAX_LENGTH
+
+#define REPLAY_EVENTS (LOG_EV_MASK(LOG_EV_PACKET_SENT) | LOG_EV_MASK(LOG_EV_PACKET_RECEIVED) | \
+                       LOG_EV_MASK(LOG_EV_CYCLE_START) | LOG_EV_MASK(LOG_EV_BUFFER) | \
+                       LOG_EV_MASK(LOG_EV_ACTION) | LOG_EV_MASK(LOG_EV_REWARD) | \
+                       LOG_EV_MASK(LOG_EV_QTABLE_RX) | LOG_EV_MASK(LOG_EV_FED_AGGREGATE))
+
+extern q_value_t theta1, theta2, theta3, theta4;
+extern q_value_t learning_rate, discount_factor;
+
+/********** Transition Records **********/
+typedef struct {
+    uint32_t time_ms;
+    uint16_t node;
+    uint16_t cycle;
+    uint8_t action;
+    uint8_t slotframe;
+    uint8_t tx;
+    uint8_t rx;
+    uint8_t buffer_before;
+    uint8_t buffer_after;
+    uint8_t from_packets;     // rebuilt from packet lines (no "Reward:" line)
+    uint8_t action_inferred;  // logged action out of range, taken from the slotframe
+    float avg_retrans;
+    float slot_bonus;
+    float reward;             // logged total reward
+} transition_t;
+
+typedef struct {
+    q_value_t q[Q_TABLE_SIZE];
+    uint16_t visits[Q_TABLE_SIZE];
+    uint8_t last_buffer;
+    q_value_t last_retrans;
+    uint16_t samples;
+
+    // assembly state
+    uint8_t action;
+    uint8_t slotframe;
+    uint8_t buffer_before;
+    uint8_t buffer_after;
+    uint8_t pending;          // action seen, transition not emitted yet
+    uint8_t sent_ok;
+    uint8_t received;
+    uint16_t sent_transmissions;
+    uint16_t cycles;
+
+    // neighbour tables received since start (federated snapshots)
+    q_value_t *neighbor_q[REPLAY_MAX_NODES];
+    uint16_t neighbor_samples[REPLAY_MAX_NODES];
+    uint32_t neighbor_time[REPLAY_MAX_NODES];
+
+    // report
+    uint8_t seen;
+    uint32_t agree;
+    uint32_t replayed;
+    double reward_sum;
+    uint8_t last_action;
+} replay_node_t;
+
+static struct {
+    const char *log_path;
+    const char *transitions_path;
+    const char *qtable_out;
+    const char *qtable_in;
+    unsigned threads;
+    uint8_t recompute;
+    uint8_t federated;
+    fed_aggregation_method_t fed_method;
+} cfg = {
+    .threads = 0,
+    .recompute = 0,
+    .federated = 1,
+    .fed_method = WEIGHTED_FEDAVG,
+};
+
+static replay_node_t *nodes[REPLAY_MAX_NODES];
+static transition_t *transitions;
+static size_t num_transitions, transitions_cap;
+
+/********** Helpers **********/
+// inverse of set_up_new_schedule(): smallest action giving this slotframe size
+static int slotframe_to_action(uint8_t slotframe) {
+    for(int a = 0; a < Q_VALUE_LIST_SIZE; a++) {
+        if(REPLAY_SF_MIN + (a * (REPLAY_SF_MAX - REPLAY_SF_MIN)) / (Q_VALUE_LIST_SIZE - 1) == slotframe) {
+            return a;
+        }
+    }
+    return -1;
+}
+
+static replay_node_t *get_node(uint16_t id) {
+    if(id >= REPLAY_MAX_NODES) {
+        return NULL;
+    }
+    if(nodes[id] == NULL) {
+        nodes[id] = calloc(1, sizeof(replay_node_t));
+        if(nodes[id] == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        nodes[id]->last_retrans = Q_ONE;
+    }
+    return nodes[id];
+}
+
+static void load_learner(replay_node_t *n) {
+    for(uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        set_q_value(i, n->q[i]);
+        set_visit_count(i, n->visits[i]);
+    }
+    observe_state(n->last_buffer, n->last_retrans);
+}
+
+static void save_learner(replay_node_t *n) {
+    memcpy(n->q, get_q_table(), sizeof(n->q));
+    memcpy(n->visits, get_visit_counts(), sizeof(n->visits));
+}
+
+static void emit_transition(uint16_t id, replay_node_t *n, const log_event_t *reward,
+                            uint32_t time_ms) {
+    if(num_transitions == transitions_cap) {
+        transitions_cap = transitions_cap ? transitions_cap * 2 : 1024;
+        transitions = realloc(transitions, transitions_cap * sizeof(transition_t));
+        if(transitions == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    transition_t *t = &transitions[num_transitions++];
+    memset(t, 0, sizeof(*t));
+    t->time_ms = time_ms;
+    t->node = id;
+    t->cycle = n->cycles++;
+    t->action = n->action;
+    t->slotframe = n->slotframe;
+    t->buffer_before = n->buffer_before;
+    t->buffer_after = n->buffer_after;
+
+    // some early runs logged uninitialised actions; the slotframe is reliable
+    if(t->action >= Q_VALUE_LIST_SIZE) {
+        int a = slotframe_to_action(t->slotframe);
+        t->action = a >= 0 ? a : Q_VALUE_LIST_SIZE - 1;
+        t->action_inferred = 1;
+    }
+
+    if(reward != NULL) {
+        t->tx = reward->u.reward.tx;
+        t->rx = reward->u.reward.rx;
+        t->avg_retrans = reward->u.reward.avg_retrans;
+        t->slot_bonus = reward->u.reward.bonus;
+        t->reward = reward->u.reward.total;
+    } else {
+        t->from_packets = 1;
+        t->tx = n->sent_ok;
+        t->rx = n->received;
+        t->avg_retrans = n->sent_ok ? (float)n->sent_transmissions / n->sent_ok : 1.0f;
+        t->reward = Q_TO_FLOAT(tsch_reward_function(t->tx, t->rx, t->buffer_before, t->buffer_after,
+                                                    Q_FROM_FLOAT(t->avg_retrans)));
+    }
+
+    n->pending = 0;
+    n->sent_ok = 0;
+    n->received = 0;
+    n->sent_transmissions = 0;
+}
+
+/********** Replay **********/
+static void replay_transition(const transition_t *t) {
+    replay_node_t *n = get_node(t->node);
+    q_value_t avg_retrans = Q_FROM_FLOAT(t->avg_retrans);
+    q_value_t reward;
+
+    if(cfg.recompute) {
+        reward = tsch_reward_function(t->tx, t->rx, t->buffer_before, t->buffer_after, avg_retrans) +
+                 Q_FROM_FLOAT(t->slot_bonus);
+    } else {
+        reward = Q_FROM_FLOAT(t->reward);
+    }
+
+    load_learner(n);
+    if(get_highest_q_val() == t->action) {
+        n->agree++;
+    }
+    observe_state(t->buffer_after, avg_retrans);
+    update_q_table(t->action, reward);
+    save_learner(n);
+
+    n->last_buffer = t->buffer_after;
+    n->last_retrans = avg_retrans;
+    if(n->samples < UINT16_MAX) {
+        n->samples++;  // mirrors increment_local_samples()
+    }
+    n->replayed++;
+    n->reward_sum += Q_TO_FLOAT(reward);
+    n->last_action = t->action;
+}
+
+static void snapshot_neighbor(uint16_t receiver, const log_event_t *ev) {
+    replay_node_t *n = get_node(receiver);
+    replay_node_t *m = get_node(ev->u.qtable.from);
+    if(n == NULL || m == NULL) {
+        return;
+    }
+    uint16_t from = ev->u.qtable.from;
+    if(n->neighbor_q[from] == NULL) {
+        n->neighbor_q[from] = malloc(sizeof(m->q));
+        if(n->neighbor_q[from] == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(n->neighbor_q[from], m->q, sizeof(m->q));
+    n->neighbor_samples[from] = ev->u.qtable.samples;
+    n->neighbor_time[from] = ev->time_ms / 1000;
+}
+
+static void replay_aggregation(uint16_t id, uint32_t time_ms) {
+    replay_node_t *n = get_node(id);
+
+    // rebuild the receiver's federated state from its snapshots
+    federated_learning_init(cfg.fed_method);
+    set_local_sample_count(n->samples);
+    for(uint16_t m = 0; m < REPLAY_MAX_NODES; m++) {
+        if(n->neighbor_q[m] != NULL) {
+            host_clock_set_seconds(n->neighbor_time[m]);
+            store_neighbor_q_table(m, n->neighbor_q[m], n->neighbor_samples[m]);
+        }
+    }
+    host_clock_set_seconds(time_ms / 1000);
+    cleanup_stale_neighbors(FEDERATED_SYNC_INTERVAL * 2);
+
+    load_learner(n);
+    federated_aggregate();
+    save_learner(n);
+}
+
+/********** Log -> Transitions **********/
+static void assemble(const log_events_t *log) {
+    for(size_t i = 0; i < log->count; i++) {
+        const log_event_t *ev = &log->events[i];
+        replay_node_t *n = get_node(ev->node);
+        if(n == NULL) {
+            continue;
+        }
+        n->seen = 1;
+
+        switch(ev->type) {
+        case LOG_EV_PACKET_SENT:
+            if(ev->u.sent.status == 0 && n->sent_ok < REPLAY_RECORD_CAP) {
+                n->sent_ok++;
+                n->sent_transmissions += ev->u.sent.tx;
+            }
+            break;
+        case LOG_EV_PACKET_RECEIVED:
+            if(n->received < REPLAY_RECORD_CAP) {
+                n->received++;
+            }
+            break;
+        case LOG_EV_BUFFER:
+            n->buffer_before = ev->u.buffer.before;
+            n->buffer_after = ev->u.buffer.after;
+            break;
+        case LOG_EV_ACTION:
+            if(n->pending) {
+                emit_transition(ev->node, n, NULL, ev->time_ms);
+            }
+            n->action = ev->u.action.action;
+            n->slotframe = ev->u.action.slotframe;
+            n->pending = 1;
+            break;
+        case LOG_EV_REWARD:
+            if(n->pending) {
+                emit_transition(ev->node, n, ev, ev->time_ms);
+            }
+            break;
+        case LOG_EV_CYCLE_START:
+            if(n->pending) {
+                emit_transition(ev->node, n, NULL, ev->time_ms);
+            }
+            // counters restart with the new cycle
+            n->sent_ok = 0;
+            n->received = 0;
+            n->sent_transmissions = 0;
+            break;
+        default:
+            break;
+        }
+    }
+    // a cycle still pending was cut off by the end of the log and is dropped
+}
+
+static void replay(const log_events_t *log) {
+    size_t next = 0;
+
+    // transitions and federated events are both in log order
+    for(size_t i = 0; i < log->count; i++) {
+        const log_event_t *ev = &log->events[i];
+        while(next < num_transitions && transitions[next].time_ms <= ev->time_ms) {
+            replay_transition(&transitions[next++]);
+        }
+        if(!cfg.federated || ev->node >= REPLAY_MAX_NODES) {
+            continue;
+        }
+        if(ev->type == LOG_EV_QTABLE_RX) {
+            snapshot_neighbor(ev->node, ev);
+        } else if(ev->type == LOG_EV_FED_AGGREGATE && ev->u.fed.neighbors > 0) {
+            replay_aggregation(ev->node, ev->time_ms);
+        }
+    }
+    while(next < num_transitions) {
+        replay_transition(&transitions[next++]);
+    }
+}
+
+/********** Files **********/
+static int write_transitions(const char *path) {
+    FILE *f = fopen(path, "w");
+    if(f == NULL) {
+        return -1;
+    }
+    fprintf(f, "time_ms,node,cycle,action,slotframe,tx,rx,buffer_before,buffer_after,"
+               "avg_retrans,slot_bonus,reward,from_packets,action_inferred\n");
+    for(size_t i = 0; i < num_transitions; i++) {
+        const transition_t *t = &transitions[i];
+        fprintf(f, "%lu,%u,%u,%u,%u,%u,%u,%u,%u,%.2f,%.2f,%.2f,%u,%u\n",
+                (unsigned long)t->time_ms, t->node, t->cycle, t->action, t->slotframe,
+                t->tx, t->rx, t->buffer_before, t->buffer_after, (double)t->avg_retrans,
+                (double)t->slot_bonus, (double)t->reward, t->from_packets, t->action_inferred);
+    }
+    return fclose(f);
+}
+
+// node,state,action,q; node 0 is the mean table of all replayed nodes
+static int write_qtables(const char *path) {
+    FILE *f = fopen(path, "w");
+    if(f == NULL) {
+        return -1;
+    }
+    fprintf(f, "node,state,action,q\n");
+    for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+        double sum = 0;
+        int count = 0;
+        for(uint16_t id = 1; id < REPLAY_MAX_NODES; id++) {
+            if(nodes[id] != NULL && nodes[id]->replayed > 0) {
+                sum += Q_TO_FLOAT(nodes[id]->q[j]);
+                count++;
+            }
+        }
+        fprintf(f, "0,%u,%u,%.4f\n", j / Q_VALUE_LIST_SIZE, j % Q_VALUE_LIST_SIZE,
+                count ? sum / count : 0.0);
+    }
+    for(uint16_t id = 1; id < REPLAY_MAX_NODES; id++) {
+        if(nodes[id] == NULL || nodes[id]->replayed == 0) {
+            continue;
+        }
+        for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+            fprintf(f, "%u,%u,%u,%.4f\n", id, j / Q_VALUE_LIST_SIZE, j % Q_VALUE_LIST_SIZE,
+                    (double)Q_TO_FLOAT(nodes[id]->q[j]));
+        }
+    }
+    return fclose(f);
+}
+
+// node 0 rows seed every node of the log, per-node rows override them
+static int read_qtables(const char *path, uint16_t max_node) {
+    char line[128];
+    unsigned node, state, action;
+    float q;
+
+    FILE *f = fopen(path, "r");
+    if(f == NULL) {
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f) != NULL) {
+        if(sscanf(line, "%u,%u,%u,%f", &node, &state, &action, &q) != 4 ||
+           state >= Q_NUM_STATES || action >= Q_VALUE_LIST_SIZE || node >= REPLAY_MAX_NODES) {
+            continue;
+        }
+        uint16_t j = state * Q_VALUE_LIST_SIZE + action;
+        if(node == 0) {
+            for(uint16_t id = 1; id <= max_node && id < REPLAY_MAX_NODES; id++) {
+                get_node(id)->q[j] = Q_FROM_FLOAT(q);
+            }
+        } else {
+            get_node(node)->q[j] = Q_FROM_FLOAT(q);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/********** Command Line **********/
+static const char *step_size_names[] = { "constant", "harmonic", "poly", "floor" };
+
+static int parse_step_size(const char *name) {
+    for(uint8_t i = 0; i < sizeof(step_size_names) / sizeof(step_size_names[0]); i++) {
+        if(strcmp(name, step_size_names[i]) == 0) {
+            set_step_size_schedule(i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] LOG\n"
+           "  -o FILE      write the transition records as CSV\n"
+           "  -q FILE      write the replayed Q-tables (node,state,action,q)\n"
+           "  -i FILE      warm-start from Q-tables written by -q\n"
+           "  -R           recompute rewards with tsch_reward_function() and the thetas\n"
+           "  -F           do not replay federated aggregation\n"
+           "  -A METHOD    fedavg | weighted | median | trimmed | krum | staleness\n"
+           "               (default weighted)\n"
+           "  -j THREADS   parser threads (default: one per CPU)\n"
+           "  -v           print the modules' LOG_INFO output\n"
+           "  --theta1..--theta4, --alpha, --gamma VALUE   override learner weights\n"
+           "  --step SCHEDULE  constant | harmonic | poly | floor step size (default constant)\n",
+           prog);
+}
+
+static void parse_args(int argc, char **argv) {
+    enum { OPT_THETA1 = 256, OPT_THETA2, OPT_THETA3, OPT_THETA4, OPT_ALPHA, OPT_GAMMA, OPT_STEP };
+    static const struct option long_options[] = {
+        { "theta1", required_argument, NULL, OPT_THETA1 },
+        { "theta2", required_argument, NULL, OPT_THETA2 },
+        { "theta3", required_argument, NULL, OPT_THETA3 },
+        { "theta4", required_argument, NULL, OPT_THETA4 },
+        { "alpha", required_argument, NULL, OPT_ALPHA },
+        { "gamma", required_argument, NULL, OPT_GAMMA },
+        { "step", required_argument, NULL, OPT_STEP },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    while((opt = getopt_long(argc, argv, "o:q:i:RFA:j:vh", long_options, NULL)) != -1) {
+        switch(opt) {
+        case 'o': cfg.transitions_path = optarg; break;
+        case 'q': cfg.qtable_out = optarg; break;
+        case 'i': cfg.qtable_in = optarg; break;
+        case 'R': cfg.recompute = 1; break;
+        case 'F': cfg.federated = 0; break;
+        case 'A':
+            if(strcmp(optarg, "fedavg") == 0) {
+                cfg.fed_method = FEDAVG;
+            } else if(strcmp(optarg, "weighted") == 0) {
+                cfg.fed_method = WEIGHTED_FEDAVG;
+            } else if(strcmp(optarg, "median") == 0) {
+                cfg.fed_method = FEDMEDIAN;
+            } else if(strcmp(optarg, "trimmed") == 0) {
+                cfg.fed_method = FEDTRIMMED;
+            } else if(strcmp(optarg, "krum") == 0) {
+                cfg.fed_method = FEDKRUM;
+            } else if(strcmp(optarg, "staleness") == 0) {
+                cfg.fed_method = FEDSTALENESS;
+            } else {
+                fprintf(stderr, "unknown aggregation method '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'j': cfg.threads = atoi(optarg); break;
+        case 'v': host_log_level = LOG_LEVEL_INFO; break;
+        case OPT_THETA1: theta1 = Q_FROM_FLOAT(atof(optarg)); break;
+        case OPT_THETA2: theta2 = Q_FROM_FLOAT(atof(optarg)); break;
+        case OPT_THETA3: theta3 = Q_FROM_FLOAT(atof(optarg)); break;
+        case OPT_THETA4: theta4 = Q_FROM_FLOAT(atof(optarg)); break;
+        case OPT_ALPHA: learning_rate = Q_FROM_FLOAT(atof(optarg)); break;
+        case OPT_GAMMA: discount_factor = Q_FROM_FLOAT(atof(optarg)); break;
+        case OPT_STEP:
+            if(parse_step_size(optarg) < 0) {
+                fprintf(stderr, "unknown step-size schedule '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        exit(1);
+    }
+    cfg.log_path = argv[optind];
+}
+
+/********** Main **********/
+int main(int argc, char **argv) {
+    log_events_t log;
+    struct timespec t0, t1, t2;
+
+    parse_args(argc, argv);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if(cooja_log_parse(cfg.log_path, REPLAY_EVENTS, cfg.threads, &log) != 0) {
+        perror(cfg.log_path);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    assemble(&log);
+    if(cfg.qtable_in != NULL && read_qtables(cfg.qtable_in, log.max_node) != 0) {
+        perror(cfg.qtable_in);
+        return 1;
+    }
+    replay(&log);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    if(cfg.transitions_path != NULL && write_transitions(cfg.transitions_path) != 0) {
+        perror(cfg.transitions_path);
+        return 1;
+    }
+    if(cfg.qtable_out != NULL && write_qtables(cfg.qtable_out) != 0) {
+        perror(cfg.qtable_out);
+        return 1;
+    }
+
+    size_t rebuilt = 0, inferred = 0;
+    for(size_t i = 0; i < num_transitions; i++) {
+        rebuilt += transitions[i].from_packets;
+        inferred += transitions[i].action_inferred;
+    }
+    printf("%s: %zu lines (%zu skipped), %zu events, %zu transitions "
+           "(%zu from packet lines, %zu actions inferred)\n",
+           cfg.log_path, log.lines, log.skipped, log.count, num_transitions, rebuilt, inferred);
+    printf("parse %.3f s, replay %.3f s, rewards %s, federated %s\n",
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+           (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9,
+           cfg.recompute ? "recomputed" : "logged", cfg.federated ? "replayed" : "off");
+    printf("node cycles mean_reward last_action greedy_action greedy_q agreement\n");
+    for(uint16_t id = 0; id < REPLAY_MAX_NODES; id++) {
+        replay_node_t *n = nodes[id];
+        if(n == NULL || n->replayed == 0) {
+            continue;
+        }
+        load_learner(n);
+        printf("%4u %6lu %11.2f %11u %13u %8.2f %8.0f%%\n", id, (unsigned long)n->replayed,
+               n->reward_sum / n->replayed, n->last_action, get_highest_q_val(),
+               (double)Q_TO_FLOAT(get_highest_q_value()), 100.0 * n->agree / n->replayed);
+    }
+
+    cooja_log_free(&log);
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * Benchmark of the slot statistics layout.
+ *
+ * One learning cycle of random tx/rx/collision events is spread over a
+ * slotframe of -s slots. The previous array-of-structures path (one
+ * slot_statistics_t with 16-bit counters and a full neighbor address per
+ * slot) is timed against the structure-of-arrays table of
+ * slot-configuration.c for the passes that run once per cycle: recording
+ * the events after a reset, analyze_slot_performance() and
+ * compute_slot_efficiency_reward(). The counters, slot rewards and both
+ * results are compared (the module clamps the slot rewards to
+ * +-SLOT_REWARD_LIMIT).
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "slot-configuration.h"
+#include "lib/random.h"
+
+#define BENCH_MAX_EVENTS 65535
+
+typedef struct {
+    uint8_t slot;
+    uint8_t type;                // 0 tx, 1 rx, 2 collision
+    uint8_t retrans;
+    linkaddr_t addr;
+} bench_event_t;
+
+static bench_event_t events[BENCH_MAX_EVENTS];
+
+/********** Previous Path **********/
+typedef struct {
+    uint16_t successful_tx;
+    uint16_t successful_rx;
+    uint16_t collisions;
+    uint16_t total_attempts;
+    uint16_t retransmissions;
+    uint8_t current_config;
+    uint8_t channel_offset;
+    linkaddr_t primary_neighbor;
+    float slot_reward;
+    uint8_t usage_count;
+} old_slot_t;
+
+static old_slot_t old_slots[MAX_TRACKED_SLOTS];
+
+// Kept out of line like the module functions they are timed against
+
+static __attribute__((noinline)) void old_reset(uint8_t size) {
+    for(int i = 0; i < size; i++) {
+        old_slot_t *slot = &old_slots[i];
+        slot->successful_tx = 0;
+        slot->successful_rx = 0;
+        slot->collisions = 0;
+        slot->total_attempts = 0;
+        slot->retransmissions = 0;
+        slot->usage_count = 0;
+        slot->slot_reward = 0.0;
+    }
+}
+
+static __attribute__((noinline)) void old_record(const bench_event_t *ev) {
+    old_slot_t *slot = &old_slots[ev->slot];
+    slot->total_attempts++;
+    if(ev->type == 2) {
+        slot->collisions++;
+        return;
+    }
+    if(ev->type == 0) {
+        slot->successful_tx++;
+        slot->retransmissions += ev->retrans;
+    } else {
+        slot->successful_rx++;
+    }
+    slot->usage_count++;
+    if(linkaddr_cmp(&slot->primary_neighbor, &linkaddr_null)) {
+        linkaddr_copy(&slot->primary_neighbor, &ev->addr);
+    }
+}
+
+static __attribute__((noinline)) float old_analyze(uint8_t size) {
+    float total_reward = 0.0;
+    uint8_t active_slots = 0;
+    for(int i = 0; i < size; i++) {
+        old_slot_t *slot = &old_slots[i];
+        if(slot->usage_count > 0 || slot->current_config != SLOT_CONFIG_INACTIVE) {
+            float throughput = (float)(slot->successful_tx + slot->successful_rx);
+            float collision_penalty = (float)slot->collisions * 2.0;
+            float retrans_penalty = (float)slot->retransmissions * 0.5;
+            slot->slot_reward = throughput - collision_penalty - retrans_penalty;
+            total_reward += slot->slot_reward;
+            active_slots++;
+        }
+    }
+    return active_slots > 0 ? total_reward / active_slots : 0.0;
+}
+
+static __attribute__((noinline)) float old_efficiency(uint8_t size) {
+    slot_manager_t *m = get_slot_manager();
+    float efficiency_bonus = m->num_dedicated_slots * 2.0;
+    uint8_t inactive_slots = size - m->num_active_slots;
+    if(inactive_slots > size / 3) {
+        efficiency_bonus -= inactive_slots * 0.5;
+    }
+    uint32_t total_collisions = 0;
+    uint32_t total_attempts = 0;
+    for(int i = 0; i < size; i++) {
+        total_collisions += old_slots[i].collisions;
+        total_attempts += old_slots[i].total_attempts;
+    }
+    if(total_attempts > 0) {
+        float collision_rate = (float)total_collisions / total_attempts;
+        if(collision_rate < 0.1) {
+            efficiency_bonus += 5.0;
+        } else if(collision_rate > 0.3) {
+            efficiency_bonus -= 5.0;
+        }
+    }
+    return efficiency_bonus;
+}
+
+/********** Benchmark **********/
+static double elapsed_ns(const struct timespec *t0, const struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static void new_record(const bench_event_t *ev) {
+    if(ev->type == 2) {
+        slot_record_collision(ev->slot);
+    } else if(ev->type == 0) {
+        slot_record_tx(ev->slot, (linkaddr_t *)&ev->addr, ev->retrans);
+    } else {
+        slot_record_rx(ev->slot, (linkaddr_t *)&ev->addr);
+    }
+}
+
+static void record_cycle(unsigned count, uint8_t size, uint8_t fast) {
+    if(fast) {
+        reset_slot_statistics();
+        for(unsigned e = 0; e < count; e++) {
+            new_record(&events[e]);
+        }
+    } else {
+        old_reset(size);
+        for(unsigned e = 0; e < count; e++) {
+            old_record(&events[e]);
+        }
+    }
+}
+
+static void fill_events(unsigned count, uint8_t size, uint8_t neighbors) {
+    for(unsigned e = 0; e < count; e++) {
+        bench_event_t *ev = &events[e];
+        memset(ev, 0, sizeof(*ev));
+        ev->slot = 1 + random_rand() % (size - 1);
+        ev->type = random_rand() % 10 < 2 ? 2 : random_rand() % 2;
+        ev->retrans = random_rand() % 4;
+        ev->addr.u8[0] = 1 + random_rand() % neighbors;
+    }
+}
+
+// Reward of the previous path as the module stores it (clamped, Q8.8 is exact for halves)
+static slot_reward_t clamped_reward(const old_slot_t *slot) {
+    float reward = slot->slot_reward;
+    if(reward > SLOT_REWARD_LIMIT) reward = SLOT_REWARD_LIMIT;
+    if(reward < -SLOT_REWARD_LIMIT) reward = -SLOT_REWARD_LIMIT;
+    return (slot_reward_t)(reward * (1 << SLOT_REWARD_FRAC_BITS));
+}
+
+static unsigned compare(uint8_t size, slot_reward_t new_reward) {
+    slot_statistics_t stats;
+    unsigned mismatches = 0;
+    int32_t total_reward = 0;
+    uint8_t active_slots = 0;
+    for(int i = 0; i < size; i++) {
+        old_slot_t *slot = &old_slots[i];
+        get_slot_statistics(i, &stats);
+        if(stats.successful_tx != slot->successful_tx || stats.successful_rx != slot->successful_rx ||
+           stats.collisions != slot->collisions || stats.total_attempts != slot->total_attempts ||
+           stats.retransmissions != slot->retransmissions ||
+           stats.slot_reward != clamped_reward(slot) ||
+           !linkaddr_cmp(&stats.primary_neighbor, &slot->primary_neighbor)) {
+            mismatches++;
+        }
+        if(slot->usage_count > 0 || slot->current_config != SLOT_CONFIG_INACTIVE) {
+            total_reward += clamped_reward(slot);
+            active_slots++;
+        }
+    }
+    mismatches += (active_slots > 0 ? total_reward / active_slots : 0) != new_reward;
+    return mismatches;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -s SIZE      slotframe size (default %u)\n"
+           "  -e EVENTS    events per learning cycle (default 2000)\n"
+           "  -m NEIGH     distinct neighbors (default 8)\n"
+           "  -i ROUNDS    cycles timed per pass (default 20000)\n",
+           prog, MAX_TRACKED_SLOTS);
+}
+
+int main(int argc, char **argv) {
+    unsigned size = MAX_TRACKED_SLOTS;
+    unsigned count = 2000;
+    unsigned neighbors = 8;
+    unsigned rounds = 20000;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:e:m:i:h")) != -1) {
+        switch(opt) {
+        case 's': size = atoi(optarg); break;
+        case 'e': count = atoi(optarg); break;
+        case 'm': neighbors = atoi(optarg); break;
+        case 'i': rounds = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(size < 2 || size > MAX_TRACKED_SLOTS || count > BENCH_MAX_EVENTS ||
+       neighbors < 1 || neighbors > 255 || rounds == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    random_init(1);
+    fill_events(count, size, neighbors);
+    slot_config_init(size);
+    for(unsigned i = 0; i < size; i++) {
+        old_slots[i].current_config = get_slot_recommendation(i);
+    }
+
+    printf("slots=%u events=%u neighbors=%u counter_bits=%u\n",
+           size, count, neighbors, SLOT_COUNTER_BITS);
+    printf("storage: array of structures %u bytes, structure of arrays %u bytes\n",
+           (unsigned)sizeof(old_slots), (unsigned)sizeof(slot_table_t));
+
+    record_cycle(count, size, 0);
+    record_cycle(count, size, 1);
+    old_analyze(size);
+    unsigned mismatches = compare(size, analyze_slot_performance());
+    mismatches += old_efficiency(size) != Q_TO_FLOAT(compute_slot_efficiency_reward());
+
+    printf("pass        aos_us  soa_us  speedup\n");
+    const char *names[] = { "record", "analyze", "efficiency" };
+    volatile float sink = 0;
+    for(int pass = 0; pass < 3; pass++) {
+        struct timespec t0, t1, t2;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(unsigned r = 0; r < rounds; r++) {
+            if(pass == 0) record_cycle(count, size, 0);
+            else if(pass == 1) sink += old_analyze(size);
+            else sink += old_efficiency(size);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        for(unsigned r = 0; r < rounds; r++) {
+            if(pass == 0) record_cycle(count, size, 1);
+            else if(pass == 1) sink += SLOT_REWARD_TO_FLOAT(analyze_slot_performance());
+            else sink += Q_TO_FLOAT(compute_slot_efficiency_reward());
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        double slow = elapsed_ns(&t0, &t1) / rounds / 1000.0;
+        double fast = elapsed_ns(&t1, &t2) / rounds / 1000.0;
+        printf("%-10s  %6.3f  %6.3f  %6.2fx\n", names[pass], slow, fast, fast > 0 ? slow / fast : 0.0);
+    }
+    printf("mismatches: %u\n", mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Check that the streaming aggregator matches stored-mode weighted FedAvg.
+ *
+ * Node 0 hears -n neighbors for -r rounds. Every round each neighbor's
+ * table takes a seeded random-walk step and is sent as node.c sends it: with
+ * -D 1 a delta against what it last sent, a full snapshot every
+ * FEDERATED_FULL_INTERVAL broadcasts; with -D 0 always a full snapshot (raw
+ * Q16.16, so the delta tolerance is the only loss). Node 0's own table is
+ * reset to the same values before every aggregation, so differences do not
+ * compound. The Makefile builds this file twice: the stored build writes the
+ * aggregated tables with -w, the streaming build, which only takes full
+ * snapshots, aggregates the same rounds and compares with -c. Entries may
+ * differ by -g, plus FEDERATED_DELTA_TOLERANCE when the reference received
+ * deltas (its copies lag the senders by up to that much). Exits non-zero on
+ * any larger difference.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "federated-learning.h"
+
+#define CHECK_MAX_NEIGHBORS MAX_FEDERATED_NEIGHBORS
+#define CHECK_LOCAL_SAMPLES 50
+
+typedef struct {
+    q_value_t q[Q_TABLE_SIZE];
+    q_value_t shadow[Q_TABLE_SIZE];   // table as last sent (delta sync)
+    uint16_t version;                 // 0 = next broadcast is a full snapshot
+    uint8_t since_full;
+} check_neighbor_t;
+
+static check_neighbor_t neighbors[CHECK_MAX_NEIGHBORS];
+static uint32_t seed = 1;
+
+// Same sequence in every build, independent of the modules' random_rand()
+static uint16_t next_random(void) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+// A quarter of the entries move by a multiple of 1/8 in [-1, 1]
+static void random_walk(q_value_t *q) {
+    for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+        if(next_random() % 4 == 0) {
+            int step = (int)(next_random() % 17) - 8;
+            q[j] += Q_FROM_INT(step) / 8;
+        }
+    }
+}
+
+static void send_table(uint8_t i, uint8_t delta, uint16_t num_samples) {
+    static uint8_t buf[Q_TABLE_SIZE * FED_WIRE_RAW_SIZE];
+    const uint16_t max_entries = sizeof(buf) / FED_DELTA_ENTRY_SIZE;
+    check_neighbor_t *n = &neighbors[i];
+    uint16_t id = i + 2;  // node 0 has ID 1
+    uint16_t count = 0;
+    uint8_t full = !delta || n->version == 0 || n->since_full >= FEDERATED_FULL_INTERVAL - 1;
+
+    if(!full) {
+        count = fed_delta_encode(n->q, n->shadow, Q_FROM_FLOAT(FEDERATED_DELTA_TOLERANCE),
+                                 buf, max_entries);
+        full = count > max_entries;
+    }
+    uint16_t base = n->version++;
+    if(full) {
+        fed_quant_params_t params;
+        fed_quantize(n->q, Q_TABLE_SIZE, 0, &params, buf);
+        store_neighbor_q_table_quantized(id, buf, 0, &params, num_samples);
+        set_neighbor_table_version(id, n->version);
+        memcpy(n->shadow, n->q, sizeof(n->shadow));
+        n->since_full = 0;
+    } else if(store_neighbor_q_delta(id, base, n->version, buf, count, num_samples)) {
+        n->since_full++;
+    } else {
+        n->version = 0;  // the receiver asks for a full snapshot
+    }
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s (-w OUT | -c REF) [options]\n"
+           "  -w OUT       write the aggregated table after every round\n"
+           "  -c REF       compare with the tables written by the other build\n"
+           "  -n NEIGH     neighbors (default 5, at most %u)\n"
+           "  -r ROUNDS    aggregation rounds (default 40)\n"
+           "  -D 0|1       delta synchronisation of the neighbors (default 0)\n"
+           "  -g GAP       difference allowed beyond the delta tolerance (default 0.001)\n",
+           prog, CHECK_MAX_NEIGHBORS);
+}
+
+int main(int argc, char **argv) {
+    const char *write_path = NULL;
+    const char *ref_path = NULL;
+    unsigned num_neighbors = 5;
+    unsigned rounds = 40;
+    unsigned delta = 0;
+    float gap = 0.001f;
+    float max_diff = 0.0f;
+    unsigned ref_delta = 0;
+    unsigned failures = 0;
+    FILE *out = NULL;
+    FILE *ref = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "w:c:n:r:D:g:h")) != -1) {
+        switch(opt) {
+        case 'w': write_path = optarg; break;
+        case 'c': ref_path = optarg; break;
+        case 'n': num_neighbors = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'D': delta = atoi(optarg) != 0; break;
+        case 'g': gap = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if((write_path == NULL) == (ref_path == NULL) || num_neighbors < 1 ||
+       num_neighbors > CHECK_MAX_NEIGHBORS || rounds == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(delta && FEDERATED_STREAMING) {
+        printf("FAIL: the streaming aggregator takes full snapshots only (-D 0)\n");
+        return 1;
+    }
+    if(write_path != NULL) {
+        if((out = fopen(write_path, "w")) == NULL) {
+            perror(write_path);
+            return 1;
+        }
+        fprintf(out, "# neighbors=%u rounds=%u delta=%u\n", num_neighbors, rounds, delta);
+    } else {
+        unsigned ref_neighbors, ref_rounds;
+        if((ref = fopen(ref_path, "r")) == NULL) {
+            perror(ref_path);
+            return 1;
+        }
+        if(fscanf(ref, "# neighbors=%u rounds=%u delta=%u\n",
+                  &ref_neighbors, &ref_rounds, &ref_delta) != 3) {
+            printf("FAIL: %s: no header\n", ref_path);
+            return 1;
+        }
+        num_neighbors = ref_neighbors;
+        rounds = ref_rounds;
+        if(ref_delta) {
+            gap += FEDERATED_DELTA_TOLERANCE;
+        }
+    }
+
+    federated_learning_init(WEIGHTED_FEDAVG);
+    for(unsigned i = 0; i < num_neighbors; i++) {
+        for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+            neighbors[i].q[j] = Q_FROM_INT((int)(next_random() % 41) - 20);
+        }
+    }
+
+    for(unsigned r = 0; r < rounds; r++) {
+        for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+            set_q_value(j, Q_FROM_INT((int)(j % 7) - 3));
+            set_visit_count(j, j % 5 != 0);  // some entries never visited locally
+        }
+        set_local_sample_count(CHECK_LOCAL_SAMPLES);
+        for(unsigned i = 0; i < num_neighbors; i++) {
+            random_walk(neighbors[i].q);
+            send_table(i, delta, 10 * (i + 1) + r);
+        }
+        federated_aggregate();
+
+        const q_value_t *q = get_q_table();
+        for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+            float value = Q_TO_FLOAT(q[j]);
+            if(out != NULL) {
+                fprintf(out, "%u,%u,%.6f\n", r, j, (double)value);
+                continue;
+            }
+            unsigned ref_round, ref_index;
+            float ref_value;
+            if(fscanf(ref, "%u,%u,%f\n", &ref_round, &ref_index, &ref_value) != 3 ||
+               ref_round != r || ref_index != j) {
+                printf("FAIL: %s: reference out of step at round %u entry %u\n", ref_path, r, j);
+                return 1;
+            }
+            float diff = value > ref_value ? value - ref_value : ref_value - value;
+            if(diff > max_diff) {
+                max_diff = diff;
+            }
+            if(diff > gap) {
+                printf("FAIL: round %u entry %u: %.4f, reference %.4f\n",
+                       r, j, (double)value, (double)ref_value);
+                failures++;
+            }
+        }
+    }
+
+    if(out != NULL) {
+        fclose(out);
+        return 0;
+    }
+    fclose(ref);
+    printf("streaming-check: neighbors=%u rounds=%u reference_delta=%u max_diff=%.4f allowed=%.4f "
+           "failures=%u\n", num_neighbors, rounds, ref_delta, (double)max_diff, (double)gap, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Host stub of contiki.h for the native learning tools.
+ * Only what q-learning.c, federated-learning.c and slot-configuration.c
+ * use is provided; everything else stays in Contiki-NG.
+ */
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CLOCK_SECOND 128UL
+
+typedef unsigned long clock_time_t;
+
+// simulated time, advanced by the host tool
+unsigned long clock_seconds(void);
+void host_clock_set_seconds(unsigned long seconds);
+
+#endif /* CONTIKI_H_ */
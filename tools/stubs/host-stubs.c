@@ -0,0 +1,107 @@
+/*
+ * Host implementations of the Contiki-NG services stubbed in tools/stubs:
+ * simulated clock, pseudo random generator, link addresses and a minimal
+ * TSCH schedule (slotframes and links in static pools).
+ */
+#include "contiki.h"
+#include "lib/random.h"
+#include "sys/log.h"
+#include "net/linkaddr.h"
+#include "net/mac/tsch/tsch.h"
+
+int host_log_level = LOG_LEVEL_WARN;
+
+const linkaddr_t linkaddr_null = { { 0 } };
+linkaddr_t linkaddr_node_addr;
+const linkaddr_t tsch_broadcast_address = { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff } };
+
+/********** Clock **********/
+static unsigned long host_seconds;
+
+unsigned long clock_seconds(void) {
+  return host_seconds;
+}
+
+void host_clock_set_seconds(unsigned long seconds) {
+  host_seconds = seconds;
+}
+
+/********** Random (xorshift32, 16-bit output) **********/
+static uint32_t random_state = 0x2545f491;
+
+void random_init(unsigned short seed) {
+  random_state = 0x2545f491 ^ ((uint32_t)seed << 8 | seed);
+  if(random_state == 0) {
+    random_state = 1;
+  }
+}
+
+unsigned short random_rand(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (unsigned short)(random_state >> 16);
+}
+
+/********** TSCH schedule **********/
+#define MAX_SLOTFRAMES 4
+
+static struct tsch_slotframe slotframes[MAX_SLOTFRAMES];
+static uint8_t slotframe_in_use[MAX_SLOTFRAMES];
+static struct tsch_link links[TSCH_SCHEDULE_MAX_LINKS];
+
+struct tsch_slotframe *tsch_schedule_add_slotframe(uint16_t handle, uint16_t size) {
+  for(int i = 0; i < MAX_SLOTFRAMES; i++) {
+    if(!slotframe_in_use[i]) {
+      slotframe_in_use[i] = 1;
+      slotframes[i].handle = handle;
+      slotframes[i].size = size;
+      return &slotframes[i];
+    }
+  }
+  return NULL;
+}
+
+int tsch_schedule_remove_all_slotframes(void) {
+  memset(slotframe_in_use, 0, sizeof(slotframe_in_use));
+  for(int i = 0; i < TSCH_SCHEDULE_MAX_LINKS; i++) {
+    links[i].in_use = 0;
+  }
+  return 1;
+}
+
+struct tsch_link *tsch_schedule_add_link(struct tsch_slotframe *slotframe,
+                                         uint8_t link_options, enum link_type link_type,
+                                         const linkaddr_t *address, uint16_t timeslot,
+                                         uint16_t channel_offset, uint8_t do_remove) {
+  if(slotframe == NULL) {
+    return NULL;
+  }
+  for(int i = 0; i < TSCH_SCHEDULE_MAX_LINKS; i++) {
+    if(links[i].in_use && do_remove &&
+       links[i].slotframe_handle == slotframe->handle && links[i].timeslot == timeslot) {
+      links[i].in_use = 0;
+    }
+  }
+  for(int i = 0; i < TSCH_SCHEDULE_MAX_LINKS; i++) {
+    if(!links[i].in_use) {
+      links[i].in_use = 1;
+      links[i].slotframe_handle = slotframe->handle;
+      links[i].link_options = link_options;
+      links[i].link_type = link_type;
+      links[i].timeslot = timeslot;
+      links[i].channel_offset = channel_offset;
+      linkaddr_copy(&links[i].addr, address != NULL ? address : &linkaddr_null);
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+
+int tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l) {
+  if(slotframe == NULL || l == NULL || !l->in_use) {
+    return 0;
+  }
+  l->in_use = 0;
+  return 1;
+}
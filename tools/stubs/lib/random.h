@@ -0,0 +1,10 @@
+/* Host stub of the Contiki-NG pseudo random generator */
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#define RANDOM_RAND_MAX 65535U
+
+unsigned short random_rand(void);
+void random_init(unsigned short seed);
+
+#endif /* RANDOM_H_ */
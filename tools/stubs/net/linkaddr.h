@@ -0,0 +1,20 @@
+/* Host stub of the Contiki-NG link-layer address (8-byte, as in TSCH) */
+#ifndef LINKADDR_H_
+#define LINKADDR_H_
+
+#include "contiki.h"
+
+#define LINKADDR_SIZE 8
+
+typedef union {
+  uint8_t u8[LINKADDR_SIZE];
+  uint16_t u16;
+} linkaddr_t;
+
+extern const linkaddr_t linkaddr_null;
+extern linkaddr_t linkaddr_node_addr;
+
+#define linkaddr_cmp(addr1, addr2) (memcmp((addr1), (addr2), LINKADDR_SIZE) == 0)
+#define linkaddr_copy(dest, src) memcpy((dest), (src), LINKADDR_SIZE)
+
+#endif /* LINKADDR_H_ */
@@ -0,0 +1,46 @@
+/*
+ * Host stub of the TSCH schedule API. Links are kept in a flat pool so
+ * the host tools can inspect what slot-configuration.c installs.
+ */
+#ifndef TSCH_H_
+#define TSCH_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+#define LINK_OPTION_TX      1
+#define LINK_OPTION_RX      2
+#define LINK_OPTION_SHARED  4
+
+enum link_type { LINK_TYPE_NORMAL, LINK_TYPE_ADVERTISING, LINK_TYPE_ADVERTISING_ONLY };
+
+struct tsch_slotframe {
+  uint16_t handle;
+  uint16_t size;
+};
+
+struct tsch_link {
+  linkaddr_t addr;
+  uint16_t slotframe_handle;
+  uint16_t timeslot;
+  uint16_t channel_offset;
+  uint8_t link_options;
+  enum link_type link_type;
+  uint8_t in_use;
+};
+
+#ifndef TSCH_SCHEDULE_MAX_LINKS
+#define TSCH_SCHEDULE_MAX_LINKS 256
+#endif
+
+extern const linkaddr_t tsch_broadcast_address;
+
+struct tsch_slotframe *tsch_schedule_add_slotframe(uint16_t handle, uint16_t size);
+int tsch_schedule_remove_all_slotframes(void);
+struct tsch_link *tsch_schedule_add_link(struct tsch_slotframe *slotframe,
+                                         uint8_t link_options, enum link_type link_type,
+                                         const linkaddr_t *address, uint16_t timeslot,
+                                         uint16_t channel_offset, uint8_t do_remove);
+int tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l);
+
+#endif /* TSCH_H_ */
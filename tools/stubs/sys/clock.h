@@ -0,0 +1,2 @@
+/* Host stub: the clock API lives in contiki.h */
+#include "contiki.h"
@@ -0,0 +1,42 @@
+/*
+ * Host stub of the Contiki-NG logging macros. Messages are printed when
+ * their level is enabled both by the module (LOG_LEVEL) and globally by
+ * host_log_level, which the host tools keep at LOG_LEVEL_WARN by default.
+ */
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdio.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERR  1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DBG  4
+
+extern int host_log_level;
+
+#define LOG_OUTPUT(level, levelstr, ...) do { \
+    if((level) <= LOG_LEVEL && (level) <= host_log_level) { \
+      printf("[%-4s: %-10s] ", levelstr, LOG_MODULE); \
+      printf(__VA_ARGS__); \
+    } \
+  } while(0)
+
+#define LOG_OUTPUT_(level, ...) do { \
+    if((level) <= LOG_LEVEL && (level) <= host_log_level) { \
+      printf(__VA_ARGS__); \
+    } \
+  } while(0)
+
+#define LOG_ERR(...)  LOG_OUTPUT(LOG_LEVEL_ERR, "ERR", __VA_ARGS__)
+#define LOG_WARN(...) LOG_OUTPUT(LOG_LEVEL_WARN, "WARN", __VA_ARGS__)
+#define LOG_INFO(...) LOG_OUTPUT(LOG_LEVEL_INFO, "INFO", __VA_ARGS__)
+#define LOG_DBG(...)  LOG_OUTPUT(LOG_LEVEL_DBG, "DBG", __VA_ARGS__)
+
+#define LOG_ERR_(...)  LOG_OUTPUT_(LOG_LEVEL_ERR, __VA_ARGS__)
+#define LOG_WARN_(...) LOG_OUTPUT_(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO_(...) LOG_OUTPUT_(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DBG_(...)  LOG_OUTPUT_(LOG_LEVEL_DBG, __VA_ARGS__)
+
+#endif /* LOG_H_ */
@@ -0,0 +1,1067 @@
+/*
+ * Host-native RL-TSCH simulator.
+ *
+ * Links tsch/q-learning.c, tsch/federated-learning.c and
+ * tsch/slot-configuration.c unchanged (against the stubs in tools/stubs) and
+ * drives them with a synthetic TSCH contention/channel model, so reward
+ * weights and learner changes can be evaluated at thousands of learning
+ * cycles per second instead of Cooja real time.
+ *
+ * Model (one collision domain, single hop, 10 ms timeslots):
+ * - every node generates packets (exponential inter-arrival) into a queue of
+ *   QUEUEBUF_NUM packets, each addressed to a random other node;
+ * - with the autonomous model a node wakes in one random shared cell per
+ *   slotframe, with the shared model it may use every shared cell but slot 0;
+ * - a queued packet is sent when the TSCH backoff window allows it; two
+ *   transmissions in the same timeslot and channel offset collide, a lone one
+ *   is lost with probability -p, receivers cannot receive while transmitting;
+ * - a packet is dropped after SIM_MAX_TRANSMISSIONS attempts.
+ *
+ * Learning follows examples/node.c: one cycle is Q_TABLE_INTERVAL (120 s),
+ * the action maps to a slotframe size of 8..101 and the reward is
+ * tsch_reward_function() of the per-cycle tx/rx records (capped at the size
+ * of the custom queues) plus, for node 0, the slot efficiency bonus.
+ *
+ * Every learning node keeps its own Q-table, swapped in and out of the
+ * single q-learning.c instance around its turn. Node 0 is the observed node:
+ * it owns the slot configuration manager and the federated state, receiving
+ * the tables of all other learners every -F cycles. With -T every learner
+ * runs a Trickle timer instead: its broadcasts reach node 0 and are heard by
+ * all other learners, and node 0 aggregates at its own transmission points.
+ * With -R the learners form a binary tree rooted at node 0 instead: subtree
+ * aggregates travel up to the root and its network model is flooded down.
+ */
+#include <getopt.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "sys/log.h"
+#include "q-learning.h"
+#include "federated-learning.h"
+#include "slot-configuration.h"
+
+/********** Model Parameters **********/
+#define SIM_CYCLE_SECONDS       120   // Q_TABLE_INTERVAL in examples/node.c
+#define SIM_SLOTS_PER_CYCLE     (SIM_CYCLE_SECONDS * 100)
+#define SIM_QUEUE_CAPACITY      8     // QUEUEBUF_CONF_NUM
+#define SIM_RECORD_CAPACITY     20    // MAX_NUMBER_OF_CUSTOM_QUEUE
+#define SIM_MAX_TRANSMISSIONS   8     // TSCH_MAC_MAX_FRAME_RETRIES + 1
+#define SIM_MIN_BE              1
+#define SIM_MAX_BE              5
+#define SIM_MAX_NODES           32
+#define SIM_FAULT_RANGE         200   // corrupted Q-values of the -X learner
+#define SIM_SF_MIN              8     // TSCH_SCHEDULE_CONF_MIN_LENGTH
+#define SIM_SF_MAX              101   // TSCH_SCHEDULE_CONF_MAX_LENGTH
+
+// reward weights live in q-learning.c
+extern q_value_t theta1, theta2, theta3, theta4;
+extern q_value_t learning_rate, discount_factor;
+
+typedef enum {
+  SIM_MODEL_AUTONOMOUS,   // one random shared cell per slotframe
+  SIM_MODEL_SHARED        // every shared cell, TSCH backoff only
+} sim_model_t;
+
+typedef struct {
+  q_value_t q[Q_TABLE_SIZE];   // private Q-table (swapped into q-learning.c)
+  uint16_t visits[Q_TABLE_SIZE];
+  q_value_t exploration;       // private exploration parameter (epsilon, temperature)
+  q_value_t shadow[Q_TABLE_SIZE];  // table as last sent to node 0 (delta sync)
+  uint16_t version;            // version of the last table sent
+  uint8_t since_full;          // deltas sent since the last full snapshot
+  unsigned long received_at;   // last time node 0 received this table
+  fed_trickle_t trickle;       // -T: dissemination timer
+  uint8_t last_buffer;         // last observation, restored before each turn
+  q_value_t last_retrans;
+
+  uint8_t action;
+  uint8_t slotframe_size;
+  uint8_t offset;              // timeslot offset of the current asn
+  uint8_t cell;                // autonomous model: cell of this slotframe
+  uint8_t queue_len;
+  uint8_t head_tx;             // transmissions spent on the head packet
+  uint8_t backoff;             // shared cells to skip
+  uint8_t be;                  // backoff exponent
+  uint32_t next_arrival;       // asn of the next generated packet
+
+  // per-cycle records, like the custom tx/rx queues
+  uint8_t tx_records;
+  uint8_t rx_records;
+  uint16_t tx_transmissions;
+  uint8_t buffer_before;
+
+  // totals for the summary
+  uint32_t generated;
+  uint32_t delivered;
+  uint32_t dropped;
+  double reward_sum;           // over the last quarter of the run
+} sim_node_t;
+
+static struct {
+  uint8_t num_nodes;
+  uint8_t learners;
+  uint32_t cycles;
+  unsigned short seed;
+  float traffic;               // packets per node per cycle
+  float per;
+  sim_model_t model;
+  uint8_t fed_interval;        // cycles between federated rounds, 0 = off
+  fed_aggregation_method_t fed_method;
+  uint8_t quant_bits;          // wire encoding of the shared tables, 0 = raw
+  uint8_t delta;               // delta synchronisation between full snapshots
+  uint8_t faulty;              // learner sharing a corrupted table, 0 = none
+  float fed_loss;              // probability a federated broadcast is lost
+  uint8_t trickle;             // Trickle dissemination instead of -F rounds
+  uint8_t tree;                // tree aggregation in the -F rounds
+  uint8_t trace;
+} cfg = {
+  .num_nodes = 10,
+  .learners = 0,               // 0 = every node learns
+  .cycles = 2000,
+  .seed = 1,
+  .traffic = 15.0f,
+  .per = 0.1f,
+  .model = SIM_MODEL_AUTONOMOUS,
+  .fed_interval = 2,           // FEDERATED_SYNC_INTERVAL rounded to cycles
+  .fed_method = WEIGHTED_FEDAVG,
+  .quant_bits = FEDERATED_QUANT_BITS,
+  .delta = FEDERATED_DELTA_SYNC,
+  .faulty = 0,
+  .fed_loss = 0.0f,
+  .trickle = 0,
+  .tree = 0,
+  .trace = 0,
+};
+
+static sim_node_t nodes[SIM_MAX_NODES];
+static uint32_t asn;
+
+// schedule of node 0, maintained like examples/node.c
+static struct tsch_slotframe *sf_min;
+static struct tsch_link *custom_links[SIM_SF_MAX];
+
+/********** Helpers **********/
+static float uniform(void) {
+  return (float)random_rand() / (RANDOM_RAND_MAX + 1.0f);
+}
+
+static uint32_t interarrival(void) {
+  float mean = SIM_SLOTS_PER_CYCLE / cfg.traffic;
+  return 1 + (uint32_t)(-logf(1.0f - uniform()) * mean);
+}
+
+static void node_addr(uint8_t id, linkaddr_t *addr) {
+  linkaddr_copy(addr, &linkaddr_null);
+  addr->u8[0] = id + 1;
+}
+
+static uint8_t action_to_slotframe_size(uint8_t action) {
+  return SIM_SF_MIN + (action * (SIM_SF_MAX - SIM_SF_MIN)) / (Q_VALUE_LIST_SIZE - 1);
+}
+
+static void build_schedule(uint8_t size) {
+  tsch_schedule_remove_all_slotframes();
+  sf_min = tsch_schedule_add_slotframe(0, size);
+  custom_links[0] = tsch_schedule_add_link(sf_min, LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+                                           LINK_TYPE_ADVERTISING, &tsch_broadcast_address, 0, 0, 1);
+  for(int i = 1; i < size; i++) {
+    custom_links[i] = tsch_schedule_add_link(sf_min, LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+                                             LINK_TYPE_NORMAL, &tsch_broadcast_address, i, 0, 1);
+  }
+}
+
+static uint8_t is_learner(uint8_t id) {
+  return id < cfg.learners;
+}
+
+/********** Learner Context Switch **********/
+static void load_learner(sim_node_t *n) {
+  for(uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+    set_q_value(i, n->q[i]);
+    set_visit_count(i, n->visits[i]);
+  }
+  set_exploration(n->exploration);
+  // restore the current state so actions are chosen in this node's state
+  observe_state(n->last_buffer, n->last_retrans);
+}
+
+static void save_learner(sim_node_t *n) {
+  memcpy(n->q, get_q_table(), sizeof(n->q));
+  memcpy(n->visits, get_visit_counts(), sizeof(n->visits));
+}
+
+// -T, -R: federated state of every learner, swapped through the module like the
+// Q-tables (node 0's is in the module outside trickle_run())
+static federated_state_t fed_states[SIM_MAX_NODES];
+static uint8_t fed_current;
+
+static void switch_federated(uint8_t id) {
+  if(id != fed_current) {
+    fed_states[fed_current] = *get_federated_state();
+    *get_federated_state() = fed_states[id];
+    fed_current = id;
+  }
+}
+
+/********** Channel Model **********/
+// channel offset node i transmits on in timeslot `offset`, or -1 if the
+// node has no usable TX cell there
+static int tx_channel(uint8_t id, uint8_t offset) {
+  sim_node_t *n = &nodes[id];
+  if(offset == 0) {
+    return -1;  // advertising cell carries EBs only
+  }
+  if(cfg.model == SIM_MODEL_AUTONOMOUS && offset != n->cell) {
+    return -1;
+  }
+  if(id == 0) {
+    struct tsch_link *l = custom_links[offset];
+    if(l == NULL || !(l->link_options & LINK_OPTION_TX)) {
+      return -1;
+    }
+    return l->channel_offset;
+  }
+  return 0;
+}
+
+static uint8_t can_receive(uint8_t id, uint8_t offset, int channel) {
+  if(id != 0) {
+    return channel == 0;
+  }
+  struct tsch_link *l = custom_links[offset];
+  return l != NULL && (l->link_options & LINK_OPTION_RX) && l->channel_offset == channel;
+}
+
+static void run_cycle(void) {
+  static uint8_t transmitters[SIM_MAX_NODES];
+  static int channels[SIM_MAX_NODES];
+  static uint8_t offsets[SIM_MAX_NODES];
+  linkaddr_t addr;
+
+  for(uint32_t t = 0; t < SIM_SLOTS_PER_CYCLE; t++, asn++) {
+    uint8_t n_tx = 0;
+
+    for(uint8_t i = 0; i < cfg.num_nodes; i++) {
+      sim_node_t *n = &nodes[i];
+      uint8_t offset = n->offset;
+      offsets[i] = offset;
+      if(++n->offset == n->slotframe_size) {
+        n->offset = 0;
+      }
+
+      while(asn >= n->next_arrival) {
+        n->generated++;
+        if(n->queue_len < SIM_QUEUE_CAPACITY) {
+          n->queue_len++;
+        } else {
+          n->dropped++;
+        }
+        n->next_arrival += interarrival();
+      }
+
+      if(offset == 0 && cfg.model == SIM_MODEL_AUTONOMOUS) {
+        n->cell = 1 + random_rand() % (n->slotframe_size - 1);
+        // node 0 only picks among the cells its schedule still has
+        for(uint8_t tries = 1; i == 0 && custom_links[n->cell] == NULL &&
+            tries < n->slotframe_size; tries++) {
+          n->cell = 1 + n->cell % (n->slotframe_size - 1);
+        }
+      }
+
+      int channel = tx_channel(i, offset);
+      if(channel < 0 || n->queue_len == 0) {
+        continue;
+      }
+      if(n->backoff > 0) {
+        n->backoff--;
+        continue;
+      }
+      channels[i] = channel;
+      transmitters[n_tx++] = i;
+    }
+
+    for(uint8_t k = 0; k < n_tx; k++) {
+      uint8_t src = transmitters[k];
+      sim_node_t *n = &nodes[src];
+      uint8_t collided = 0;
+      for(uint8_t j = 0; j < n_tx; j++) {
+        if(j != k && channels[transmitters[j]] == channels[src]) {
+          collided = 1;
+          break;
+        }
+      }
+
+      uint8_t dest = random_rand() % (cfg.num_nodes - 1);
+      if(dest >= src) {
+        dest++;
+      }
+      uint8_t dest_offset = offsets[dest];
+      uint8_t dest_busy = 0;
+      for(uint8_t j = 0; j < n_tx; j++) {
+        if(transmitters[j] == dest) {
+          dest_busy = 1;
+        }
+      }
+
+      n->head_tx++;
+      if(!collided && !dest_busy && can_receive(dest, dest_offset, channels[src]) &&
+         uniform() >= cfg.per) {
+        if(n->tx_records < SIM_RECORD_CAPACITY) {
+          n->tx_records++;
+          n->tx_transmissions += n->head_tx;
+        }
+        if(nodes[dest].rx_records < SIM_RECORD_CAPACITY) {
+          nodes[dest].rx_records++;
+        }
+        if(src == 0) {
+          node_addr(dest, &addr);
+          slot_record_tx(offsets[src], &addr, n->head_tx);
+        }
+        if(dest == 0) {
+          node_addr(src, &addr);
+          slot_record_rx(dest_offset, &addr);
+        }
+        n->delivered++;
+        n->queue_len--;
+        n->head_tx = 0;
+        n->be = SIM_MIN_BE;
+        continue;
+      }
+
+      if(collided && src == 0) {
+        slot_record_collision(offsets[src]);
+        slot_record_interference(offsets[src], channels[src], SLOT_EVENT_COLLISION);
+      } else if(src == 0) {
+        slot_record_interference(offsets[src], channels[src], SLOT_EVENT_NOACK);
+      }
+      if(n->head_tx >= SIM_MAX_TRANSMISSIONS) {
+        n->dropped++;
+        n->queue_len--;
+        n->head_tx = 0;
+        n->be = SIM_MIN_BE;
+      } else {
+        if(n->be < SIM_MAX_BE) {
+          n->be++;
+        }
+        n->backoff = random_rand() % (1 << n->be);
+      }
+    }
+  }
+}
+
+/********** Learning Cycle **********/
+static void start_cycle(uint8_t id) {
+  sim_node_t *n = &nodes[id];
+
+  if(is_learner(id)) {
+    if(cfg.learners > 1) {
+      load_learner(n);
+    }
+    n->action = select_action();
+  } else {
+    n->action = nodes[0].action;  // followers copy node 0
+  }
+
+  uint8_t size = action_to_slotframe_size(n->action);
+  if(id == 0 && size != n->slotframe_size) {
+    build_schedule(size);
+    update_slotframe_size(size);
+#if SLOT_BANDIT
+    apply_slot_configuration(sf_min, custom_links);
+#endif
+  }
+  n->slotframe_size = size;
+  n->offset = asn % size;
+  n->buffer_before = n->queue_len;
+}
+
+static void end_cycle(uint8_t id, uint32_t cycle) {
+  sim_node_t *n = &nodes[id];
+
+  q_value_t avg_retrans = Q_ONE;
+  if(n->tx_records > 0) {
+    avg_retrans = Q_FROM_RATIO(n->tx_transmissions, n->tx_records);
+  }
+
+  q_value_t reward = tsch_reward_function(n->tx_records, n->rx_records, n->buffer_before,
+                                          n->queue_len, avg_retrans);
+  q_value_t slot_bonus = 0;
+  if(id == 0) {
+    analyze_slot_performance();
+    slot_bonus = compute_slot_efficiency_reward();
+    reward += slot_bonus;
+  }
+
+  if(is_learner(id)) {
+    if(cfg.learners > 1) {
+      load_learner(n);
+    }
+    observe_state(n->queue_len, avg_retrans);
+    update_q_table(n->action, reward);
+    if(cfg.learners > 1) {
+      save_learner(n);
+    }
+    n->last_buffer = n->queue_len;
+    n->last_retrans = avg_retrans;
+
+    decay_exploration();
+    n->exploration = get_exploration();
+    if(cfg.trickle) {
+      fed_trickle_check_local(&n->trickle);
+    }
+    if(cfg.trickle || cfg.tree) {
+      if(id != 0) {
+        switch_federated(id);
+        increment_local_samples();
+        switch_federated(0);
+      }
+    }
+  }
+
+  if(id == 0) {
+    if(should_reconfigure_slots()) {
+      reconfigure_slots_adaptive(sf_min, custom_links);
+    }
+    reset_slot_statistics();
+    increment_local_samples();
+  }
+
+  if(cycle >= cfg.cycles - cfg.cycles / 4) {
+    n->reward_sum += Q_TO_FLOAT(reward);
+  }
+
+  if(cfg.trace) {
+    printf("%lu,%u,%u,%u,%u,%u,%u,%u,%.3f,%.3f,%.3f\n",
+           (unsigned long)cycle, id, n->action, n->slotframe_size,
+           n->tx_records, n->rx_records, n->buffer_before, n->queue_len,
+           (double)Q_TO_FLOAT(avg_retrans), (double)Q_TO_FLOAT(slot_bonus), (double)Q_TO_FLOAT(reward));
+  }
+
+  n->tx_records = 0;
+  n->rx_records = 0;
+  n->tx_transmissions = 0;
+}
+
+// federated traffic and the difference between aggregating the tables as
+// received over the air and the raw tables
+static struct {
+  uint32_t full;
+  uint32_t delta;
+  uint32_t delta_entries;
+  uint32_t lost;
+  uint64_t bytes;
+  uint64_t full_only_bytes;    // same rounds with full snapshots only
+  double max_error;
+  double sum_error;
+  uint32_t values;
+} sync_stats;
+
+// Send learner i's table as node i would: a delta against what it sent
+// before, or a full snapshot (first round, periodic, delta too large). It
+// reaches node 0, with -T every other learner. With -L each reception may be
+// lost; the receiver keeps the older table. Returns the receivers as a mask
+static uint32_t deliver_table(uint8_t i) {
+  static uint8_t buf[Q_TABLE_SIZE * FED_WIRE_RAW_SIZE];
+  sim_node_t *n = &nodes[i];
+  uint16_t values_len = Q_TABLE_SIZE * FED_WIRE_VALUE_SIZE(cfg.quant_bits);
+  uint16_t max_entries = values_len / FED_DELTA_ENTRY_SIZE;
+  uint16_t count = 0;
+  uint8_t full = !cfg.delta || n->version == 0 || n->since_full >= FEDERATED_FULL_INTERVAL - 1;
+  uint8_t gap = 0;
+  uint32_t received = 0;
+  fed_quant_params_t params;
+
+  if(!full) {
+    count = fed_delta_encode(n->q, n->shadow, Q_FROM_FLOAT(FEDERATED_DELTA_TOLERANCE),
+                             buf, max_entries);
+    full = count > max_entries;
+  }
+  if(full) {
+    fed_quantize(n->q, Q_TABLE_SIZE, cfg.quant_bits, &params, buf);
+  }
+  // identifies the table the receivers end up with, as in the message
+  uint16_t checksum = fed_table_checksum(full ? n->q : n->shadow);
+
+  uint16_t base = n->version++;
+  for(uint8_t r = 0; r < (cfg.trickle ? cfg.learners : 1); r++) {
+    if(r == i) {
+      continue;
+    }
+    if(cfg.fed_loss > 0.0f && random_rand() < cfg.fed_loss * 65536.0f) {
+      sync_stats.lost++;
+      continue;
+    }
+    received |= 1UL << r;
+    switch_federated(r);
+    if(r == 0) {
+      n->received_at = clock_seconds();
+    }
+    if(full) {
+      if(fed_neighbor_unchanged(i + 1, n->version, checksum, get_local_sample_count())) {
+        continue;
+      }
+      store_neighbor_q_table_quantized(i + 1, buf, cfg.quant_bits, &params,
+                                       get_local_sample_count());
+      set_neighbor_table_version(i + 1, n->version);
+      set_neighbor_table_checksum(i + 1, checksum);
+    } else if(store_neighbor_q_delta(i + 1, base, n->version, buf, count,
+                                     get_local_sample_count())) {
+      set_neighbor_table_checksum(i + 1, checksum);
+    } else {
+      gap = 1;
+    }
+  }
+  switch_federated(0);
+
+  if(full) {
+    memcpy(n->shadow, n->q, sizeof(n->shadow));
+    n->since_full = 0;
+    sync_stats.full++;
+    sync_stats.bytes += FED_MESSAGE_HEADER_LEN + values_len;
+  } else {
+    // an evicted receiver answers with a request, the next send is full
+    if(gap) {
+      n->version = 0;
+    }
+    n->since_full++;
+    sync_stats.delta++;
+    sync_stats.delta_entries += count;
+    sync_stats.bytes += FED_MESSAGE_HEADER_LEN + count * FED_DELTA_ENTRY_SIZE;
+  }
+  sync_stats.full_only_bytes += FED_MESSAGE_HEADER_LEN + values_len;
+  return received;
+}
+
+// table of the faulty learner before it was last corrupted
+static q_value_t healthy[Q_TABLE_SIZE];
+
+// a faulty learner restarts from scratch and shares a corrupted table; the
+// reference aggregation uses the table it held before
+static void corrupt_faulty(void) {
+  memcpy(healthy, nodes[cfg.faulty].q, sizeof(healthy));
+  load_learner(&nodes[cfg.faulty]);
+  generate_random_q_values();
+  for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+    set_q_value(j, Q_FROM_INT((int)(random_rand() % (2 * SIM_FAULT_RANGE + 1)) - SIM_FAULT_RANGE));
+  }
+  save_learner(&nodes[cfg.faulty]);
+}
+
+// Aggregation on node 0 (loaded) over the tables it holds, measured against
+// aggregating the raw tables
+static void aggregate_node0(void) {
+  static q_value_t received[SIM_MAX_NODES][Q_TABLE_SIZE];
+  static uint8_t held[SIM_MAX_NODES];
+  static q_value_t reference[Q_TABLE_SIZE];
+  // the streaming aggregator keeps no tables to compare against, and with
+  // no table changed the aggregation is skipped
+  uint8_t lossy = !FEDERATED_STREAMING && get_federated_state()->tables_changed &&
+                  (cfg.quant_bits || cfg.delta || cfg.faulty || cfg.fed_loss > 0.0f);
+
+  if(lossy) {
+    // aggregate the raw (healthy) tables as the reference, then put back what
+    // node 0 actually received
+    // (only the neighbors node 0 holds, the others were evicted)
+    for(uint8_t i = 1; i < cfg.learners; i++) {
+      const q_value_t *q = get_neighbor_q_table(i + 1);
+      held[i] = q != NULL;
+      if(held[i]) {
+        memcpy(received[i], q, sizeof(received[i]));
+        store_neighbor_q_table(i + 1, i == cfg.faulty ? healthy : nodes[i].q,
+                               get_local_sample_count());
+      }
+    }
+    federated_aggregate();
+    memcpy(reference, get_q_table(), sizeof(reference));
+    load_learner(&nodes[0]);
+    unsigned long now = clock_seconds();
+    for(uint8_t i = 1; i < cfg.learners; i++) {
+      if(held[i]) {
+        host_clock_set_seconds(nodes[i].received_at);  // keep the table's age
+        store_neighbor_q_table(i + 1, received[i], get_local_sample_count());
+        set_neighbor_table_version(i + 1, nodes[i].version);
+      }
+    }
+    host_clock_set_seconds(now);
+  }
+  federated_aggregate();
+
+  if(lossy) {
+    const q_value_t *q = get_q_table();
+    for(uint16_t j = 0; j < Q_TABLE_SIZE; j++) {
+      double error = fabs((double)Q_TO_FLOAT(q[j] - reference[j]));
+      sync_stats.sum_error += error;
+      if(error > sync_stats.max_error) {
+        sync_stats.max_error = error;
+      }
+    }
+    sync_stats.values += Q_TABLE_SIZE;
+  }
+  save_learner(&nodes[0]);
+}
+
+static void federated_round(void) {
+  if(cfg.faulty) {
+    corrupt_faulty();
+  }
+
+  load_learner(&nodes[0]);
+  for(uint8_t i = 1; i < cfg.learners; i++) {
+    deliver_table(i);
+  }
+  aggregate_node0();
+}
+
+// Run the learners' Trickle timers up to `until` (seconds), events in time
+// order. A broadcast is heard by every learner that receives it; each learner
+// aggregates at its transmission point, sent or suppressed, node 0 measured
+// against the raw tables as in federated_round()
+static void trickle_run(unsigned long until) {
+  uint8_t best[Q_NUM_STATES];
+
+  for(;;) {
+    int next = -1;
+    uint32_t at = 0;
+    for(uint8_t i = 0; i < cfg.learners; i++) {
+      uint32_t event = fed_trickle_next_event(&nodes[i].trickle);
+      if(event <= until && (next < 0 || event < at)) {
+        next = i;
+        at = event;
+      }
+    }
+    if(next < 0) {
+      break;
+    }
+
+    host_clock_set_seconds(at);
+    sim_node_t *n = &nodes[next];
+    if(next == cfg.faulty && next != 0 && !n->trickle.tx_passed) {
+      corrupt_faulty();
+    }
+    load_learner(n);
+    fed_trickle_event_t event = fed_trickle_expired(&n->trickle);
+    if(event == FED_TRICKLE_WAIT) {
+      continue;
+    }
+
+    if(event == FED_TRICKLE_TRANSMIT) {
+      fed_best_actions(best);
+      uint32_t received = deliver_table(next);
+      for(uint8_t j = 0; j < cfg.learners; j++) {
+        if(received & (1UL << j)) {
+          load_learner(&nodes[j]);
+          fed_trickle_heard(&nodes[j].trickle, best);
+        }
+      }
+    }
+
+    load_learner(n);
+    if(next == 0) {
+      aggregate_node0();
+    } else {
+      switch_federated(next);
+      federated_aggregate();
+      save_learner(n);
+      switch_federated(0);
+    }
+  }
+  host_clock_set_seconds(until);
+  load_learner(&nodes[0]);
+}
+
+// -R traffic and the samples behind the network model
+static struct {
+  uint32_t rounds;
+  uint32_t up;                 // subtree aggregates sent to the parent
+  uint32_t down;               // network model broadcasts (root and forwarders)
+  uint32_t lost;
+  uint64_t bytes;
+  uint32_t model_samples;      // of the last network model
+} tree_stats;
+
+static uint8_t tree_lost(void) {
+  if(cfg.fed_loss > 0.0f && random_rand() < cfg.fed_loss * 65536.0f) {
+    tree_stats.lost++;
+    return 1;
+  }
+  return 0;
+}
+
+// -R: learner i's parent is (i - 1) / 2. Subtree aggregates go up deepest
+// learner first, so the root's model covers the whole tree in one round; a
+// learner that misses the model (-L) does not forward it to its children
+static void tree_round(void) {
+  static fed_message_t msg;
+  static uint8_t adopted[SIM_MAX_NODES];
+
+  for(int i = cfg.learners - 1; i > 0; i--) {
+    switch_federated(i);
+    load_learner(&nodes[i]);
+    uint16_t len = fed_prepare_partial(&msg, i + 1);
+    tree_stats.up++;
+    tree_stats.bytes += len;
+    if(tree_lost()) {
+      continue;
+    }
+    switch_federated((i - 1) / 2);
+    store_neighbor_q_table_quantized(msg.node_id, msg.values, msg.encoding, &msg.quant,
+                                     msg.num_samples);
+  }
+
+  switch_federated(0);
+  load_learner(&nodes[0]);
+  uint16_t len = fed_prepare_global(&msg, 1);
+  save_learner(&nodes[0]);
+  tree_stats.model_samples = msg.num_samples;
+  adopted[0] = 1;
+  for(uint8_t i = 0; i < cfg.learners; i++) {
+    if(i > 0) {
+      adopted[i] = adopted[(i - 1) / 2] && !tree_lost();
+      if(!adopted[i]) {
+        continue;
+      }
+      switch_federated(i);
+      load_learner(&nodes[i]);
+      fed_apply_global_model(&msg, msg.values);
+      save_learner(&nodes[i]);
+    }
+    tree_stats.down++;
+    tree_stats.bytes += len;
+  }
+  tree_stats.rounds++;
+  switch_federated(0);
+  load_learner(&nodes[0]);
+}
+
+/********** Command Line **********/
+static const char *step_size_names[] = { "constant", "harmonic", "poly", "floor" };
+
+static int parse_step_size(const char *name) {
+  for(uint8_t i = 0; i < sizeof(step_size_names) / sizeof(step_size_names[0]); i++) {
+    if(strcmp(name, step_size_names[i]) == 0) {
+      set_step_size_schedule(i);
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int parse_policy(const char *name) {
+  for(uint8_t i = Q_POLICY_EPSILON_GREEDY; i <= Q_POLICY_SOFTMAX; i++) {
+    if(strcmp(name, get_exploration_policy_name(i)) == 0) {
+      set_exploration_policy(i);
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void usage(const char *prog) {
+  printf("Usage: %s [options]\n"
+         "  -n NODES     nodes in the collision domain (2-%u, default %u)\n"
+         "  -l LEARNERS  nodes running their own Q-learner, the rest follow node 0\n"
+         "               (default: all)\n"
+         "  -c CYCLES    learning cycles of %u s (default %lu)\n"
+         "  -r RATE      packets generated per node per cycle (default %.1f)\n"
+         "  -p PER       packet error rate of collision-free attempts (default %.2f)\n"
+         "  -m MODEL     autonomous | shared (default autonomous)\n"
+         "  -F CYCLES    federated round every CYCLES cycles, 0 disables (default %u)\n"
+         "  -A METHOD    fedavg | weighted | median | trimmed | krum | staleness\n"
+         "               (default weighted)\n"
+         "  -Q BITS      wire encoding of shared Q-tables: 0 (raw), 8, 16 (default %u)\n"
+         "  -D 0|1       delta synchronisation between full snapshots (default %u)\n"
+         "  -X LEARNER   learner that restarts and shares a corrupted table (values\n"
+         "               uniform in +-%u) every federated round (default none)\n"
+         "  -L LOSS      probability that a federated broadcast is lost (default 0)\n"
+         "  -T           Trickle dissemination (Imin %u s, %u doublings, k %u) instead\n"
+         "               of -F rounds\n"
+         "  -R           tree aggregation in the -F rounds (binary tree rooted at\n"
+         "               node 0, %u bit encoding)\n"
+         "  -s SEED      random seed (default %u)\n"
+         "  -t           print a CSV trace line per node and cycle\n"
+         "  -v           print the modules' LOG_INFO output\n"
+         "  --theta1..--theta4, --alpha, --gamma VALUE   override learner weights\n"
+         "  --step SCHEDULE  constant | harmonic | poly | floor step size (default constant)\n"
+         "  --policy POLICY  epsilon-greedy | ucb1 | softmax exploration (default epsilon-greedy)\n",
+         prog, SIM_MAX_NODES, cfg.num_nodes, SIM_CYCLE_SECONDS, (unsigned long)cfg.cycles,
+         (double)cfg.traffic, (double)cfg.per, cfg.fed_interval, FEDERATED_QUANT_BITS,
+         FEDERATED_DELTA_SYNC, SIM_FAULT_RANGE, FEDERATED_TRICKLE_IMIN,
+         FEDERATED_TRICKLE_DOUBLINGS, FEDERATED_TRICKLE_K, FEDERATED_QUANT_BITS, cfg.seed);
+}
+
+static void parse_args(int argc, char **argv) {
+  enum { OPT_THETA1 = 256, OPT_THETA2, OPT_THETA3, OPT_THETA4, OPT_ALPHA, OPT_GAMMA, OPT_STEP,
+         OPT_POLICY };
+  static const struct option long_options[] = {
+    { "theta1", required_argument, NULL, OPT_THETA1 },
+    { "theta2", required_argument, NULL, OPT_THETA2 },
+    { "theta3", required_argument, NULL, OPT_THETA3 },
+    { "theta4", required_argument, NULL, OPT_THETA4 },
+    { "alpha", required_argument, NULL, OPT_ALPHA },
+    { "gamma", required_argument, NULL, OPT_GAMMA },
+    { "step", required_argument, NULL, OPT_STEP },
+    { "policy", required_argument, NULL, OPT_POLICY },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int opt;
+
+  while((opt = getopt_long(argc, argv, "n:l:c:r:p:m:F:A:Q:D:X:L:TRs:tvh", long_options, NULL)) != -1) {
+    switch(opt) {
+    case 'n': cfg.num_nodes = atoi(optarg); break;
+    case 'l': cfg.learners = atoi(optarg); break;
+    case 'c': cfg.cycles = strtoul(optarg, NULL, 10); break;
+    case 'r': cfg.traffic = atof(optarg); break;
+    case 'p': cfg.per = atof(optarg); break;
+    case 'm':
+      if(strcmp(optarg, "autonomous") == 0) {
+        cfg.model = SIM_MODEL_AUTONOMOUS;
+      } else if(strcmp(optarg, "shared") == 0) {
+        cfg.model = SIM_MODEL_SHARED;
+      } else {
+        fprintf(stderr, "unknown model '%s'\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'F': cfg.fed_interval = atoi(optarg); break;
+    case 'A':
+      if(strcmp(optarg, "fedavg") == 0) {
+        cfg.fed_method = FEDAVG;
+      } else if(strcmp(optarg, "weighted") == 0) {
+        cfg.fed_method = WEIGHTED_FEDAVG;
+      } else if(strcmp(optarg, "median") == 0) {
+        cfg.fed_method = FEDMEDIAN;
+      } else if(strcmp(optarg, "trimmed") == 0) {
+        cfg.fed_method = FEDTRIMMED;
+      } else if(strcmp(optarg, "krum") == 0) {
+        cfg.fed_method = FEDKRUM;
+      } else if(strcmp(optarg, "staleness") == 0) {
+        cfg.fed_method = FEDSTALENESS;
+      } else {
+        fprintf(stderr, "unknown aggregation method '%s'\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'Q':
+      cfg.quant_bits = atoi(optarg);
+      if(cfg.quant_bits != 0 && cfg.quant_bits != 8 && cfg.quant_bits != 16) {
+        fprintf(stderr, "quantization must be 0, 8 or 16 bits\n");
+        exit(1);
+      }
+      break;
+    case 'D': cfg.delta = atoi(optarg) != 0; break;
+    case 'X': cfg.faulty = atoi(optarg); break;
+    case 'L': cfg.fed_loss = atof(optarg); break;
+    case 'T': cfg.trickle = 1; break;
+    case 'R': cfg.tree = 1; break;
+    case 's': cfg.seed = atoi(optarg); break;
+    case 't': cfg.trace = 1; break;
+    case 'v': host_log_level = LOG_LEVEL_INFO; break;
+    case OPT_THETA1: theta1 = Q_FROM_FLOAT(atof(optarg)); break;
+    case OPT_THETA2: theta2 = Q_FROM_FLOAT(atof(optarg)); break;
+    case OPT_THETA3: theta3 = Q_FROM_FLOAT(atof(optarg)); break;
+    case OPT_THETA4: theta4 = Q_FROM_FLOAT(atof(optarg)); break;
+    case OPT_ALPHA: learning_rate = Q_FROM_FLOAT(atof(optarg)); break;
+    case OPT_GAMMA: discount_factor = Q_FROM_FLOAT(atof(optarg)); break;
+    case OPT_STEP:
+      if(parse_step_size(optarg) < 0) {
+        fprintf(stderr, "unknown step-size schedule '%s'\n", optarg);
+        exit(1);
+      }
+      break;
+    case OPT_POLICY:
+      if(parse_policy(optarg) < 0) {
+        fprintf(stderr, "unknown exploration policy '%s'\n", optarg);
+        exit(1);
+      }
+      break;
+    default:
+      usage(argv[0]);
+      exit(opt == 'h' ? 0 : 1);
+    }
+  }
+
+  if(cfg.num_nodes < 2 || cfg.num_nodes > SIM_MAX_NODES || cfg.cycles == 0 ||
+     cfg.traffic <= 0.0f || cfg.per < 0.0f || cfg.per >= 1.0f ||
+     cfg.fed_loss < 0.0f || cfg.fed_loss >= 1.0f) {
+    usage(argv[0]);
+    exit(1);
+  }
+  if(cfg.learners == 0 || cfg.learners > cfg.num_nodes) {
+    cfg.learners = cfg.num_nodes;
+  }
+  if(cfg.trickle && cfg.tree) {
+    fprintf(stderr, "-T and -R are exclusive\n");
+    exit(1);
+  }
+  if(cfg.tree && FEDERATED_STREAMING) {
+    fprintf(stderr, "-R needs the stored tables (FEDERATED_CONF_STREAMING 0)\n");
+    exit(1);
+  }
+  if(cfg.delta && FEDERATED_STREAMING) {
+    fprintf(stderr, "-D 1 needs the stored tables (FEDERATED_CONF_STREAMING 0)\n");
+    exit(1);
+  }
+  if(cfg.faulty >= cfg.learners) {
+    fprintf(stderr, "faulty learner must be 1..%u\n", cfg.learners - 1);
+    exit(1);
+  }
+#if Q_LEARNING_HIERARCHICAL
+  // the coarse tables are private to q-learning.c and cannot be swapped
+  if(cfg.learners > 1) {
+    fprintf(stderr, "hierarchical search: only node 0 learns, the others follow it\n");
+    cfg.learners = 1;
+  }
+#endif
+}
+
+/********** Main **********/
+int main(int argc, char **argv) {
+  parse_args(argc, argv);
+  random_init(cfg.seed);
+
+  federated_learning_init(cfg.fed_method);
+  slot_config_init(SIM_SF_MIN);
+  build_schedule(SIM_SF_MIN);
+  for(uint8_t i = 0; i < SIM_MAX_NODES; i++) {
+    fed_states[i] = *get_federated_state();
+  }
+
+  for(uint8_t i = 0; i < cfg.num_nodes; i++) {
+    sim_node_t *n = &nodes[i];
+    memset(n, 0, sizeof(*n));
+    n->exploration = get_exploration();
+    n->last_retrans = Q_ONE;
+    n->slotframe_size = SIM_SF_MIN;
+    n->be = SIM_MIN_BE;
+    n->next_arrival = interarrival();
+    if(is_learner(i)) {
+      generate_random_q_values();
+      observe_state(0, Q_ONE);
+      save_learner(n);
+      fed_trickle_init(&n->trickle);
+    }
+  }
+  if(cfg.learners > 1) {
+    load_learner(&nodes[0]);
+  }
+
+  if(cfg.trace) {
+    printf("cycle,node,action,slotframe,tx,rx,buffer_before,buffer_after,avg_retrans,slot_bonus,reward\n");
+  }
+
+  clock_t started = clock();
+  for(uint32_t cycle = 0; cycle < cfg.cycles; cycle++) {
+    host_clock_set_seconds((unsigned long)cycle * SIM_CYCLE_SECONDS);
+    for(uint8_t i = 0; i < cfg.num_nodes; i++) {
+      start_cycle(i);
+    }
+    run_cycle();
+    for(uint8_t i = 0; i < cfg.num_nodes; i++) {
+      end_cycle(i, cycle);
+    }
+    if(cfg.trickle && cfg.learners > 1) {
+      trickle_run((unsigned long)(cycle + 1) * SIM_CYCLE_SECONDS);
+    } else if(cfg.fed_interval > 0 && cfg.learners > 1 && (cycle + 1) % cfg.fed_interval == 0) {
+      if(cfg.tree) {
+        tree_round();
+      } else {
+        federated_round();
+      }
+    }
+  }
+  double elapsed = (double)(clock() - started) / CLOCKS_PER_SEC;
+
+  if(cfg.trace) {
+    return 0;
+  }
+
+  printf("nodes=%u learners=%u cycles=%lu rate=%.1f per=%.2f model=%s federated=%u\n",
+         cfg.num_nodes, cfg.learners, (unsigned long)cfg.cycles, (double)cfg.traffic,
+         (double)cfg.per, cfg.model == SIM_MODEL_AUTONOMOUS ? "autonomous" : "shared",
+         cfg.fed_interval);
+  printf("theta=%.2f/%.2f/%.2f/%.2f alpha=%.2f gamma=%.2f step=%s policy=%s\n",
+         (double)Q_TO_FLOAT(theta1), (double)Q_TO_FLOAT(theta2), (double)Q_TO_FLOAT(theta3),
+         (double)Q_TO_FLOAT(theta4), (double)Q_TO_FLOAT(learning_rate),
+         (double)Q_TO_FLOAT(discount_factor), step_size_names[get_step_size_schedule()],
+         get_exploration_policy_name(get_exploration_policy()));
+  if(sync_stats.full + sync_stats.delta > 0) {
+    printf("sync: bits=%u delta=%u full=%lu deltas=%lu (%.1f entries) lost=%lu bytes=%llu "
+           "(full only %llu, %.1fx)\n",
+           cfg.quant_bits, cfg.delta, (unsigned long)sync_stats.full,
+           (unsigned long)sync_stats.delta,
+           sync_stats.delta ? (double)sync_stats.delta_entries / sync_stats.delta : 0.0,
+           (unsigned long)sync_stats.lost, (unsigned long long)sync_stats.bytes, (unsigned long long)sync_stats.full_only_bytes,
+           sync_stats.bytes ? (double)sync_stats.full_only_bytes / sync_stats.bytes : 0.0);
+  }
+  if(cfg.trickle && cfg.learners > 1) {
+    uint32_t tx = 0, suppressed = 0, resets = 0;
+    for(uint8_t i = 0; i < cfg.learners; i++) {
+      tx += nodes[i].trickle.transmissions;
+      suppressed += nodes[i].trickle.suppressions;
+      resets += nodes[i].trickle.resets;
+    }
+    printf("trickle: imin=%u imax=%lu k=%u broadcasts=%lu suppressed=%lu resets=%lu "
+           "(fixed %u s timer: %lu)\n",
+           FEDERATED_TRICKLE_IMIN, (unsigned long)FED_TRICKLE_IMAX, FEDERATED_TRICKLE_K,
+           (unsigned long)tx, (unsigned long)suppressed, (unsigned long)resets,
+           FEDERATED_SYNC_INTERVAL,
+           (unsigned long)((uint64_t)cfg.learners * cfg.cycles * SIM_CYCLE_SECONDS /
+                           FEDERATED_SYNC_INTERVAL));
+  }
+  if(cfg.learners > 1 && !FEDERATED_STREAMING) {
+    // summed over the learners' federated states with -T / -R
+    unsigned long duplicates = 0, skipped = 0;
+    for(uint8_t i = 0; i < ((cfg.trickle || cfg.tree) ? cfg.learners : 1); i++) {
+      uint16_t d, s;
+      switch_federated(i);
+      get_dedup_stats(&d, &s);
+      duplicates += d;
+      skipped += s;
+    }
+    switch_federated(0);
+    printf("dedup: unchanged tables not stored=%lu aggregations skipped=%lu\n",
+           duplicates, skipped);
+  }
+  if(tree_stats.rounds > 0) {
+    printf("tree: rounds=%lu up=%lu down=%lu lost=%lu bytes=%llu model_samples=%lu "
+           "(network %lu)\n",
+           (unsigned long)tree_stats.rounds, (unsigned long)tree_stats.up,
+           (unsigned long)tree_stats.down, (unsigned long)tree_stats.lost,
+           (unsigned long long)tree_stats.bytes, (unsigned long)tree_stats.model_samples,
+           (unsigned long)cfg.learners * get_local_sample_count());
+  }
+  if(cfg.learners > 1) {
+    printf("neighbor table: capacity=%u streaming=%u state=%lu bytes evictions=%u\n",
+           MAX_FEDERATED_NEIGHBORS, FEDERATED_STREAMING, (unsigned long)sizeof(federated_state_t),
+           get_neighbor_evictions());
+  }
+  if(sync_stats.values > 0) {
+    printf("aggregation error vs raw%s tables: max=%.4f mean=%.5f\n",
+           cfg.faulty ? " healthy" : "", sync_stats.max_error,
+           sync_stats.sum_error / sync_stats.values);
+  }
+  printf("node best_action slotframe pdr    drops  mean_reward(last 25%%)\n");
+
+  uint32_t window = cfg.cycles / 4;
+  for(uint8_t i = 0; i < cfg.num_nodes; i++) {
+    sim_node_t *n = &nodes[i];
+    uint8_t best = n->action;
+    if(is_learner(i)) {
+      if(cfg.learners > 1) {
+        load_learner(n);
+      }
+      best = get_highest_q_val();
+    }
+    printf("%4u %11u %9u %.3f %6lu %8.2f\n", i, best, action_to_slotframe_size(best),
+           n->generated ? (double)n->delivered / n->generated : 0.0,
+           (unsigned long)n->dropped,
+           window ? n->reward_sum / window : 0.0);
+  }
+  printf("%.0f cycles/s\n", elapsed > 0 ? cfg.cycles / elapsed : 0.0);
+
+  return 0;
+}
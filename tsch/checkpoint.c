@@ -0,0 +1,270 @@
+/********** Libraries ***********/
+#include "checkpoint.h"
+#include "federated-learning.h"
+#include "slot-configuration.h"
+#include "cfs/cfs.h"
+#include "lib/crc16.h"
+#include <string.h>
+#include <stdio.h>
+
+#include "sys/log.h"
+#define LOG_MODULE "Checkpoint"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+/********** Record Format ***********/
+// header | app state | samples | Q-table | visit counts | slot records
+// the CRC covers everything after the header plus the sequence number
+#define CHECKPOINT_MAGIC 0x524c434bUL  // "RLCK"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t payload_len;
+    uint32_t sequence;
+    // layout of the build that wrote the record
+    uint8_t num_states;
+    uint8_t num_actions;
+    uint8_t value_size;          // sizeof(q_value_t)
+    uint8_t fixed_point;         // Q_FIXED_FRAC_BITS, 0 for float
+    uint8_t tracked_slots;
+    uint8_t reserved;
+    uint16_t crc;
+} checkpoint_header_t;
+
+typedef struct {
+    uint8_t config;
+    uint8_t channel_offset;
+    linkaddr_t neighbor;
+} checkpoint_slot_t;
+
+#define CHECKPOINT_PAYLOAD_LEN (sizeof(checkpoint_app_state_t) + sizeof(uint16_t) + \
+                                Q_TABLE_SIZE * (sizeof(q_value_t) + sizeof(uint16_t)) + \
+                                MAX_TRACKED_SLOTS * sizeof(checkpoint_slot_t))
+
+#if Q_LEARNING_FIXED_POINT
+#define CHECKPOINT_FORMAT Q_FIXED_FRAC_BITS
+#else
+#define CHECKPOINT_FORMAT 0
+#endif
+
+static uint32_t last_sequence;
+
+/********** Helpers ***********/
+static void file_name(uint8_t slot, char *name, uint8_t len) {
+    snprintf(name, len, CHECKPOINT_FILE_PREFIX "%u", slot);
+}
+
+static void fill_layout(checkpoint_header_t *h) {
+    h->magic = CHECKPOINT_MAGIC;
+    h->version = CHECKPOINT_VERSION;
+    h->payload_len = CHECKPOINT_PAYLOAD_LEN;
+    h->num_states = Q_NUM_STATES;
+    h->num_actions = Q_VALUE_LIST_SIZE;
+    h->value_size = sizeof(q_value_t);
+    h->fixed_point = CHECKPOINT_FORMAT;
+    h->tracked_slots = MAX_TRACKED_SLOTS;
+    h->reserved = 0;
+}
+
+static uint8_t layout_matches(const checkpoint_header_t *h) {
+    checkpoint_header_t expected;
+    fill_layout(&expected);
+    return h->magic == expected.magic && h->version == expected.version &&
+           h->payload_len == expected.payload_len && h->num_states == expected.num_states &&
+           h->num_actions == expected.num_actions && h->value_size == expected.value_size &&
+           h->fixed_point == expected.fixed_point && h->tracked_slots == expected.tracked_slots;
+}
+
+// Writes (fd >= 0) and/or checksums one section of the payload
+static int emit(int fd, const void *data, uint16_t len, unsigned short *crc) {
+    *crc = crc16_data((const unsigned char *)data, len, *crc);
+    if (fd >= 0 && cfs_write(fd, data, len) != len) {
+        return -1;
+    }
+    return 0;
+}
+
+// Serialises the payload; with fd < 0 only the CRC is computed
+static int write_payload(int fd, const checkpoint_app_state_t *app, unsigned short *crc) {
+    uint16_t samples = get_local_sample_count();
+    checkpoint_slot_t record;
+    slot_statistics_t slot;
+
+    if (emit(fd, app, sizeof(*app), crc) < 0 ||
+        emit(fd, &samples, sizeof(samples), crc) < 0 ||
+        emit(fd, get_q_table(), Q_TABLE_SIZE * sizeof(q_value_t), crc) < 0 ||
+        emit(fd, get_visit_counts(), Q_TABLE_SIZE * sizeof(uint16_t), crc) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < MAX_TRACKED_SLOTS; i++) {
+        get_slot_statistics(i, &slot);
+        memset(&record, 0, sizeof(record));
+        record.config = slot.current_config;
+        record.channel_offset = slot.channel_offset;
+        linkaddr_copy(&record.neighbor, &slot.primary_neighbor);
+        if (emit(fd, &record, sizeof(record), crc) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Reads the header and checks the payload CRC; returns 1 for a valid record
+static uint8_t read_valid_header(uint8_t slot, checkpoint_header_t *h) {
+    char name[16];
+    uint8_t buf[32];
+    int fd;
+
+    file_name(slot, name, sizeof(name));
+    fd = cfs_open(name, CFS_READ);
+    if (fd < 0) {
+        return 0;
+    }
+
+    uint8_t valid = 0;
+    if (cfs_read(fd, h, sizeof(*h)) == sizeof(*h) && layout_matches(h)) {
+        unsigned short crc = crc16_data((const unsigned char *)&h->sequence, sizeof(h->sequence), 0);
+        uint16_t remaining = h->payload_len;
+        while (remaining > 0) {
+            int n = cfs_read(fd, buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+            if (n <= 0) {
+                break;
+            }
+            crc = crc16_data(buf, n, crc);
+            remaining -= n;
+        }
+        valid = remaining == 0 && crc == h->crc;
+        if (!valid) {
+            LOG_WARN("Checkpoint %s corrupted (seq=%lu)\n", name, (unsigned long)h->sequence);
+        }
+    }
+    cfs_close(fd);
+    return valid;
+}
+
+/********** Public Functions ***********/
+
+/**
+ * Write a checkpoint to the oldest file
+ */
+uint8_t checkpoint_save(const checkpoint_app_state_t *app) {
+    checkpoint_header_t h;
+    char name[16];
+
+    if (app == NULL) {
+        return 0;
+    }
+
+    fill_layout(&h);
+    h.sequence = last_sequence + 1;
+    unsigned short crc = crc16_data((const unsigned char *)&h.sequence, sizeof(h.sequence), 0);
+    write_payload(-1, app, &crc);
+    h.crc = crc;
+
+    // Rotate over the files; the previous checkpoints stay intact if this
+    // write is interrupted
+    file_name(h.sequence % CHECKPOINT_SLOTS, name, sizeof(name));
+    cfs_remove(name);
+    int fd = cfs_open(name, CFS_WRITE);
+    if (fd < 0) {
+        LOG_WARN("Cannot open checkpoint %s\n", name);
+        return 0;
+    }
+
+    crc = 0;
+    int ok = cfs_write(fd, &h, sizeof(h)) == sizeof(h) && write_payload(fd, app, &crc) == 0;
+    cfs_close(fd);
+
+    if (!ok) {
+        LOG_WARN("Checkpoint write to %s failed\n", name);
+        cfs_remove(name);
+        return 0;
+    }
+
+    last_sequence = h.sequence;
+    LOG_INFO("Checkpoint %lu saved to %s (%u bytes)\n",
+             (unsigned long)h.sequence, name, (unsigned)(sizeof(h) + h.payload_len));
+    return 1;
+}
+
+/**
+ * Restore the newest valid checkpoint
+ */
+uint8_t checkpoint_restore(checkpoint_app_state_t *app) {
+    checkpoint_header_t h;
+    checkpoint_slot_t record;
+    uint32_t best_sequence = 0;
+    int best_slot = -1;
+    char name[16];
+
+    if (app == NULL) {
+        return 0;
+    }
+
+    // Pick the newest record that passes the checks
+    for (uint8_t slot = 0; slot < CHECKPOINT_SLOTS; slot++) {
+        if (read_valid_header(slot, &h) && (best_slot < 0 || h.sequence > best_sequence)) {
+            best_sequence = h.sequence;
+            best_slot = slot;
+        }
+    }
+    if (best_slot < 0) {
+        LOG_INFO("No valid checkpoint, cold start\n");
+        return 0;
+    }
+
+    file_name(best_slot, name, sizeof(name));
+    int fd = cfs_open(name, CFS_READ);
+    if (fd < 0) {
+        return 0;
+    }
+
+    // The record was verified above, apply it section by section
+    uint16_t samples = 0;
+    cfs_read(fd, &h, sizeof(h));
+    cfs_read(fd, app, sizeof(*app));
+    cfs_read(fd, &samples, sizeof(samples));
+    for (uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        q_value_t value;
+        cfs_read(fd, &value, sizeof(value));
+        set_q_value(i, value);
+    }
+    for (uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        uint16_t visits;
+        cfs_read(fd, &visits, sizeof(visits));
+        set_visit_count(i, visits);
+    }
+    set_local_sample_count(samples);
+
+    update_slotframe_size(app->slotframe_size);
+    for (uint8_t i = 0; i < MAX_TRACKED_SLOTS; i++) {
+        cfs_read(fd, &record, sizeof(record));
+        slot_config_restore(i, record.config, record.channel_offset, &record.neighbor);
+    }
+    cfs_close(fd);
+
+    last_sequence = best_sequence;
+    LOG_INFO("Restored checkpoint %lu from %s: slotframe=%u samples=%u best_action=%u\n",
+             (unsigned long)best_sequence, name, app->slotframe_size, samples,
+             get_highest_q_val());
+    return 1;
+}
+
+/**
+ * Remove all checkpoint files
+ */
+void checkpoint_erase(void) {
+    char name[16];
+    for (uint8_t slot = 0; slot < CHECKPOINT_SLOTS; slot++) {
+        file_name(slot, name, sizeof(name));
+        cfs_remove(name);
+    }
+    last_sequence = 0;
+}
+
+/**
+ * Sequence number of the last checkpoint
+ */
+uint32_t checkpoint_get_sequence(void) {
+    return last_sequence;
+}
@@ -0,0 +1,72 @@
+#ifndef CHECKPOINT_HEADER
+#define CHECKPOINT_HEADER
+
+/********** Libraries **********/
+#include "contiki.h"
+#include "q-learning.h"
+
+/******** Configuration *******/
+// Persist the learned state to CFS and warm-start from it after a reboot
+// (needs MODULES += $(CONTIKI_NG_STORAGE_DIR)/cfs in the project Makefile)
+#ifdef CHECKPOINT_CONF_ENABLED
+#define CHECKPOINT_ENABLED CHECKPOINT_CONF_ENABLED
+#else
+#define CHECKPOINT_ENABLED 0
+#endif
+
+// Number of rotating checkpoint files (wear levelling: every write goes to
+// the oldest file, the newest valid one is restored)
+#ifndef CHECKPOINT_SLOTS
+#define CHECKPOINT_SLOTS 3
+#endif
+
+// Q-learning cycles between two checkpoints
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL 5
+#endif
+
+// File name prefix, files are <prefix>0 .. <prefix>(CHECKPOINT_SLOTS - 1)
+#ifndef CHECKPOINT_FILE_PREFIX
+#define CHECKPOINT_FILE_PREFIX "rlckpt"
+#endif
+
+// Record format version, bump when the payload layout changes
+#define CHECKPOINT_VERSION 4
+
+/******** Structures *******/
+// Application state saved next to the learner (owned by the node process)
+typedef struct {
+    q_value_t exploration;       // exploration parameter reached (epsilon, temperature)
+    uint8_t policy;              // exploration policy it belongs to
+    uint8_t slotframe_size;      // slotframe size in use
+} checkpoint_app_state_t;
+
+/********** Functions *********/
+
+/**
+ * Write a checkpoint of the Q-table and its visit counts, the federated
+ * sample count, the slot configuration and the application state to the
+ * oldest checkpoint file
+ * Returns 1 on success
+ */
+uint8_t checkpoint_save(const checkpoint_app_state_t *app);
+
+/**
+ * Restore the newest valid checkpoint (magic, version, layout and CRC
+ * checked). Must run after federated_learning_init() and slot_config_init().
+ * Restores the Q-table, the sample count and the slot configuration and fills
+ * app; returns 0 (nothing restored) when no valid checkpoint exists
+ */
+uint8_t checkpoint_restore(checkpoint_app_state_t *app);
+
+/**
+ * Remove all checkpoint files (forces a cold start on the next boot)
+ */
+void checkpoint_erase(void);
+
+/**
+ * Sequence number of the last checkpoint written or restored
+ */
+uint32_t checkpoint_get_sequence(void);
+
+#endif /* CHECKPOINT_HEADER */
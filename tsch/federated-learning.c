@@ -2,8 +2,9 @@
 #include "federated-learning.h"
 #include "q-learning.h"
 #include "sys/clock.h"
+#include "lib/random.h"
+#include "sys/critical.h"
 #include <string.h>
-#include <stdlib.h>
 
 #include "sys/log.h"
 #define LOG_MODULE "FedLearn"
@@ -14,34 +15,271 @@ static federated_state_t fed_state;
 
 /********** Helper Functions ***********/
 
+// Compare-exchange: a <= b afterwards
+#define Q_CSWAP(a, b) do { \
+        if ((b) < (a)) { q_value_t t_ = (a); (a) = (b); (b) = t_; } \
+    } while (0)
+
 /**
- * Compare function for qsort
+ * Partially order values so that values[k] holds the k-th smallest value,
+ * with no larger value before it (quickselect, median-of-three pivot)
  */
-static int compare_float(const void *a, const void *b) {
-    float fa = *(const float*)a;
-    float fb = *(const float*)b;
-    return (fa > fb) - (fa < fb);
+static void select_kth(q_value_t *values, uint8_t count, uint8_t k) {
+    int lo = 0;
+    int hi = count - 1;
+    
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        Q_CSWAP(values[lo], values[mid]);
+        Q_CSWAP(values[lo], values[hi]);
+        Q_CSWAP(values[mid], values[hi]);
+        q_value_t pivot = values[mid];
+        
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (values[i] < pivot) i++;
+            while (pivot < values[j]) j--;
+            if (i <= j) {
+                q_value_t t = values[i];
+                values[i++] = values[j];
+                values[j--] = t;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            return;  // values[j+1 .. i-1] all equal the pivot
+        }
+    }
 }
 
 /**
- * Calculate median of an array of floats
+ * Home position of a node ID in the neighbor index (Fibonacci hashing)
  */
-static float calculate_median(float *values, uint8_t count) {
-    if (count == 0) return 0.0;
-    
-    // Create temporary array for sorting
-    float temp[MAX_FEDERATED_NEIGHBORS + 1];
-    memcpy(temp, values, count * sizeof(float));
+static uint8_t index_home(uint16_t node_id) {
+    return (uint16_t)(node_id * 40503u) >> (16 - FED_NEIGHBOR_INDEX_BITS);
+}
+
+/**
+ * Index position holding node_id, or the free position ending its probe
+ * sequence when the node is unknown
+ */
+static uint8_t index_lookup(uint16_t node_id) {
+    uint8_t pos = index_home(node_id);
+    while (fed_state.neighbor_index[pos] != 0 &&
+           fed_state.neighbors[fed_state.neighbor_index[pos] - 1].node_id != node_id) {
+        pos = (pos + 1) & (FED_NEIGHBOR_INDEX_SIZE - 1);
+    }
+    return pos;
+}
+
+/**
+ * Clear an index position, shifting back the entries of the probe sequence
+ * behind it so that lookups never stop at the hole
+ */
+static void index_remove(uint8_t hole) {
+    uint8_t pos = hole;
+    for (;;) {
+        pos = (pos + 1) & (FED_NEIGHBOR_INDEX_SIZE - 1);
+        uint8_t slot = fed_state.neighbor_index[pos];
+        if (slot == 0) {
+            break;
+        }
+        uint8_t home = index_home(fed_state.neighbors[slot - 1].node_id);
+        // the entry may move to the hole unless its home lies between them
+        if (((pos - home) & (FED_NEIGHBOR_INDEX_SIZE - 1)) >=
+            ((pos - hole) & (FED_NEIGHBOR_INDEX_SIZE - 1))) {
+            fed_state.neighbor_index[hole] = slot;
+            hole = pos;
+        }
+    }
+    fed_state.neighbor_index[hole] = 0;
+}
+
+#if FEDERATED_STREAMING
+/**
+ * Whether the entry at slot was folded into the running sums this round
+ */
+static uint8_t round_folded(uint8_t slot) {
+    return (fed_state.round_folded[slot >> 3] >> (slot & 7)) & 1;
+}
+
+static void set_round_folded(uint8_t slot, uint8_t folded) {
+    if (folded) {
+        fed_state.round_folded[slot >> 3] |= 1 << (slot & 7);
+    } else {
+        fed_state.round_folded[slot >> 3] &= ~(1 << (slot & 7));
+    }
+}
+#endif
+
+/**
+ * Remove the entry at slot, moving the last active entry into its place
+ */
+static void remove_neighbor(uint8_t slot) {
+    uint8_t last = fed_state.num_active_neighbors - 1;
     
-    // Sort array
-    qsort(temp, count, sizeof(float), compare_float);
+    index_remove(index_lookup(fed_state.neighbors[slot].node_id));
+    fed_state.tables_changed = 1;
+    if (slot != last) {
+        memcpy(&fed_state.neighbors[slot], &fed_state.neighbors[last], sizeof(neighbor_q_table_t));
+        fed_state.neighbor_index[index_lookup(fed_state.neighbors[slot].node_id)] = slot + 1;
+    }
+#if FEDERATED_STREAMING
+    // the moved entry keeps its folded bit, the freed one starts clear
+    set_round_folded(slot, round_folded(last));
+    set_round_folded(last, 0);
+#endif
+    fed_state.num_active_neighbors--;
+}
+
+/**
+ * Entry to replace for a new neighbor with the given sample count, -1 when
+ * the newcomer should be dropped instead
+ */
+static int select_eviction(uint16_t num_samples) {
+    int victim = 0;
+    for (int i = 1; i < fed_state.num_active_neighbors; i++) {
+        const neighbor_q_table_t *n = &fed_state.neighbors[i];
+        const neighbor_q_table_t *v = &fed_state.neighbors[victim];
+#if FEDERATED_EVICTION == FED_EVICT_QUALITY
+        if (n->num_samples < v->num_samples ||
+            (n->num_samples == v->num_samples && n->last_update_seq < v->last_update_seq)) {
+            victim = i;
+        }
+#else
+        if (n->last_update_seq < v->last_update_seq) {
+            victim = i;
+        }
+#endif
+    }
+#if FEDERATED_EVICTION == FED_EVICT_QUALITY
+    if (num_samples < fed_state.neighbors[victim].num_samples) {
+        return -1;
+    }
+#endif
+    return victim;
+}
+
+/**
+ * Write a Q-value as Q16.16 little endian
+ */
+static void wire_put(uint8_t *p, q_value_t value) {
+    uint32_t w = (uint32_t)fed_to_wire(value);
+    p[0] = w & 0xff;
+    p[1] = (w >> 8) & 0xff;
+    p[2] = (w >> 16) & 0xff;
+    p[3] = w >> 24;
+}
+
+/**
+ * Read a Q16.16 little endian value written by wire_put()
+ */
+static q_value_t wire_get(const uint8_t *p) {
+    uint32_t w = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return fed_from_wire((int32_t)w);
+}
+
+/**
+ * Blend an aggregated value into a local one using the local model weight
+ */
+static q_value_t blend_with_local(q_value_t local, q_value_t aggregated) {
+    return Q_MUL(fed_state.aggregation_weight, local) + 
+           Q_MUL(Q_ONE - fed_state.aggregation_weight, aggregated);
+}
+
+/**
+ * Write one received value into the neighbor's table, or with
+ * FEDERATED_STREAMING fold it into the running sums with the neighbor's
+ * weight (its sample count for weighted FedAvg)
+ */
+static void store_value(neighbor_q_table_t *entry, uint16_t index, q_value_t value) {
+#if FEDERATED_STREAMING
+    // a table folded this round is fresh, staleness weighting reduces to
+    // the sample count
+    uint16_t weight = fed_state.aggregation_method == WEIGHTED_FEDAVG ||
+                      fed_state.aggregation_method == FEDSTALENESS ? entry->num_samples : 1;
+    fed_state.running_sum[index] += (q_accum_t)weight * value;
+    fed_state.running_weight[index] += weight;
+#else
+    entry->q_values[index] = value;
+#endif
+}
+
+/**
+ * Whether a received table should be stored (always without
+ * FEDERATED_STREAMING). In streaming mode a neighbor is folded in once per
+ * round: the running sums can't take back the values of its earlier
+ * message, so a repeat within the round is skipped rather than counted
+ * twice
+ */
+static uint8_t begin_fold(neighbor_q_table_t *entry) {
+#if FEDERATED_STREAMING
+    uint8_t slot = entry - fed_state.neighbors;
+    if (round_folded(slot)) {
+        LOG_INFO("Node %u already folded into this round, table skipped\n", entry->node_id);
+        fed_state.duplicates_skipped++;
+        return 0;
+    }
+    set_round_folded(slot, 1);
+    fed_state.round_neighbors++;
+#endif
+    return 1;
+}
+
+#if FEDERATED_STREAMING
+/**
+ * Start a new aggregation round with empty running sums
+ */
+static void reset_running_sums(void) {
+    memset(fed_state.running_sum, 0, sizeof(fed_state.running_sum));
+    memset(fed_state.running_weight, 0, sizeof(fed_state.running_weight));
+    memset(fed_state.round_folded, 0, sizeof(fed_state.round_folded));
+    fed_state.round_neighbors = 0;
+}
+
+/**
+ * Merge the running sums into the local Q-table and start a new round;
+ * entries no neighbor reported this round keep their local value
+ * Returns the number of neighbors folded in
+ */
+static uint8_t aggregate_running_sums(uint8_t weighted) {
+    const q_value_t *local_q_table = get_q_table();
+    const uint16_t *local_visits = get_visit_counts();
+    uint8_t neighbors = fed_state.round_neighbors;
     
-    // Return median
-    if (count % 2 == 0) {
-        return (temp[count/2 - 1] + temp[count/2]) / 2.0;
-    } else {
-        return temp[count/2];
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        if (fed_state.running_weight[j] == 0) {
+            continue;
+        }
+        if (weighted) {
+            // unvisited local entries get no weight, as in the stored mode
+            uint16_t local_samples = local_visits[j] ? fed_state.local_num_samples : 0;
+            q_accum_t sum = fed_state.running_sum[j] + (q_accum_t)local_samples * local_q_table[j];
+            set_q_value(j, (q_value_t)(sum / (q_accum_t)(fed_state.running_weight[j] + local_samples)));
+        } else {
+            q_accum_t sum = fed_state.running_sum[j] + local_q_table[j];
+            set_q_value(j, blend_with_local(local_q_table[j],
+                                            (q_value_t)(sum / (q_accum_t)(fed_state.running_weight[j] + 1))));
+        }
     }
+    reset_running_sums();
+    return neighbors;
+}
+#endif
+
+/**
+ * Number of neighbors the next aggregation includes
+ */
+static uint8_t neighbors_to_aggregate(void) {
+#if FEDERATED_STREAMING
+    return fed_state.round_neighbors;
+#else
+    return fed_state.num_active_neighbors;
+#endif
 }
 
 /********** Public Functions ***********/
@@ -50,143 +288,919 @@ static float calculate_median(float *values, uint8_t count) {
  * Initialize federated learning system
  */
 void federated_learning_init(fed_aggregation_method_t method) {
-    // Initialize all neighbors as inactive
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        fed_state.neighbors[i].is_active = 0;
-        fed_state.neighbors[i].node_id = 0;
-        fed_state.neighbors[i].num_samples = 0;
-        fed_state.neighbors[i].last_update_time = 0;
-    }
-    
+    // No neighbors yet
+    memset(fed_state.neighbor_index, 0, sizeof(fed_state.neighbor_index));
     fed_state.num_active_neighbors = 0;
+    fed_state.update_seq = 0;
+    fed_state.evictions = 0;
+#if FEDERATED_STREAMING
+    reset_running_sums();
+#endif
     fed_state.local_num_samples = 0;
     fed_state.aggregation_method = method;
-    fed_state.aggregation_weight = 0.5;  // Equal weight between local and federated
+    fed_state.aggregation_weight = Q_ONE / 2;  // Equal weight between local and federated
+    fed_state.local_version = 0;
+    fed_state.broadcasts_since_full = 0;
+    fed_state.full_requested = 1;  // the first broadcast is a full snapshot
+    fed_state.global_version = 0;
+    memset(&fed_state.summary, 0, sizeof(fed_state.summary));
+    fed_state.summaries_agreed = 0;
+    fed_state.summaries_disagreed = 0;
+    fed_state.syncs_skipped = 0;
+    fed_state.tables_changed = 0;
+    fed_state.duplicates_skipped = 0;
+    fed_state.aggregations_skipped = 0;
     
     LOG_INFO("Federated Learning initialized with method=%u\n", method);
 }
 
+/**
+ * Entry of a neighbor, allocating a free one for a new node
+ * Returns NULL when the table is full
+ */
+static neighbor_q_table_t *get_neighbor_entry(uint16_t node_id, uint16_t num_samples) {
+    uint8_t pos = index_lookup(node_id);
+    neighbor_q_table_t *entry;
+    
+    // Check if this neighbor already exists
+    fed_state.tables_changed = 1;
+    if (fed_state.neighbor_index[pos] != 0) {
+        entry = &fed_state.neighbors[fed_state.neighbor_index[pos] - 1];
+        entry->num_samples = num_samples;
+        entry->last_update_time = clock_seconds();
+        entry->last_update_seq = ++fed_state.update_seq;
+        LOG_INFO("Updated Q-table from node %u (samples=%u)\n", node_id, num_samples);
+        return entry;
+    }
+    
+    // Make room for the new neighbor
+    if (fed_state.num_active_neighbors == MAX_FEDERATED_NEIGHBORS) {
+        int victim = select_eviction(num_samples);
+        if (victim < 0) {
+            LOG_WARN("No space to store Q-table from node %u (table full)\n", node_id);
+            return NULL;
+        }
+        LOG_INFO("Evicting node %u (samples=%u) for node %u\n",
+                 fed_state.neighbors[victim].node_id, fed_state.neighbors[victim].num_samples,
+                 node_id);
+        remove_neighbor(victim);
+        fed_state.evictions++;
+        pos = index_lookup(node_id);
+    }
+    
+    entry = &fed_state.neighbors[fed_state.num_active_neighbors];
+    entry->node_id = node_id;
+    entry->num_samples = num_samples;
+    entry->last_update_time = clock_seconds();
+    entry->last_update_seq = ++fed_state.update_seq;
+    entry->version = 0;
+    entry->checksum = 0;
+    fed_state.neighbor_index[pos] = ++fed_state.num_active_neighbors;
+    LOG_INFO("Added Q-table from new node %u (samples=%u, total_neighbors=%u)\n", 
+             node_id, num_samples, fed_state.num_active_neighbors);
+    return entry;
+}
+
 /**
  * Store or update Q-table from a neighbor node
  */
-uint8_t store_neighbor_q_table(uint16_t node_id, float *q_values, uint8_t num_samples) {
+uint8_t store_neighbor_q_table(uint16_t node_id, const q_value_t *q_values, uint16_t num_samples) {
     if (q_values == NULL) {
         LOG_WARN("Attempted to store NULL Q-table\n");
         return 0;
     }
     
-    // Check if this neighbor already exists
-    int existing_idx = -1;
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        if (fed_state.neighbors[i].is_active && 
-            fed_state.neighbors[i].node_id == node_id) {
-            existing_idx = i;
-            break;
-        }
+    neighbor_q_table_t *entry = get_neighbor_entry(node_id, num_samples);
+    if (entry == NULL) {
+        return 0;
+    }
+    if (!begin_fold(entry)) {
+        return 1;
+    }
+#if FEDERATED_STREAMING
+    for (uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        store_value(entry, i, q_values[i]);
+    }
+#else
+    memcpy(entry->q_values, q_values, Q_TABLE_SIZE * sizeof(q_value_t));
+#endif
+    return 1;
+}
+
+/**
+ * Store or update a Q-table received on the wire from a neighbor node
+ */
+uint8_t store_neighbor_q_table_quantized(uint16_t node_id, const uint8_t *codes, uint8_t bits,
+                                         const fed_quant_params_t *params, uint16_t num_samples) {
+    if (codes == NULL || (bits != 0 && bits != 8 && bits != 16) || (bits != 0 && params == NULL)) {
+        LOG_WARN("Attempted to store invalid quantized Q-table\n");
+        return 0;
     }
     
-    // Update existing neighbor
-    if (existing_idx >= 0) {
-        memcpy(fed_state.neighbors[existing_idx].q_values, q_values, 
-               Q_VALUE_LIST_SIZE * sizeof(float));
-        fed_state.neighbors[existing_idx].num_samples = num_samples;
-        fed_state.neighbors[existing_idx].last_update_time = clock_seconds();
-        LOG_INFO("Updated Q-table from node %u (samples=%u)\n", node_id, num_samples);
+    neighbor_q_table_t *entry = get_neighbor_entry(node_id, num_samples);
+    if (entry == NULL) {
+        return 0;
+    }
+    if (!begin_fold(entry)) {
         return 1;
     }
+#if FEDERATED_STREAMING
+    for (uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        q_value_t value;
+        fed_dequantize(codes + i * FED_WIRE_VALUE_SIZE(bits), 1, bits, params, &value);
+        store_value(entry, i, value);
+    }
+#else
+    fed_dequantize(codes, Q_TABLE_SIZE, bits, params, entry->q_values);
+#endif
+    return 1;
+}
+
+/**
+ * Active entry of a known neighbor, NULL if unknown
+ */
+static neighbor_q_table_t *find_neighbor(uint16_t node_id) {
+    uint8_t slot = fed_state.neighbor_index[index_lookup(node_id)];
+    return slot ? &fed_state.neighbors[slot - 1] : NULL;
+}
+
+/**
+ * Apply a delta from a neighbor
+ */
+uint8_t store_neighbor_q_delta(uint16_t node_id, uint16_t base_version, uint16_t version,
+                               const uint8_t *entries, uint16_t count, uint16_t num_samples) {
+    neighbor_q_table_t *entry = find_neighbor(node_id);
+    
+    // With FEDERATED_STREAMING the entries a delta leaves out would get no
+    // weight this round: it is answered like a version gap, so the sender's
+    // next broadcast is a full snapshot
+    if (FEDERATED_STREAMING || entry == NULL || entry->version != base_version) {
+        LOG_WARN("Q-table delta from node %u: version gap (have %u, base %u)\n",
+                 node_id, entry ? entry->version : 0, base_version);
+        return 0;
+    }
     
-    // Find empty slot for new neighbor
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        if (!fed_state.neighbors[i].is_active) {
-            fed_state.neighbors[i].node_id = node_id;
-            memcpy(fed_state.neighbors[i].q_values, q_values, 
-                   Q_VALUE_LIST_SIZE * sizeof(float));
-            fed_state.neighbors[i].num_samples = num_samples;
-            fed_state.neighbors[i].is_active = 1;
-            fed_state.neighbors[i].last_update_time = clock_seconds();
-            fed_state.num_active_neighbors++;
-            LOG_INFO("Added Q-table from new node %u (samples=%u, total_neighbors=%u)\n", 
-                     node_id, num_samples, fed_state.num_active_neighbors);
-            return 1;
+    entry->num_samples = num_samples;
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t *e = entries + i * FED_DELTA_ENTRY_SIZE;
+        uint16_t index = e[0] | ((uint16_t)e[1] << 8);
+        if (index < Q_TABLE_SIZE) {
+            store_value(entry, index, wire_get(e + 2));
         }
     }
+    entry->version = version;
+    entry->last_update_time = clock_seconds();
+    if (count > 0) {
+        fed_state.tables_changed = 1;
+    }
+    LOG_INFO("Applied Q-table delta from node %u (entries=%u, version=%u)\n",
+             node_id, count, version);
+    return 1;
+}
+
+/**
+ * Table held for a neighbor
+ */
+const q_value_t *get_neighbor_q_table(uint16_t node_id) {
+#if FEDERATED_STREAMING
+    return NULL;
+#else
+    neighbor_q_table_t *entry = find_neighbor(node_id);
+    return entry ? entry->q_values : NULL;
+#endif
+}
+
+/**
+ * Record the table version held for a neighbor
+ */
+void set_neighbor_table_version(uint16_t node_id, uint16_t version) {
+    neighbor_q_table_t *entry = find_neighbor(node_id);
+    if (entry != NULL) {
+        entry->version = version;
+    }
+}
+
+/**
+ * Checksum of a Q-table
+ */
+uint16_t fed_table_checksum(const q_value_t *q_values) {
+    const uint8_t *bytes = (const uint8_t *)q_values;
+    uint32_t sum1 = 0;
+    uint32_t sum2 = 0;
     
-    LOG_WARN("No space to store Q-table from node %u (table full)\n", node_id);
+    // reduced every 256 bytes, sum2 stays far below 2^32
+    for (uint16_t i = 0; i < Q_TABLE_SIZE * sizeof(q_value_t); i++) {
+        sum1 += bytes[i];
+        sum2 += sum1;
+        if ((i & 0xff) == 0xff) {
+            sum1 %= 255;
+            sum2 %= 255;
+        }
+    }
+    uint16_t checksum = (uint16_t)(((sum2 % 255) << 8) | (sum1 % 255));
+    return checksum != 0 ? checksum : 1;
+}
+
+/**
+ * Record the checksum of the table held for a neighbor
+ */
+void set_neighbor_table_checksum(uint16_t node_id, uint16_t checksum) {
+    neighbor_q_table_t *entry = find_neighbor(node_id);
+    if (entry != NULL) {
+        entry->checksum = checksum;
+    }
+}
+
+/**
+ * Whether a full table is the one already held for the neighbor
+ */
+uint8_t fed_neighbor_unchanged(uint16_t node_id, uint16_t version, uint16_t checksum,
+                               uint16_t num_samples) {
+#if FEDERATED_STREAMING
     return 0;
+#else
+    neighbor_q_table_t *entry = find_neighbor(node_id);
+    
+    if (entry == NULL || checksum == 0 || entry->checksum != checksum) {
+        return 0;
+    }
+    entry->version = version;
+    entry->num_samples = num_samples;
+    entry->last_update_time = clock_seconds();
+    entry->last_update_seq = ++fed_state.update_seq;
+    if (fed_state.duplicates_skipped < UINT16_MAX) {
+        fed_state.duplicates_skipped++;
+    }
+    LOG_INFO("Q-table from node %u unchanged (version=%u), not stored\n", node_id, version);
+    return 1;
+#endif
 }
 
 /**
- * Aggregate Q-tables using FedAvg
+ * Receptions and aggregations saved by the duplicate suppression
  */
-uint8_t federated_aggregate_fedavg(void) {
-    if (fed_state.num_active_neighbors == 0) {
-        LOG_INFO("No neighbors to aggregate with\n");
+void get_dedup_stats(uint16_t *duplicates, uint16_t *aggregations) {
+    *duplicates = fed_state.duplicates_skipped;
+    *aggregations = fed_state.aggregations_skipped;
+}
+
+/**
+ * Encode the entries that moved more than tolerance since they were sent
+ */
+uint16_t fed_delta_encode(const q_value_t *q_values, q_value_t *shadow, q_value_t tolerance,
+                          uint8_t *entries, uint16_t max_entries) {
+    uint16_t count = 0;
+    
+    // count first, so an oversized delta leaves the shadow untouched
+    for (uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        q_value_t diff = q_values[i] - shadow[i];
+        if (diff > tolerance || diff < -tolerance) {
+            count++;
+        }
+    }
+    if (count > max_entries) {
+        return count;
+    }
+    
+    uint8_t *e = entries;
+    for (uint16_t i = 0; i < Q_TABLE_SIZE; i++) {
+        q_value_t diff = q_values[i] - shadow[i];
+        if (diff > tolerance || diff < -tolerance) {
+            e[0] = i & 0xff;
+            e[1] = i >> 8;
+            wire_put(e + 2, q_values[i]);
+            shadow[i] = q_values[i];
+            e += FED_DELTA_ENTRY_SIZE;
+        }
+    }
+    return count;
+}
+
+/**
+ * Write a full snapshot of q_values into msg with FEDERATED_QUANT_BITS
+ */
+static void encode_full(fed_message_t *msg, const q_value_t *q_values) {
+    msg->count = Q_TABLE_SIZE;
+    msg->checksum = fed_table_checksum(q_values);
+    msg->encoding = FEDERATED_QUANT_BITS;
+    msg->reserved[0] = 0;
+    msg->reserved[1] = 0;
+    // error the neighbors inherit in their aggregation (at most step / 2)
+    q_value_t quant_error = fed_quantize(q_values, Q_TABLE_SIZE, FEDERATED_QUANT_BITS,
+                                         &msg->quant, msg->values);
+    LOG_INFO("Q-table encoded: bits=%u bytes=%u step=%.4f max_error=%.4f\n",
+             FEDERATED_QUANT_BITS, (unsigned)FED_MESSAGE_LEN_FULL(FEDERATED_QUANT_BITS),
+             (double)Q_TO_FLOAT(fed_from_wire(msg->quant.scale)), (double)Q_TO_FLOAT(quant_error));
+}
+
+/**
+ * Prepare the next broadcast of the local table
+ */
+uint16_t fed_prepare_broadcast(fed_message_t *msg, uint16_t node_id) {
+    const q_value_t *local_q = get_q_table();
+    uint16_t len;
+    
+    msg->node_id = node_id;
+    msg->num_samples = fed_state.local_num_samples;
+    msg->base_version = fed_state.local_version;
+    msg->version = ++fed_state.local_version;
+    fed_state.summary.version = msg->version;
+#if FEDERATED_TRICKLE
+    memset(msg->best_actions, 0, sizeof(msg->best_actions));
+    fed_best_actions(msg->best_actions);
+#endif
+    
+#if FEDERATED_DELTA_SYNC
+    if (!fed_state.full_requested && fed_state.broadcasts_since_full < FEDERATED_FULL_INTERVAL - 1) {
+        uint16_t count = fed_delta_encode(local_q, fed_state.sent_q_values,
+                                          Q_FROM_FLOAT(FEDERATED_DELTA_TOLERANCE),
+                                          msg->values, FED_DELTA_MAX_ENTRIES);
+        if (count <= FED_DELTA_MAX_ENTRIES) {
+            msg->type = FED_MSG_DELTA;
+            msg->count = count;
+            // the receivers' copy now matches the shadow
+            msg->checksum = fed_table_checksum(fed_state.sent_q_values);
+            msg->encoding = 0;
+            fed_state.broadcasts_since_full++;
+            len = FED_MESSAGE_LEN_DELTA(count);
+            LOG_INFO("Q-table delta: entries=%u bytes=%u version=%u\n", count, len, msg->version);
+            return len;
+        }
+    }
+#endif /* FEDERATED_DELTA_SYNC */
+    
+    msg->type = FED_MSG_FULL;
+    encode_full(msg, local_q);
+    // deltas are computed against the exact values, the quantization error
+    // of the snapshot stays below step / 2 on the receivers
+    memcpy(fed_state.sent_q_values, local_q, sizeof(fed_state.sent_q_values));
+    fed_state.broadcasts_since_full = 0;
+    fed_state.full_requested = 0;
+    len = FED_MESSAGE_LEN_FULL(FEDERATED_QUANT_BITS);
+    LOG_INFO("Q-table full snapshot: bytes=%u version=%u\n", len, msg->version);
+    return len;
+}
+
+/**
+ * A neighbor reported a version gap
+ */
+void fed_request_full(void) {
+    fed_state.full_requested = 1;
+}
+
+/********** Enhanced Beacon Summaries ***********/
+
+/**
+ * Refresh the local model summary
+ */
+void fed_update_summary(uint16_t node_id, uint8_t state) {
+    fed_summary_t summary;
+    int32_t value;
+    
+    if (state >= Q_NUM_STATES) {
+        state = 0;
+    }
+    summary.node_id = node_id;
+    summary.version = fed_state.local_version;
+    summary.state = state;
+    summary.best_action = get_highest_q_val_in_state(state);
+    // through Q16.16, shifts only in fixed-point builds
+    value = fed_to_wire(get_q_value(state * Q_VALUE_LIST_SIZE + summary.best_action)) /
+            FED_SUMMARY_WIRE_STEP;
+    summary.best_value = value > INT16_MAX ? INT16_MAX :
+                         value < INT16_MIN ? INT16_MIN : (int16_t)value;
+    // the slot operation copies it from the rtimer interrupt when an EB goes out
+    int_master_status_t status = critical_enter();
+    fed_state.summary = summary;
+    critical_exit(status);
+}
+
+/**
+ * Copy of the local model summary
+ */
+void fed_get_summary(fed_summary_t *summary) {
+    int_master_status_t status = critical_enter();
+    *summary = fed_state.summary;
+    critical_exit(status);
+}
+
+/**
+ * A neighbor's EB summary
+ */
+void fed_summary_heard(const fed_summary_t *summary) {
+    const q_value_t *local_q = get_q_table();
+    q_value_t tolerance = Q_FROM_FLOAT(FEDERATED_SUMMARY_TOLERANCE);
+    
+    if (summary->state >= Q_NUM_STATES || summary->best_action >= Q_VALUE_LIST_SIZE) {
+        return;
+    }
+    
+    const q_value_t *row = &local_q[summary->state * Q_VALUE_LIST_SIZE];
+    q_value_t best = row[get_highest_q_val_in_state(summary->state)];
+    q_value_t value = fed_from_wire((int32_t)summary->best_value * FED_SUMMARY_WIRE_STEP);
+    q_value_t value_gap = value > best ? value - best : best - value;
+    
+    if (best - row[summary->best_action] <= tolerance && value_gap <= tolerance) {
+        if (fed_state.summaries_agreed < 255) {
+            fed_state.summaries_agreed++;
+        }
+    } else {
+        LOG_INFO("EB summary of node %u disagrees (state %u, action %u, value %.2f)\n",
+                 summary->node_id, summary->state, summary->best_action,
+                 (double)Q_TO_FLOAT(value));
+        if (fed_state.summaries_disagreed < 255) {
+            fed_state.summaries_disagreed++;
+        }
+    }
+    
+    // the table held for the sender is still its latest one
+    neighbor_q_table_t *entry = find_neighbor(summary->node_id);
+    if (entry != NULL && entry->version == summary->version) {
+        entry->last_update_time = clock_seconds();
+    }
+}
+
+/**
+ * Whether the next sync should broadcast the full table
+ */
+uint8_t fed_summary_broadcast_needed(void) {
+    uint8_t needed = fed_state.summaries_disagreed > 0 || fed_state.summaries_agreed == 0 ||
+                     fed_state.full_requested ||
+                     fed_state.syncs_skipped >= FEDERATED_SUMMARY_MAX_SKIP;
+    
+    if (needed) {
+        fed_state.syncs_skipped = 0;
+    } else {
+        fed_state.syncs_skipped++;
+        LOG_INFO("Q-table broadcast skipped: %u EB summaries agree\n", fed_state.summaries_agreed);
+    }
+    fed_state.summaries_agreed = 0;
+    fed_state.summaries_disagreed = 0;
+    return needed;
+}
+
+/********** Tree Aggregation ***********/
+
+/**
+ * Sample-weighted average of the local table and the stored tables
+ */
+uint16_t fed_subtree_aggregate(q_value_t *out) {
+    const q_value_t *local_q = get_q_table();
+#if FEDERATED_STREAMING
+    // no tables are kept, the subtree is the local node
+    memcpy(out, local_q, Q_TABLE_SIZE * sizeof(q_value_t));
+    return fed_state.local_num_samples;
+#else
+    const uint16_t *local_visits = get_visit_counts();
+    uint32_t neighbor_samples = 0;
+    
+    for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+        neighbor_samples += fed_state.neighbors[i].num_samples;
+    }
+    
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        uint16_t local_samples = local_visits[j] ? fed_state.local_num_samples : 0;
+        uint32_t entry_samples = neighbor_samples + local_samples;
+        if (entry_samples == 0) {
+            out[j] = local_q[j];
+            continue;
+        }
+        q_accum_t weighted = (q_accum_t)local_samples * local_q[j];
+        for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+            weighted += (q_accum_t)fed_state.neighbors[i].num_samples *
+                        fed_state.neighbors[i].q_values[j];
+        }
+        out[j] = (q_value_t)(weighted / (q_accum_t)entry_samples);
+    }
+    
+    neighbor_samples += fed_state.local_num_samples;
+    return neighbor_samples > UINT16_MAX ? UINT16_MAX : neighbor_samples;
+#endif
+}
+
+/**
+ * Prepare the subtree aggregate for the parent
+ */
+uint16_t fed_prepare_partial(fed_message_t *msg, uint16_t node_id) {
+    static q_value_t aggregate[Q_TABLE_SIZE];
+    
+    msg->type = FED_MSG_PARTIAL;
+    msg->node_id = node_id;
+    msg->num_samples = fed_subtree_aggregate(aggregate);
+    msg->version = fed_state.global_version;
+    msg->base_version = 0;
+    encode_full(msg, aggregate);
+    LOG_INFO("Subtree aggregate: children=%u samples=%u\n",
+             fed_state.num_active_neighbors, msg->num_samples);
+    return FED_MESSAGE_LEN_FULL(FEDERATED_QUANT_BITS);
+}
+
+/**
+ * Replace the local table with the model encoded in values (header in msg)
+ */
+static void adopt_model(const fed_message_t *msg, const uint8_t *values) {
+    static q_value_t model[Q_TABLE_SIZE];
+    
+    fed_dequantize(values, Q_TABLE_SIZE, msg->encoding, &msg->quant, model);
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        set_q_value(j, model[j]);
+    }
+}
+
+/**
+ * Root: aggregate, adopt and prepare the network-wide model
+ */
+uint16_t fed_prepare_global(fed_message_t *msg, uint16_t node_id) {
+    static q_value_t aggregate[Q_TABLE_SIZE];
+    
+    msg->type = FED_MSG_GLOBAL;
+    msg->node_id = node_id;
+    msg->num_samples = fed_subtree_aggregate(aggregate);
+    msg->version = ++fed_state.global_version;
+    msg->base_version = 0;
+    encode_full(msg, aggregate);
+    // the root adopts the encoded values, as its descendants do
+    adopt_model(msg, msg->values);
+    LOG_INFO("Network model %u: subtrees=%u samples=%u\n",
+             msg->version, fed_state.num_active_neighbors, msg->num_samples);
+    return FED_MESSAGE_LEN_FULL(FEDERATED_QUANT_BITS);
+}
+
+/**
+ * Adopt a network-wide model from the parent
+ */
+uint8_t fed_apply_global_model(const fed_message_t *msg, const uint8_t *values) {
+    if (msg->encoding != 0 && msg->encoding != 8 && msg->encoding != 16) {
+        return 0;
+    }
+    // a rebooted root restarts its rounds, so any other round is new
+    if (msg->version == fed_state.global_version) {
         return 0;
     }
+    adopt_model(msg, values);
+    fed_state.global_version = msg->version;
+    LOG_INFO("Adopted network model %u (samples=%u)\n", msg->version, msg->num_samples);
+    return 1;
+}
+
+/**
+ * Prepare the forwarding of an adopted network model
+ */
+uint16_t fed_prepare_forward(fed_message_t *msg, const uint8_t *values, uint16_t node_id) {
+    msg->node_id = node_id;
+    if (msg->encoding == FEDERATED_QUANT_BITS) {
+        memmove(msg->values, values, FED_FULL_VALUES_LEN);
+    } else {
+        encode_full(msg, get_q_table());
+    }
+    return FED_MESSAGE_LEN_FULL(FEDERATED_QUANT_BITS);
+}
+
+/********** Trickle Dissemination ***********/
+
+// Start an interval of the given length now, t drawn from [I/2, I)
+static void trickle_start_interval(fed_trickle_t *t, uint32_t interval) {
+    t->interval_start = clock_seconds();
+    t->interval = interval;
+    t->tx_offset = interval / 2 + random_rand() % (interval - interval / 2);
+    t->counter = 0;
+    t->tx_passed = 0;
+}
+
+// Inconsistency: back to FEDERATED_TRICKLE_IMIN unless already there
+static uint8_t trickle_reset(fed_trickle_t *t) {
+    if (t->interval <= FEDERATED_TRICKLE_IMIN) {
+        return 0;
+    }
+    trickle_start_interval(t, FEDERATED_TRICKLE_IMIN);
+    t->resets++;
+    return 1;
+}
+
+/**
+ * Best action of every state of the local table
+ */
+void fed_best_actions(uint8_t *best_actions) {
+    for (uint8_t s = 0; s < Q_NUM_STATES; s++) {
+        best_actions[s] = get_highest_q_val_in_state(s);
+    }
+}
+
+/**
+ * Start a Trickle timer at the minimum interval
+ */
+void fed_trickle_init(fed_trickle_t *t) {
+    memset(t, 0, sizeof(*t));
+    fed_best_actions(t->best_actions);
+    trickle_start_interval(t, FEDERATED_TRICKLE_IMIN);
+}
+
+/**
+ * Time of the next Trickle event
+ */
+uint32_t fed_trickle_next_event(const fed_trickle_t *t) {
+    return t->interval_start + (t->tx_passed ? t->interval : t->tx_offset);
+}
+
+/**
+ * Handle a due Trickle event
+ */
+fed_trickle_event_t fed_trickle_expired(fed_trickle_t *t) {
+    if (!t->tx_passed) {
+        t->tx_passed = 1;
+        if (FEDERATED_TRICKLE_K == 0 || t->counter < FEDERATED_TRICKLE_K) {
+            // the broadcast advertises the current best actions
+            fed_best_actions(t->best_actions);
+            t->transmissions++;
+            return FED_TRICKLE_TRANSMIT;
+        }
+        t->suppressions++;
+        LOG_INFO("Trickle: broadcast suppressed (heard %u consistent tables)\n", t->counter);
+        return FED_TRICKLE_SUPPRESS;
+    }
     
-    float *local_q_table = get_q_table();
+    trickle_start_interval(t, t->interval < FED_TRICKLE_IMAX ? t->interval * 2 : FED_TRICKLE_IMAX);
+    return FED_TRICKLE_WAIT;
+}
+
+/**
+ * A neighbor advertised its best actions
+ */
+uint8_t fed_trickle_heard(fed_trickle_t *t, const uint8_t *best_actions) {
+    const q_value_t *local_q = get_q_table();
+    q_value_t tolerance = Q_FROM_FLOAT(FEDERATED_TRICKLE_TOLERANCE);
     
-    // Temporary array for aggregation
-    float temp_aggregated[Q_VALUE_LIST_SIZE];
+    for (uint8_t s = 0; s < Q_NUM_STATES; s++) {
+        const q_value_t *row = &local_q[s * Q_VALUE_LIST_SIZE];
+        if (best_actions[s] >= Q_VALUE_LIST_SIZE ||
+            row[get_highest_q_val_in_state(s)] - row[best_actions[s]] > tolerance) {
+            LOG_INFO("Trickle: inconsistent table (state %u prefers action %u)\n",
+                     s, best_actions[s]);
+            return trickle_reset(t);
+        }
+    }
     
-    // Initialize with zeros
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        temp_aggregated[j] = 0.0;
+    if (t->counter < 255) {
+        t->counter++;
     }
+    return 0;
+}
+
+/**
+ * Reset the interval when the local best action changed
+ */
+uint8_t fed_trickle_check_local(fed_trickle_t *t) {
+    const q_value_t *local_q = get_q_table();
+    q_value_t tolerance = Q_FROM_FLOAT(FEDERATED_TRICKLE_TOLERANCE);
     
-    // Sum all Q-values (local + neighbors)
-    uint8_t count = 0;
+    for (uint8_t s = 0; s < Q_NUM_STATES; s++) {
+        const q_value_t *row = &local_q[s * Q_VALUE_LIST_SIZE];
+        if (row[get_highest_q_val_in_state(s)] - row[t->best_actions[s]] > tolerance) {
+            LOG_INFO("Trickle: best action of state %u changed %u -> %u\n",
+                     s, t->best_actions[s], get_highest_q_val_in_state(s));
+            fed_best_actions(t->best_actions);
+            return trickle_reset(t);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Q16.16 wire representation of a Q-value
+ */
+int32_t fed_to_wire(q_value_t value) {
+#if Q_LEARNING_FIXED_POINT
+#if Q_FIXED_FRAC_BITS >= FED_WIRE_FRAC_BITS
+    return value >> (Q_FIXED_FRAC_BITS - FED_WIRE_FRAC_BITS);
+#else
+    return value * (1L << (FED_WIRE_FRAC_BITS - Q_FIXED_FRAC_BITS));
+#endif
+#else
+    float w = value * (float)(1L << FED_WIRE_FRAC_BITS);
+    if (w >= 2147483648.0f) return INT32_MAX;
+    if (w <= -2147483648.0f) return INT32_MIN;
+    return (int32_t)(w + (w >= 0 ? 0.5f : -0.5f));
+#endif
+}
+
+/**
+ * Q-value of its Q16.16 wire representation
+ */
+q_value_t fed_from_wire(int32_t value) {
+#if Q_LEARNING_FIXED_POINT
+#if Q_FIXED_FRAC_BITS >= FED_WIRE_FRAC_BITS
+    return value * (1L << (Q_FIXED_FRAC_BITS - FED_WIRE_FRAC_BITS));
+#else
+    return value >> (FED_WIRE_FRAC_BITS - Q_FIXED_FRAC_BITS);
+#endif
+#else
+    return (q_value_t)value / (1L << FED_WIRE_FRAC_BITS);
+#endif
+}
+
+/**
+ * Quantize Q-values into 8 or 16 bit codes, or raw Q16.16 values
+ * offset is the minimum and scale spreads the range over all codes, so the
+ * reconstruction error is at most scale / 2. Both are rounded to the wire
+ * grid first (offset down, scale up) and the codes computed from the
+ * rounded pair, so the receivers reconstruct exactly what the error is
+ * measured against
+ */
+q_value_t fed_quantize(const q_value_t *q_values, uint16_t count, uint8_t bits,
+                       fed_quant_params_t *params, uint8_t *codes) {
+    uint16_t levels = bits == 16 ? 0xffff : 0xff;
+    q_value_t min_q = q_values[0];
+    q_value_t max_q = q_values[0];
+    q_value_t max_error = 0;
+    q_value_t offset, scale;
     
-    // Add local Q-values
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        temp_aggregated[j] += local_q_table[j];
+    if (bits == 0) {
+        params->offset = 0;
+        params->scale = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            wire_put(codes + i * FED_WIRE_RAW_SIZE, q_values[i]);
+            q_value_t error = q_values[i] - wire_get(codes + i * FED_WIRE_RAW_SIZE);
+            if (error < 0) error = -error;
+            if (error > max_error) max_error = error;
+        }
+        return max_error;
     }
-    count++;
     
-    // Add neighbor Q-values
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        if (fed_state.neighbors[i].is_active) {
-            for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-                temp_aggregated[j] += fed_state.neighbors[i].q_values[j];
-            }
-            count++;
+    for (uint16_t i = 1; i < count; i++) {
+        if (q_values[i] < min_q) min_q = q_values[i];
+        if (q_values[i] > max_q) max_q = q_values[i];
+    }
+    
+    params->offset = fed_to_wire(min_q);
+    if (fed_from_wire(params->offset) > min_q) {
+        params->offset--;
+    }
+    offset = fed_from_wire(params->offset);
+#if Q_LEARNING_FIXED_POINT
+    // round up so the largest value is still reachable
+    scale = (max_q - offset + levels - 1) / levels;
+#else
+    scale = (max_q - offset) / levels;
+#endif
+    if (scale <= 0) {
+        scale = Q_ONE;  // flat table, every code is 0
+    }
+    params->scale = fed_to_wire(scale);
+    if (fed_from_wire(params->scale) < scale) {
+        params->scale++;
+    }
+    scale = fed_from_wire(params->scale);
+    
+    for (uint16_t i = 0; i < count; i++) {
+        // round to the nearest code
+        uint32_t code = (uint32_t)((q_values[i] - offset + scale / 2) / scale);
+        if (code > levels) code = levels;
+        
+        if (bits == 16) {
+            codes[2 * i] = code & 0xff;
+            codes[2 * i + 1] = code >> 8;
+        } else {
+            codes[i] = code;
+        }
+        
+        q_value_t error = q_values[i] - (offset + (q_value_t)code * scale);
+        if (error < 0) error = -error;
+        if (error > max_error) max_error = error;
+    }
+    return max_error;
+}
+
+/**
+ * Reconstruct Q-values from their codes or raw values
+ */
+void fed_dequantize(const uint8_t *codes, uint16_t count, uint8_t bits,
+                    const fed_quant_params_t *params, q_value_t *q_values) {
+    if (bits == 0) {
+        for (uint16_t i = 0; i < count; i++) {
+            q_values[i] = wire_get(codes + i * FED_WIRE_RAW_SIZE);
         }
+        return;
     }
     
-    // Average and update local Q-table with aggregation weight
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        float avg = temp_aggregated[j] / count;
-        local_q_table[j] = fed_state.aggregation_weight * local_q_table[j] + 
-                           (1.0 - fed_state.aggregation_weight) * avg;
+    q_value_t offset = fed_from_wire(params->offset);
+    q_value_t scale = fed_from_wire(params->scale);
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t code = bits == 16 ? codes[2 * i] | ((uint16_t)codes[2 * i + 1] << 8) : codes[i];
+        q_values[i] = offset + (q_value_t)code * scale;
+    }
+}
+
+/**
+ * Median of count Q-values, reordering values in place
+ */
+q_value_t fed_median(q_value_t *values, uint8_t count) {
+    q_value_t *v = values;
+    
+    // Median networks for the common small neighborhoods
+    switch (count) {
+        case 0:
+            return 0;
+        case 1:
+            return v[0];
+        case 2:
+            return (v[0] + v[1]) / 2;
+        case 3:
+            Q_CSWAP(v[0], v[1]); Q_CSWAP(v[1], v[2]); Q_CSWAP(v[0], v[1]);
+            return v[1];
+        case 4:
+            Q_CSWAP(v[0], v[1]); Q_CSWAP(v[2], v[3]); Q_CSWAP(v[0], v[2]);
+            Q_CSWAP(v[1], v[3]); Q_CSWAP(v[1], v[2]);
+            return (v[1] + v[2]) / 2;
+        case 5:
+            Q_CSWAP(v[0], v[1]); Q_CSWAP(v[3], v[4]); Q_CSWAP(v[0], v[3]);
+            Q_CSWAP(v[1], v[4]); Q_CSWAP(v[1], v[2]); Q_CSWAP(v[2], v[3]);
+            Q_CSWAP(v[1], v[2]);
+            return v[2];
+        case 7:
+            Q_CSWAP(v[0], v[5]); Q_CSWAP(v[0], v[3]); Q_CSWAP(v[1], v[6]);
+            Q_CSWAP(v[2], v[4]); Q_CSWAP(v[0], v[1]); Q_CSWAP(v[3], v[5]);
+            Q_CSWAP(v[2], v[6]); Q_CSWAP(v[2], v[3]); Q_CSWAP(v[3], v[6]);
+            Q_CSWAP(v[4], v[5]); Q_CSWAP(v[1], v[4]); Q_CSWAP(v[1], v[3]);
+            Q_CSWAP(v[3], v[4]);
+            return v[3];
+        default:
+            break;
+    }
+    
+    uint8_t k = count / 2;
+    select_kth(v, count, k);
+    if (count % 2) {
+        return v[k];
+    }
+    // even count: the lower middle is the largest value left of k
+    q_value_t lower = v[0];
+    for (uint8_t i = 1; i < k; i++) {
+        if (v[i] > lower) lower = v[i];
+    }
+    return (lower + v[k]) / 2;
+}
+
+/**
+ * Aggregate Q-tables using FedAvg
+ */
+uint8_t federated_aggregate_fedavg(void) {
+    if (neighbors_to_aggregate() == 0) {
+        LOG_INFO("No neighbors to aggregate with\n");
+        return 0;
+    }
+    
+#if FEDERATED_STREAMING
+    uint8_t neighbors = aggregate_running_sums(0);
+    LOG_INFO("FedAvg: aggregated %u neighbors\n", neighbors);
+    return neighbors;
+#else
+    const q_value_t *local_q_table = get_q_table();
+    
+    // Average each Q-value position over local + neighbors and update the
+    // local Q-table with the aggregation weight
+    uint8_t count = 0;
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        // Add local Q-value
+        q_accum_t sum = local_q_table[j];
+        count = 1;
+        
+        // Add neighbor Q-values
+        for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+            sum += fed_state.neighbors[i].q_values[j];
+            count++;
+        }
+        
+        set_q_value(j, blend_with_local(local_q_table[j], (q_value_t)(sum / count)));
     }
     
     LOG_INFO("FedAvg: aggregated %u neighbors\n", count - 1);
     return count - 1;
+#endif
 }
 
 /**
  * Aggregate Q-tables using weighted average based on number of samples
  */
 uint8_t federated_aggregate_weighted(void) {
-    if (fed_state.num_active_neighbors == 0) {
+    if (neighbors_to_aggregate() == 0) {
         LOG_INFO("No neighbors to aggregate with\n");
         return 0;
     }
     
-    float *local_q_table = get_q_table();
-    float temp_weighted[Q_VALUE_LIST_SIZE];
-    
-    // Initialize with zeros
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        temp_weighted[j] = 0.0;
-    }
+#if FEDERATED_STREAMING
+    uint8_t neighbors = aggregate_running_sums(1);
+    LOG_INFO("Weighted FedAvg: local_samples=%u, neighbors=%u\n",
+             fed_state.local_num_samples, neighbors);
+    return neighbors;
+#else
+    const q_value_t *local_q_table = get_q_table();
     
     // Calculate total samples
     uint32_t total_samples = fed_state.local_num_samples;
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        if (fed_state.neighbors[i].is_active) {
-            total_samples += fed_state.neighbors[i].num_samples;
-        }
+    uint8_t neighbor_count = 0;
+    for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+        total_samples += fed_state.neighbors[i].num_samples;
+        neighbor_count++;
     }
     
     if (total_samples == 0) {
@@ -194,69 +1208,283 @@ uint8_t federated_aggregate_weighted(void) {
         return federated_aggregate_fedavg();  // Fallback to simple average
     }
     
-    // Weighted sum: local Q-table
-    float local_weight = (float)fed_state.local_num_samples / total_samples;
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        temp_weighted[j] += local_weight * local_q_table[j];
-    }
-    
-    // Weighted sum: neighbor Q-tables
-    uint8_t neighbor_count = 0;
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        if (fed_state.neighbors[i].is_active) {
-            float weight = (float)fed_state.neighbors[i].num_samples / total_samples;
-            for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-                temp_weighted[j] += weight * fed_state.neighbors[i].q_values[j];
-            }
-            neighbor_count++;
+    // Weighted sum per Q-value position: sum(samples_i * q_i) / total_samples
+    // Local entries never visited still hold their random initial value and
+    // get no weight, they simply take over the neighbors' estimate
+    const uint16_t *local_visits = get_visit_counts();
+    uint32_t neighbor_samples = total_samples - fed_state.local_num_samples;
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        uint16_t local_samples = local_visits[j] ? fed_state.local_num_samples : 0;
+        uint32_t entry_samples = neighbor_samples + local_samples;
+        if (entry_samples == 0) {
+            continue;  // nobody has information about this entry
         }
-    }
-    
-    // Update local Q-table with weighted aggregation
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        local_q_table[j] = temp_weighted[j];
+        q_accum_t weighted = (q_accum_t)local_samples * local_q_table[j];
+        
+        for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+            weighted += (q_accum_t)fed_state.neighbors[i].num_samples * 
+                        fed_state.neighbors[i].q_values[j];
+        }
+        
+        // Update local Q-table with weighted aggregation
+        set_q_value(j, (q_value_t)(weighted / (q_accum_t)entry_samples));
     }
     
     LOG_INFO("Weighted FedAvg: local_weight=%.2f, neighbors=%u\n", 
-             (double)local_weight, neighbor_count);
+             (double)Q_TO_FLOAT(Q_FROM_RATIO(fed_state.local_num_samples, total_samples)),
+             neighbor_count);
     return neighbor_count;
+#endif
 }
 
 /**
  * Aggregate Q-tables using median
  */
 uint8_t federated_aggregate_median(void) {
+#if FEDERATED_STREAMING
+    LOG_WARN("FedMedian needs the neighbor tables, using FedAvg (streaming mode)\n");
+    return federated_aggregate_fedavg();
+#else
     if (fed_state.num_active_neighbors == 0) {
         LOG_INFO("No neighbors to aggregate with\n");
         return 0;
     }
     
-    float *local_q_table = get_q_table();
-    float temp_median[Q_VALUE_LIST_SIZE];
+    const q_value_t *local_q_table = get_q_table();
     
-    // For each Q-value position, collect values from all nodes and take median
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        float values[MAX_FEDERATED_NEIGHBORS + 1];
+    // For each Q-value position, collect values from all nodes and take median,
+    // then update the local Q-table applying the aggregation weight
+    q_value_t values[MAX_FEDERATED_NEIGHBORS + 1];
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
         values[0] = local_q_table[j];
         uint8_t count = 1;
         
-        for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-            if (fed_state.neighbors[i].is_active) {
-                values[count++] = fed_state.neighbors[i].q_values[j];
-            }
+        for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+            values[count++] = fed_state.neighbors[i].q_values[j];
         }
         
-        temp_median[j] = calculate_median(values, count);
+        set_q_value(j, blend_with_local(local_q_table[j], fed_median(values, count)));
+    }
+    
+    LOG_INFO("FedMedian: aggregated %u neighbors\n", fed_state.num_active_neighbors);
+    return fed_state.num_active_neighbors;
+#endif
+}
+
+/**
+ * Aggregate Q-tables using the coordinate-wise trimmed mean
+ */
+uint8_t federated_aggregate_trimmed(void) {
+#if FEDERATED_STREAMING
+    LOG_WARN("Trimmed mean needs the neighbor tables, using FedAvg (streaming mode)\n");
+    return federated_aggregate_fedavg();
+#else
+    if (fed_state.num_active_neighbors == 0) {
+        LOG_INFO("No neighbors to aggregate with\n");
+        return 0;
     }
     
-    // Update local Q-table with median values and apply aggregation weight
-    for (int j = 0; j < Q_VALUE_LIST_SIZE; j++) {
-        local_q_table[j] = fed_state.aggregation_weight * local_q_table[j] + 
-                           (1.0 - fed_state.aggregation_weight) * temp_median[j];
+    const q_value_t *local_q_table = get_q_table();
+    uint8_t count = fed_state.num_active_neighbors + 1;
+    uint8_t trim = (uint16_t)count * FEDERATED_TRIM_PERCENT / 100;
+    if (trim == 0 && count >= 3) {
+        trim = 1;
     }
+    uint8_t kept = count - 2 * trim;
     
-    LOG_INFO("FedMedian: aggregated %u neighbors\n", fed_state.num_active_neighbors);
+    q_value_t values[MAX_FEDERATED_NEIGHBORS + 1];
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        values[0] = local_q_table[j];
+        for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+            values[i + 1] = fed_state.neighbors[i].q_values[j];
+        }
+        
+        // two selections leave the kept values in values[trim .. trim + kept)
+        if (trim > 0) {
+            select_kth(values, count, trim);
+            select_kth(values + trim, count - trim, kept);
+        }
+        q_accum_t sum = 0;
+        for (int i = trim; i < trim + kept; i++) {
+            sum += values[i];
+        }
+        set_q_value(j, blend_with_local(local_q_table[j], (q_value_t)(sum / kept)));
+    }
+    
+    LOG_INFO("Trimmed mean: aggregated %u neighbors, trimmed %u per end\n",
+             fed_state.num_active_neighbors, trim);
     return fed_state.num_active_neighbors;
+#endif
+}
+
+#if !FEDERATED_STREAMING
+/**
+ * Candidate table for Krum: 0 is the local table, i the (i-1)-th neighbor
+ */
+static const q_value_t *krum_table(uint8_t i) {
+    return i == 0 ? get_q_table() : fed_state.neighbors[i - 1].q_values;
+}
+
+/**
+ * L1 distance between two Q-tables (additions only, exact in fixed point)
+ */
+static q_accum_t table_distance(const q_value_t *a, const q_value_t *b) {
+    q_accum_t distance = 0;
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        q_value_t diff = a[j] - b[j];
+        distance += diff < 0 ? -diff : diff;
+    }
+    return distance;
+}
+#endif
+
+/**
+ * Aggregate Q-tables using Multi-Krum
+ */
+uint8_t federated_aggregate_krum(void) {
+#if FEDERATED_STREAMING
+    LOG_WARN("Krum needs the neighbor tables, using FedAvg (streaming mode)\n");
+    return federated_aggregate_fedavg();
+#else
+    if (fed_state.num_active_neighbors == 0) {
+        LOG_INFO("No neighbors to aggregate with\n");
+        return 0;
+    }
+    
+    uint8_t count = fed_state.num_active_neighbors + 1;
+    if (count < FEDERATED_KRUM_F + 3) {
+        LOG_INFO("Krum: %u tables for f=%u, using the median\n", count, FEDERATED_KRUM_F);
+        return federated_aggregate_median();
+    }
+    
+    // Score every table by the distance to its closest tables; distances are
+    // recomputed per table so memory stays O(neighbors)
+    uint8_t closest = count - FEDERATED_KRUM_F - 2;
+    q_accum_t scores[MAX_FEDERATED_NEIGHBORS + 1];
+    q_accum_t distances[MAX_FEDERATED_NEIGHBORS + 1];
+    for (uint8_t a = 0; a < count; a++) {
+        uint8_t n = 0;
+        for (uint8_t b = 0; b < count; b++) {
+            if (b != a) {
+                distances[n++] = table_distance(krum_table(a), krum_table(b));
+            }
+        }
+        // partial selection sort of the closest distances
+        scores[a] = 0;
+        for (uint8_t k = 0; k < closest; k++) {
+            uint8_t min = k;
+            for (uint8_t i = k + 1; i < n; i++) {
+                if (distances[i] < distances[min]) min = i;
+            }
+            q_accum_t d = distances[min];
+            distances[min] = distances[k];
+            distances[k] = d;
+            scores[a] += d;
+        }
+    }
+    
+    // Keep the count - f best scored tables
+    uint8_t selected[MAX_FEDERATED_NEIGHBORS + 1];
+    uint8_t keep = count - FEDERATED_KRUM_F;
+    memset(selected, 0, count);
+    for (uint8_t k = 0; k < keep; k++) {
+        int best = -1;
+        for (uint8_t i = 0; i < count; i++) {
+            if (!selected[i] && (best < 0 || scores[i] < scores[best])) best = i;
+        }
+        selected[best] = 1;
+    }
+    
+    const q_value_t *local_q_table = get_q_table();
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        q_accum_t sum = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (selected[i]) {
+                sum += krum_table(i)[j];
+            }
+        }
+        set_q_value(j, blend_with_local(local_q_table[j], (q_value_t)(sum / keep)));
+    }
+    
+    uint8_t neighbors = keep - selected[0];
+    for (uint8_t i = 1; i < count; i++) {
+        if (!selected[i]) {
+            LOG_INFO("Krum: rejected table of node %u\n", fed_state.neighbors[i - 1].node_id);
+        }
+    }
+    LOG_INFO("Krum: aggregated %u neighbors (local %s)\n", neighbors,
+             selected[0] ? "kept" : "rejected");
+    return neighbors;
+#endif
+}
+
+#if !FEDERATED_STREAMING
+// Fixed-point 1.0 of the age decay factor
+#define FED_DECAY_ONE 1024
+
+/**
+ * Weight factor of a table updated age seconds ago, FED_DECAY_ONE when fresh
+ */
+static uint16_t staleness_decay(uint32_t age) {
+    uint32_t halvings = age / FEDERATED_STALENESS_HALF_LIFE;
+    if (halvings >= 10) {
+        return 0;  // below 1/FED_DECAY_ONE
+    }
+    uint16_t decay = FED_DECAY_ONE >> halvings;
+    return decay - (uint32_t)decay * (age % FEDERATED_STALENESS_HALF_LIFE) /
+                   (2 * FEDERATED_STALENESS_HALF_LIFE);
+}
+#endif
+
+/**
+ * Aggregate Q-tables using age-decayed sample weights
+ */
+uint8_t federated_aggregate_staleness(void) {
+#if FEDERATED_STREAMING
+    // only tables of the current round are folded, none is stale
+    return federated_aggregate_weighted();
+#else
+    if (fed_state.num_active_neighbors == 0) {
+        LOG_INFO("No neighbors to aggregate with\n");
+        return 0;
+    }
+    
+    uint32_t now = clock_seconds();
+    uint32_t weights[MAX_FEDERATED_NEIGHBORS];
+    uint64_t neighbor_weight = 0;
+    uint8_t used = 0;
+    for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+        const neighbor_q_table_t *n = &fed_state.neighbors[i];
+        weights[i] = (uint32_t)n->num_samples * staleness_decay(now - n->last_update_time);
+        neighbor_weight += weights[i];
+        used += weights[i] > 0;
+    }
+    if (neighbor_weight == 0) {
+        LOG_INFO("Staleness-weighted FedAvg: all neighbor tables too old\n");
+        return 0;
+    }
+    
+    // As in weighted FedAvg, unvisited local entries get no weight
+    const q_value_t *local_q_table = get_q_table();
+    const uint16_t *local_visits = get_visit_counts();
+    uint32_t local_weight = (uint32_t)fed_state.local_num_samples * FED_DECAY_ONE;
+    for (int j = 0; j < Q_TABLE_SIZE; j++) {
+        uint32_t entry_local = local_visits[j] ? local_weight : 0;
+        q_accum_t weighted = (q_accum_t)entry_local * local_q_table[j];
+        
+        for (int i = 0; i < fed_state.num_active_neighbors; i++) {
+            if (weights[i]) {
+                weighted += (q_accum_t)weights[i] * fed_state.neighbors[i].q_values[j];
+            }
+        }
+        set_q_value(j, (q_value_t)(weighted / (q_accum_t)(neighbor_weight + entry_local)));
+    }
+    
+    LOG_INFO("Staleness-weighted FedAvg: local_weight=%.2f, neighbors=%u/%u\n",
+             (double)local_weight / (double)(local_weight + neighbor_weight),
+             used, fed_state.num_active_neighbors);
+    return used;
+#endif
 }
 
 /**
@@ -267,6 +1495,20 @@ uint8_t federated_aggregate(void) {
     return 0;
     #endif
     
+#if !FEDERATED_STREAMING
+    // every stored table is mixed in already: aggregating again would only
+    // pull the local table further towards the same data
+    if (!fed_state.tables_changed && fed_state.num_active_neighbors > 0) {
+        if (fed_state.aggregations_skipped < UINT16_MAX) {
+            fed_state.aggregations_skipped++;
+        }
+        LOG_INFO("Aggregation skipped: neighbor tables unchanged (skipped=%u)\n",
+                 fed_state.aggregations_skipped);
+        return 0;
+    }
+    fed_state.tables_changed = 0;
+#endif
+    
     switch (fed_state.aggregation_method) {
         case FEDAVG:
             return federated_aggregate_fedavg();
@@ -274,6 +1516,12 @@ uint8_t federated_aggregate(void) {
             return federated_aggregate_weighted();
         case FEDMEDIAN:
             return federated_aggregate_median();
+        case FEDTRIMMED:
+            return federated_aggregate_trimmed();
+        case FEDKRUM:
+            return federated_aggregate_krum();
+        case FEDSTALENESS:
+            return federated_aggregate_staleness();
         default:
             LOG_WARN("Unknown aggregation method %u\n", fed_state.aggregation_method);
             return federated_aggregate_fedavg();
@@ -283,7 +1531,7 @@ uint8_t federated_aggregate(void) {
 /**
  * Get local Q-table for sharing
  */
-float* get_local_q_table_for_sharing(void) {
+const q_value_t* get_local_q_table_for_sharing(void) {
     return get_q_table();
 }
 
@@ -291,7 +1539,7 @@ float* get_local_q_table_for_sharing(void) {
  * Increment local sample count
  */
 void increment_local_samples(void) {
-    if (fed_state.local_num_samples < 255) {
+    if (fed_state.local_num_samples < UINT16_MAX) {
         fed_state.local_num_samples++;
     }
 }
@@ -299,10 +1547,17 @@ void increment_local_samples(void) {
 /**
  * Get local sample count
  */
-uint8_t get_local_sample_count(void) {
+uint16_t get_local_sample_count(void) {
     return fed_state.local_num_samples;
 }
 
+/**
+ * Set local sample count
+ */
+void set_local_sample_count(uint16_t samples) {
+    fed_state.local_num_samples = samples;
+}
+
 /**
  * Clean up stale neighbor entries
  */
@@ -310,15 +1565,16 @@ void cleanup_stale_neighbors(uint32_t timeout_seconds) {
     uint32_t current_time = clock_seconds();
     uint8_t removed = 0;
     
-    for (int i = 0; i < MAX_FEDERATED_NEIGHBORS; i++) {
-        if (fed_state.neighbors[i].is_active) {
-            if (current_time - fed_state.neighbors[i].last_update_time > timeout_seconds) {
-                LOG_INFO("Removing stale neighbor node %u\n", 
-                         fed_state.neighbors[i].node_id);
-                fed_state.neighbors[i].is_active = 0;
-                fed_state.num_active_neighbors--;
-                removed++;
-            }
+    // removal moves the last entry into the freed slot, so it is checked next
+    int i = 0;
+    while (i < fed_state.num_active_neighbors) {
+        if (current_time - fed_state.neighbors[i].last_update_time > timeout_seconds) {
+            LOG_INFO("Removing stale neighbor node %u\n", 
+                     fed_state.neighbors[i].node_id);
+            remove_neighbor(i);
+            removed++;
+        } else {
+            i++;
         }
     }
     
@@ -330,17 +1586,37 @@ void cleanup_stale_neighbors(uint32_t timeout_seconds) {
 /**
  * Get federated learning statistics
  */
-void get_federated_stats(uint8_t *num_neighbors, uint8_t *local_samples, 
+void get_federated_stats(uint8_t *num_neighbors, uint16_t *local_samples, 
                          fed_aggregation_method_t *method) {
     if (num_neighbors) *num_neighbors = fed_state.num_active_neighbors;
     if (local_samples) *local_samples = fed_state.local_num_samples;
     if (method) *method = fed_state.aggregation_method;
 }
 
+/**
+ * Number of neighbors replaced because the table was full
+ */
+uint16_t get_neighbor_evictions(void) {
+    return fed_state.evictions;
+}
+
+/**
+ * Federated state of this node
+ */
+federated_state_t *get_federated_state(void) {
+    return &fed_state;
+}
+
 /**
  * Set aggregation method
  */
 void set_aggregation_method(fed_aggregation_method_t method) {
+#if FEDERATED_STREAMING
+    // the running sums were weighted for the previous method
+    if (method != fed_state.aggregation_method) {
+        reset_running_sums();
+    }
+#endif
     fed_state.aggregation_method = method;
     LOG_INFO("Aggregation method changed to %u\n", method);
 }
@@ -348,9 +1624,9 @@ void set_aggregation_method(fed_aggregation_method_t method) {
 /**
  * Set local model weight
  */
-void set_local_model_weight(float weight) {
-    if (weight < 0.0) weight = 0.0;
-    if (weight > 1.0) weight = 1.0;
+void set_local_model_weight(q_value_t weight) {
+    if (weight < 0) weight = 0;
+    if (weight > Q_ONE) weight = Q_ONE;
     fed_state.aggregation_weight = weight;
-    LOG_INFO("Local model weight set to %.2f\n", (double)weight);
+    LOG_INFO("Local model weight set to %.2f\n", (double)Q_TO_FLOAT(weight));
 }
\ No newline at end of file
@@ -3,11 +3,8 @@
 
 /********** Libraries **********/
 #include "contiki.h"
-
-// Forward declaration to avoid circular dependency
-#ifndef Q_VALUE_LIST_SIZE
-#define Q_VALUE_LIST_SIZE 101  // Default TSCH slotframe length
-#endif
+#include "q-learning.h"
+#include <stddef.h>
 
 /******** Configuration *******/
 // Maximum number of neighbor nodes to store Q-tables from
@@ -15,6 +12,38 @@
 #define MAX_FEDERATED_NEIGHBORS 10
 #endif
 
+#if MAX_FEDERATED_NEIGHBORS > 127
+#error "MAX_FEDERATED_NEIGHBORS must not exceed 127"
+#endif
+
+// Open-addressing index from node ID to neighbor entry: 2^BITS positions,
+// at least twice MAX_FEDERATED_NEIGHBORS so probe sequences stay short
+#ifndef FED_NEIGHBOR_INDEX_BITS
+#if MAX_FEDERATED_NEIGHBORS <= 8
+#define FED_NEIGHBOR_INDEX_BITS 4
+#elif MAX_FEDERATED_NEIGHBORS <= 16
+#define FED_NEIGHBOR_INDEX_BITS 5
+#elif MAX_FEDERATED_NEIGHBORS <= 32
+#define FED_NEIGHBOR_INDEX_BITS 6
+#elif MAX_FEDERATED_NEIGHBORS <= 64
+#define FED_NEIGHBOR_INDEX_BITS 7
+#else
+#define FED_NEIGHBOR_INDEX_BITS 8
+#endif
+#endif
+#define FED_NEIGHBOR_INDEX_SIZE (1 << FED_NEIGHBOR_INDEX_BITS)
+
+// Entry replaced when a new neighbor arrives with the table full. Macros
+// rather than an enum so FEDERATED_EVICTION can be tested by #if
+#define FED_EVICT_LRU 0           // least recently updated neighbor
+#define FED_EVICT_QUALITY 1       // fewest samples (oldest among equals); a newcomer
+                                  // with fewer samples than every entry is dropped
+#ifdef FEDERATED_CONF_EVICTION
+#define FEDERATED_EVICTION FEDERATED_CONF_EVICTION
+#else
+#define FEDERATED_EVICTION FED_EVICT_LRU
+#endif
+
 // Federated learning synchronization interval
 #ifndef FEDERATED_SYNC_INTERVAL
 #define FEDERATED_SYNC_INTERVAL 180
@@ -25,31 +54,355 @@
 #define ENABLE_FEDERATED_LEARNING 1
 #endif
 
-// Federated aggregation method
+// Wire encoding of shared Q-tables: 8 or 16 bit codes with a per-message
+// offset and scale (q ~ offset + code * scale), 0 sends raw values
+#ifdef FEDERATED_CONF_QUANT_BITS
+#define FEDERATED_QUANT_BITS FEDERATED_CONF_QUANT_BITS
+#else
+#define FEDERATED_QUANT_BITS 8
+#endif
+
+// Raw Q-values, delta entries and the quantization offset/scale travel as
+// Q16.16 two's complement (4 bytes, little endian in the values), whether
+// the node keeps float or fixed-point Q-values, so both builds interoperate
+#define FED_WIRE_FRAC_BITS 16
+#define FED_WIRE_RAW_SIZE 4
+
+// Bytes per Q-value on the wire for an encoding
+#define FED_WIRE_VALUE_SIZE(bits) ((bits) == 0 ? FED_WIRE_RAW_SIZE : (bits) / 8)
+
+// Online aggregation: every received table is folded into per-entry
+// running weighted sums as it arrives and only an ID, weight and version
+// are kept per neighbor. A neighbor is folded in once per round, later
+// messages of the same round are skipped. FedMedian, trimmed mean and Krum
+// need the stored tables and fall back to FedAvg in this mode
+#ifdef FEDERATED_CONF_STREAMING
+#define FEDERATED_STREAMING FEDERATED_CONF_STREAMING
+#else
+#define FEDERATED_STREAMING 0
+#endif
+
+// Delta synchronisation: between full snapshots only the entries that moved
+// more than FEDERATED_DELTA_TOLERANCE since they were last sent are broadcast.
+// Off with FEDERATED_STREAMING: a delta would fold only the changed entries
+// and leave the others without the neighbor's weight for the round, so
+// streaming nodes exchange full snapshots (and ask for one when a delta
+// arrives)
+#ifdef FEDERATED_CONF_DELTA_SYNC
+#define FEDERATED_DELTA_SYNC FEDERATED_CONF_DELTA_SYNC
+#else
+#define FEDERATED_DELTA_SYNC (!FEDERATED_STREAMING)
+#endif
+
+#if FEDERATED_STREAMING && FEDERATED_DELTA_SYNC
+#error "FEDERATED_CONF_STREAMING needs full snapshots (FEDERATED_CONF_DELTA_SYNC 0)"
+#endif
+
+#ifndef FEDERATED_DELTA_TOLERANCE
+#define FEDERATED_DELTA_TOLERANCE 0.5
+#endif
+
+// Every FEDERATED_FULL_INTERVAL-th broadcast is a full snapshot (late joiners,
+// lost deltas without a request)
+#ifndef FEDERATED_FULL_INTERVAL
+#define FEDERATED_FULL_INTERVAL 10
+#endif
+
+// Delta entry on the wire: uint16_t index + Q16.16 value, both little endian
+#define FED_DELTA_ENTRY_SIZE (2 + FED_WIRE_RAW_SIZE)
+
+// Bytes of the values of a full snapshot; a delta with more entries than fit
+// in the same space is replaced by a full snapshot
+#define FED_FULL_VALUES_LEN (Q_TABLE_SIZE * FED_WIRE_VALUE_SIZE(FEDERATED_QUANT_BITS))
+#define FED_DELTA_MAX_ENTRIES (FED_FULL_VALUES_LEN / FED_DELTA_ENTRY_SIZE)
+
+// Federated message types
 typedef enum {
-    FEDAVG,           // Federated Averaging (default)
-    FEDMEDIAN,        // Federated Median
-    WEIGHTED_FEDAVG   // Weighted Federated Averaging (based on node performance)
-} fed_aggregation_method_t;
+    FED_MSG_FULL,     // whole table, encoded with FEDERATED_QUANT_BITS
+    FED_MSG_DELTA,    // sparse (index, value) entries on top of base_version
+    FED_MSG_REQUEST,  // receiver missed a version, asks for a full snapshot
+    FED_MSG_PARTIAL,  // tree: subtree aggregate to the parent (full encoding,
+                      // num_samples of the whole subtree)
+    FED_MSG_GLOBAL    // tree: network-wide model from the root (full encoding,
+                      // version = aggregation round)
+} fed_message_type_t;
+
+// Trimmed mean: percentage of the values dropped at each end of every
+// Q-value position (at least one per end once three tables are present)
+#ifndef FEDERATED_TRIM_PERCENT
+#define FEDERATED_TRIM_PERCENT 20
+#endif
+
+// Staleness-weighted FedAvg (FEDSTALENESS): a neighbor's weight is its
+// sample count halved every FEDERATED_STALENESS_HALF_LIFE seconds since its
+// table was last updated (linear between halvings), so silent neighbors fade
+// out smoothly instead of at the cleanup_stale_neighbors() cutoff
+#ifndef FEDERATED_STALENESS_HALF_LIFE
+#define FEDERATED_STALENESS_HALF_LIFE FEDERATED_SYNC_INTERVAL
+#endif
+
+// Multi-Krum: number of faulty tables tolerated. Every table is scored by
+// its L1 distance to its n - f - 2 closest tables and the n - f best scored
+// ones are averaged; with fewer than f + 3 tables the median is used
+#ifndef FEDERATED_KRUM_F
+#define FEDERATED_KRUM_F 1
+#endif
+
+// Trickle dissemination (RFC 6206) instead of the fixed FEDERATED_SYNC_INTERVAL
+// timer: the broadcast interval doubles from FEDERATED_TRICKLE_IMIN seconds
+// (at most FEDERATED_TRICKLE_DOUBLINGS times) while the neighbors' tables
+// agree with ours, and a broadcast is suppressed once FEDERATED_TRICKLE_K
+// consistent tables were heard in the interval (0 never suppresses)
+#ifdef FEDERATED_CONF_TRICKLE
+#define FEDERATED_TRICKLE FEDERATED_CONF_TRICKLE
+#else
+#define FEDERATED_TRICKLE 0
+#endif
+
+#ifndef FEDERATED_TRICKLE_IMIN
+#define FEDERATED_TRICKLE_IMIN 60
+#endif
+
+#ifndef FEDERATED_TRICKLE_DOUBLINGS
+#define FEDERATED_TRICKLE_DOUBLINGS 3
+#endif
+
+#ifndef FEDERATED_TRICKLE_K
+#define FEDERATED_TRICKLE_K 2
+#endif
+
+// A neighbor's table is consistent when the action it prefers in every
+// state is within FEDERATED_TRICKLE_TOLERANCE of our best Q-value; the local
+// best action counts as changed once it beats the advertised one by as much
+#ifndef FEDERATED_TRICKLE_TOLERANCE
+#define FEDERATED_TRICKLE_TOLERANCE 0.5
+#endif
+
+// Hierarchical aggregation along the RPL DODAG: every FEDERATED_SYNC_INTERVAL
+// a node unicasts the sample-weighted aggregate of its own table and its
+// children's aggregates to its preferred parent; the root's aggregate is the
+// network-wide model, broadcast and forwarded down the tree by every node
+// that hears it from its parent
+#ifdef FEDERATED_CONF_TREE
+#define FEDERATED_TREE FEDERATED_CONF_TREE
+#else
+#define FEDERATED_TREE 0
+#endif
+
+#if FEDERATED_TREE && FEDERATED_STREAMING
+#error "FEDERATED_CONF_TREE needs the stored tables (FEDERATED_CONF_STREAMING 0)"
+#endif
+
+#if FEDERATED_TREE && FEDERATED_TRICKLE
+#error "FEDERATED_CONF_TREE and FEDERATED_CONF_TRICKLE are exclusive"
+#endif
+
+// Compact model summary piggybacked on every Enhanced Beacon (payload IE
+// written and parsed by tsch-slot-operation.c): a sync broadcasts the full
+// table only when a summary heard since the previous sync disagrees with the
+// local model, none was heard or FEDERATED_SUMMARY_MAX_SKIP syncs in a row
+// were skipped
+#ifdef FEDERATED_CONF_EB_SUMMARY
+#define FEDERATED_EB_SUMMARY FEDERATED_CONF_EB_SUMMARY
+#else
+#define FEDERATED_EB_SUMMARY 0
+#endif
+
+// A summary agrees when its best action is within FEDERATED_SUMMARY_TOLERANCE
+// of our best Q-value in its state and both best values are that close
+#ifndef FEDERATED_SUMMARY_TOLERANCE
+#define FEDERATED_SUMMARY_TOLERANCE 0.5
+#endif
+
+#ifndef FEDERATED_SUMMARY_MAX_SKIP
+#define FEDERATED_SUMMARY_MAX_SKIP 4
+#endif
+
+// Summary Q-values travel as int16 in 1 / FED_SUMMARY_VALUE_SCALE steps (a
+// power of two), converted through the Q16.16 wire value without floats
+#define FED_SUMMARY_VALUE_SCALE 4
+#define FED_SUMMARY_WIRE_STEP ((1L << FED_WIRE_FRAC_BITS) / FED_SUMMARY_VALUE_SCALE)
+
+// Model exchange in its own low-rate slotframe: node.c adds a slotframe with
+// a single shared cell, its packet-ready callback pins the federated
+// messages to that cell and the slot operation leaves the cell out of the
+// learner's measurements (project-conf.h enables the TSCH link selector)
+#ifdef FEDERATED_CONF_SLOTFRAME
+#define FEDERATED_SLOTFRAME FEDERATED_CONF_SLOTFRAME
+#else
+#define FEDERATED_SLOTFRAME 0
+#endif
+
+// The data slotframe has handle 0
+#ifndef FEDERATED_SLOTFRAME_HANDLE
+#define FEDERATED_SLOTFRAME_HANDLE 1
+#endif
+
+// queuebuf.c does not see this header, so project-conf.h passes it the
+// handle separately; both must name the same slotframe
+#if defined(QUEUEBUF_CONF_UNMEASURED_SLOTFRAME) && \
+    QUEUEBUF_CONF_UNMEASURED_SLOTFRAME != FEDERATED_SLOTFRAME_HANDLE
+#error "QUEUEBUF_CONF_UNMEASURED_SLOTFRAME must equal FEDERATED_SLOTFRAME_HANDLE"
+#endif
+
+// Prime, so the cell drifts over the data timeslots instead of always
+// taking the same one (it wins the overlap on every node)
+#ifndef FEDERATED_SLOTFRAME_LENGTH
+#define FEDERATED_SLOTFRAME_LENGTH 31
+#endif
+
+// Not 0: with a data slotframe of a multiple of the length above the cell
+// would always shadow the advertising cell
+#ifndef FEDERATED_SLOTFRAME_TIMESLOT
+#define FEDERATED_SLOTFRAME_TIMESLOT 1
+#endif
+
+#ifndef FEDERATED_SLOTFRAME_CHANNEL_OFFSET
+#define FEDERATED_SLOTFRAME_CHANNEL_OFFSET 1
+#endif
+
+#if FEDERATED_EB_SUMMARY && FEDERATED_TREE
+#error "FEDERATED_CONF_EB_SUMMARY only applies to the neighbor broadcasts (FEDERATED_CONF_TREE 0)"
+#endif
+
+// Largest Trickle interval, seconds
+#define FED_TRICKLE_IMAX ((uint32_t)FEDERATED_TRICKLE_IMIN << FEDERATED_TRICKLE_DOUBLINGS)
+
+// Per-state best actions carried in the message header, padded to a multiple
+// of 4 bytes so the values after them keep the 4-byte alignment of the
+// fixed header
+#define FED_BEST_ACTIONS_LEN ((Q_NUM_STATES + 3) & ~3)
+
+// Federated aggregation method. Macros rather than an enum so
+// FEDERATED_METHOD can be tested by #if
+typedef uint8_t fed_aggregation_method_t;
+#define FEDAVG 0              // Federated Averaging
+#define FEDMEDIAN 1           // Federated Median
+#define WEIGHTED_FEDAVG 2     // Weighted Federated Averaging (based on node performance)
+#define FEDTRIMMED 3          // Coordinate-wise trimmed mean
+#define FEDKRUM 4             // Multi-Krum: average of the tables closest to the others
+#define FEDSTALENESS 5        // Weighted FedAvg with weights decayed by the table's age
+
+// Method node.c starts the federated learning with
+#ifdef FEDERATED_CONF_METHOD
+#define FEDERATED_METHOD FEDERATED_CONF_METHOD
+#else
+#define FEDERATED_METHOD WEIGHTED_FEDAVG
+#endif
+
+#if FEDERATED_STREAMING && \
+    (FEDERATED_METHOD == FEDMEDIAN || FEDERATED_METHOD == FEDTRIMMED || FEDERATED_METHOD == FEDKRUM)
+#warning "FEDERATED_CONF_METHOD needs the stored tables, FEDERATED_CONF_STREAMING aggregates with FedAvg"
+#endif
 
 /********** Structures *********/
 
 // Structure to store Q-table from a neighbor node
 typedef struct {
     uint16_t node_id;                    // ID of the neighbor node
-    float q_values[Q_VALUE_LIST_SIZE];   // Q-table from neighbor
-    uint8_t num_samples;                  // Number of learning iterations (for weighting)
-    uint8_t is_active;                    // Whether this entry is valid/active
+#if !FEDERATED_STREAMING
+    q_value_t q_values[Q_TABLE_SIZE];      // Q-table from neighbor (all states)
+#endif
+    uint16_t num_samples;                 // Number of learning iterations (for weighting)
     uint32_t last_update_time;            // Timestamp of last update
+    uint32_t last_update_seq;             // Update order (LRU eviction)
+    uint16_t version;                     // Sender's table version held here
+    uint16_t checksum;                    // fed_table_checksum() of it, 0 = unknown
 } neighbor_q_table_t;
 
+// Offset and scale of a quantized Q-table, Q16.16 as on the wire
+typedef struct {
+    int32_t offset;                       // smallest value of the table (rounded down)
+    int32_t scale;                        // value of one code step (rounded up)
+} fed_quant_params_t;
+
+// Federated message (full snapshot, delta or request), sent with
+// FED_MESSAGE_LEN() bytes. Header fields are in the sender's byte order
+// (little endian on every supported platform)
+typedef struct {
+    fed_quant_params_t quant;             // full: offset/scale of the codes
+    uint16_t node_id;                     // sender
+    uint16_t count;                       // full: Q_TABLE_SIZE, delta: entries
+    uint16_t version;                     // sender's table version after this message
+    uint16_t base_version;                // delta: version the entries apply to
+    uint16_t num_samples;
+    uint16_t checksum;                    // full/delta: sender's table after this message
+    uint8_t type;                         // fed_message_type_t
+    uint8_t encoding;                     // full: 8 or 16 bit codes, 0 = raw Q16.16
+    uint8_t reserved[2];                  // keeps the values 4-byte aligned
+#if FEDERATED_TRICKLE
+    uint8_t best_actions[FED_BEST_ACTIONS_LEN];  // full/delta: sender's best action per state
+#endif
+    uint8_t values[FED_FULL_VALUES_LEN];
+} fed_message_t;
+
+_Static_assert(offsetof(fed_message_t, values) % 4 == 0,
+               "fed_message_t values must be 4-byte aligned");
+
+#define FED_MESSAGE_HEADER_LEN offsetof(fed_message_t, values)
+#define FED_MESSAGE_LEN_FULL(encoding) (FED_MESSAGE_HEADER_LEN + Q_TABLE_SIZE * FED_WIRE_VALUE_SIZE(encoding))
+#define FED_MESSAGE_LEN_DELTA(entries) (FED_MESSAGE_HEADER_LEN + (entries) * FED_DELTA_ENTRY_SIZE)
+
+// Model summary carried in Enhanced Beacons
+typedef struct {
+    uint16_t node_id;                     // sender
+    uint16_t version;                     // version of the sender's last table broadcast
+    int16_t best_value;                   // Q-value of best_action (FED_SUMMARY_VALUE_SCALE)
+    uint8_t state;                        // sender's current state
+    uint8_t best_action;                  // sender's best action in that state
+} fed_summary_t;
+
+// Trickle timer outcome, see fed_trickle_expired()
+typedef enum {
+    FED_TRICKLE_WAIT,         // interval ended, a new one started
+    FED_TRICKLE_TRANSMIT,     // transmission point: broadcast the table
+    FED_TRICKLE_SUPPRESS      // transmission point, enough consistent tables heard
+} fed_trickle_event_t;
+
+// Trickle timer state (one per node, owned by the sync process)
+typedef struct {
+    uint32_t interval_start;              // clock_seconds() when the interval began
+    uint32_t interval;                    // I, seconds
+    uint32_t tx_offset;                   // t, transmission point in [I/2, I)
+    uint8_t counter;                      // consistent tables heard this interval (c)
+    uint8_t tx_passed;                    // transmission point of this interval reached
+    uint8_t best_actions[Q_NUM_STATES];   // local best actions last advertised
+    uint16_t transmissions;
+    uint16_t suppressions;
+    uint16_t resets;                      // intervals cut back to FEDERATED_TRICKLE_IMIN
+} fed_trickle_t;
+
 // Global federated learning state
 typedef struct {
-    neighbor_q_table_t neighbors[MAX_FEDERATED_NEIGHBORS];  // Q-tables from neighbors
+    neighbor_q_table_t neighbors[MAX_FEDERATED_NEIGHBORS];  // Active entries packed in
+                                                             // [0, num_active_neighbors)
     uint8_t num_active_neighbors;                            // Number of active neighbors
-    uint8_t local_num_samples;                               // Local learning iterations count
+    uint8_t neighbor_index[FED_NEIGHBOR_INDEX_SIZE];         // node ID hash -> entry + 1, 0 = free
+    uint32_t update_seq;                                     // Updates stored so far
+    uint16_t evictions;                                      // Neighbors replaced when full
+#if FEDERATED_STREAMING
+    q_accum_t running_sum[Q_TABLE_SIZE];                     // Sum of weight * value this round
+    uint32_t running_weight[Q_TABLE_SIZE];                   // Sum of weights this round
+    uint8_t round_folded[(MAX_FEDERATED_NEIGHBORS + 7) / 8];  // Entries folded this round, bit per entry
+    uint8_t round_neighbors;                                 // Neighbors folded this round
+#endif
+    uint16_t local_num_samples;                              // Local learning iterations count
     fed_aggregation_method_t aggregation_method;             // Aggregation method to use
-    float aggregation_weight;                                 // Weight for local model (0-1)
+    q_value_t aggregation_weight;                             // Weight for local model (0-Q_ONE)
+    uint16_t local_version;                                  // Version of the last broadcast
+    uint8_t broadcasts_since_full;                           // Deltas sent since the last full
+    uint8_t full_requested;                                  // A neighbor asked for a full table
+    q_value_t sent_q_values[Q_TABLE_SIZE];                   // Values as last broadcast
+    uint16_t global_version;                                 // Tree: last network-wide model
+                                                             // sent (root) or applied
+    fed_summary_t summary;                                   // Local summary for the EBs
+    uint8_t summaries_agreed;                                // EB summaries heard since the
+    uint8_t summaries_disagreed;                             // last sync decision
+    uint8_t syncs_skipped;                                   // Broadcasts skipped in a row
+    uint8_t tables_changed;                                  // Stored tables changed since
+                                                             // the last aggregation
+    uint16_t duplicates_skipped;                             // Unchanged tables not stored
+    uint16_t aggregations_skipped;                           // Aggregations with nothing new
 } federated_state_t;
 
 /********** Functions *********/
@@ -61,9 +414,216 @@ void federated_learning_init(fed_aggregation_method_t method);
 
 /**
  * Store or update Q-table from a neighbor node
+ * With the table full a new node replaces an entry chosen by
+ * FEDERATED_EVICTION. With FEDERATED_STREAMING the table is folded into the
+ * running sums of the next aggregation instead of being stored
+ * Returns 1 on success, 0 on failure
+ */
+uint8_t store_neighbor_q_table(uint16_t node_id, const q_value_t *q_values, uint16_t num_samples);
+
+/**
+ * Store or update a Q-table received on the wire from a neighbor node
+ * (bits = 8 or 16 for codes as written by fed_quantize(), 0 for raw Q16.16
+ * values, params unused), decoded straight into its entry
  * Returns 1 on success, 0 on failure
  */
-uint8_t store_neighbor_q_table(uint16_t node_id, float *q_values, uint8_t num_samples);
+uint8_t store_neighbor_q_table_quantized(uint16_t node_id, const uint8_t *codes, uint8_t bits,
+                                         const fed_quant_params_t *params, uint16_t num_samples);
+
+/**
+ * Apply a delta from a neighbor (count entries written by fed_delta_encode())
+ * Returns 1 when applied, 0 on a version gap or unknown neighbor (always
+ * with FEDERATED_STREAMING), in which case the receiver should request a
+ * full snapshot
+ */
+uint8_t store_neighbor_q_delta(uint16_t node_id, uint16_t base_version, uint16_t version,
+                               const uint8_t *entries, uint16_t count, uint16_t num_samples);
+
+/**
+ * Table held for a neighbor, NULL if unknown (always NULL with
+ * FEDERATED_STREAMING, tables are not kept)
+ */
+const q_value_t *get_neighbor_q_table(uint16_t node_id);
+
+/**
+ * Record the table version held for a neighbor (after a full snapshot)
+ */
+void set_neighbor_table_version(uint16_t node_id, uint16_t version);
+
+/**
+ * Checksum identifying the contents of a Q-table (Fletcher-16, never 0)
+ */
+uint16_t fed_table_checksum(const q_value_t *q_values);
+
+/**
+ * Record the checksum of the table held for a neighbor
+ */
+void set_neighbor_table_checksum(uint16_t node_id, uint16_t checksum);
+
+/**
+ * Whether a full table announced with this checksum is the one already held
+ * for the neighbor; if so its version, sample count and age are refreshed
+ * and the table need not be stored again. Always 0 in streaming mode, where
+ * every round folds the tables in again
+ */
+uint8_t fed_neighbor_unchanged(uint16_t node_id, uint16_t version, uint16_t checksum,
+                               uint16_t num_samples);
+
+/**
+ * Receptions not stored and aggregations skipped because nothing changed
+ */
+void get_dedup_stats(uint16_t *duplicates, uint16_t *aggregations);
+
+/**
+ * Encode the entries of q_values that differ from shadow by more than
+ * tolerance and update shadow for them
+ * Returns the number of changed entries; when it exceeds max_entries nothing
+ * is written nor updated and a full snapshot should be sent instead
+ */
+uint16_t fed_delta_encode(const q_value_t *q_values, q_value_t *shadow, q_value_t tolerance,
+                          uint8_t *entries, uint16_t max_entries);
+
+/**
+ * Prepare the next broadcast of the local table in msg (header and values)
+ * Sends a delta against the values last broadcast, or a full snapshot when
+ * one was requested, is periodically due or the delta would be larger
+ * Returns the message length
+ */
+uint16_t fed_prepare_broadcast(fed_message_t *msg, uint16_t node_id);
+
+/**
+ * A neighbor reported a version gap, the next broadcast is a full snapshot
+ */
+void fed_request_full(void);
+
+/**
+ * Sample-weighted average of the local table and the stored neighbor tables
+ * (in tree mode the children's subtree aggregates) into out; entries the
+ * local node never visited get no local weight
+ * Returns the samples behind the aggregate (saturates at UINT16_MAX)
+ */
+uint16_t fed_subtree_aggregate(q_value_t *out);
+
+/**
+ * Prepare the subtree aggregate for the preferred parent in msg
+ * (FED_MSG_PARTIAL). Returns the message length
+ */
+uint16_t fed_prepare_partial(fed_message_t *msg, uint16_t node_id);
+
+/**
+ * Root: aggregate the network-wide model, adopt it as the local table and
+ * prepare its broadcast in msg (FED_MSG_GLOBAL). Returns the message length
+ */
+uint16_t fed_prepare_global(fed_message_t *msg, uint16_t node_id);
+
+/**
+ * Adopt a network-wide model received from the parent: header of msg, the
+ * values encoded in values (length checked by the caller, no alignment
+ * needed). Returns 1 when it is new and should be forwarded down,
+ * 0 for a model already applied or a malformed encoding
+ */
+uint8_t fed_apply_global_model(const fed_message_t *msg, const uint8_t *values);
+
+/**
+ * Turn msg, the header of a network model just adopted, into its
+ * forwarding to the children: the received values when they have the
+ * local encoding, otherwise the adopted table encoded with
+ * FEDERATED_QUANT_BITS (msg has no room for a wider encoding)
+ * Returns the message length
+ */
+uint16_t fed_prepare_forward(fed_message_t *msg, const uint8_t *values, uint16_t node_id);
+
+/**
+ * Refresh the local model summary advertised in the EBs (call after
+ * learning updates and aggregations)
+ */
+void fed_update_summary(uint16_t node_id, uint8_t state);
+
+/**
+ * Copy the local model summary (read by the slot operation when sending an
+ * EB; safe from interrupt context)
+ */
+void fed_get_summary(fed_summary_t *summary);
+
+/**
+ * A neighbor's EB summary: counts whether it agrees with the local model,
+ * and keeps the neighbor's stored table fresh when the summary advertises
+ * the version held
+ */
+void fed_summary_heard(const fed_summary_t *summary);
+
+/**
+ * Whether the next sync should broadcast the full table (see
+ * FEDERATED_EB_SUMMARY); starts counting summaries for the following sync
+ */
+uint8_t fed_summary_broadcast_needed(void);
+
+/**
+ * Best action of every state of the local table (Q_NUM_STATES entries)
+ */
+void fed_best_actions(uint8_t *best_actions);
+
+/**
+ * Start a Trickle timer at FEDERATED_TRICKLE_IMIN, remembering the current
+ * local best actions
+ */
+void fed_trickle_init(fed_trickle_t *t);
+
+/**
+ * clock_seconds() value of the timer's next event (transmission point or
+ * end of the interval)
+ */
+uint32_t fed_trickle_next_event(const fed_trickle_t *t);
+
+/**
+ * Handle the event returned by fed_trickle_next_event() once it is due:
+ * the transmission point (TRANSMIT, or SUPPRESS when FEDERATED_TRICKLE_K
+ * consistent tables were heard) or the end of the interval, which doubles it
+ */
+fed_trickle_event_t fed_trickle_expired(fed_trickle_t *t);
+
+/**
+ * A neighbor advertised best_actions (Q_NUM_STATES entries): counts it when
+ * consistent with the local table, resets the interval otherwise
+ * Returns 1 when the interval was reset and the next event moved earlier
+ */
+uint8_t fed_trickle_heard(fed_trickle_t *t, const uint8_t *best_actions);
+
+/**
+ * Reset the interval when a local best action improved on the advertised
+ * one by more than FEDERATED_TRICKLE_TOLERANCE (call after learning updates)
+ * Returns 1 when the interval was reset
+ */
+uint8_t fed_trickle_check_local(fed_trickle_t *t);
+
+/**
+ * Q16.16 wire representation of a Q-value and back (float builds round to
+ * the nearest 2^-16, saturating)
+ */
+int32_t fed_to_wire(q_value_t value);
+q_value_t fed_from_wire(int32_t value);
+
+/**
+ * Quantize count Q-values into 8 or 16 bit codes (16 bit codes little endian),
+ * or with bits = 0 write them as raw Q16.16 values
+ * Fills params and returns the largest absolute reconstruction error
+ */
+q_value_t fed_quantize(const q_value_t *q_values, uint16_t count, uint8_t bits,
+                       fed_quant_params_t *params, uint8_t *codes);
+
+/**
+ * Reconstruct count Q-values from codes written by fed_quantize(), or with
+ * bits = 0 from raw Q16.16 values (params unused)
+ */
+void fed_dequantize(const uint8_t *codes, uint16_t count, uint8_t bits,
+                    const fed_quant_params_t *params, q_value_t *q_values);
+
+/**
+ * Median of count Q-values (mean of the two middle ones for an even count)
+ * Reorders values in place: median networks up to 7 values, quickselect
+ * above
+ */
+q_value_t fed_median(q_value_t *values, uint8_t count);
 
 /**
  * Aggregate Q-tables from neighbors using FedAvg (Federated Averaging)
@@ -80,11 +640,35 @@ uint8_t federated_aggregate_fedavg(void);
 uint8_t federated_aggregate_weighted(void);
 
 /**
- * Aggregate Q-tables using median value
+ * Aggregate Q-tables using median value (FedAvg with FEDERATED_STREAMING)
  * Returns the number of neighbors included in aggregation
  */
 uint8_t federated_aggregate_median(void);
 
+/**
+ * Aggregate Q-tables using the coordinate-wise trimmed mean: the
+ * FEDERATED_TRIM_PERCENT smallest and largest values of every position are
+ * dropped before averaging (FedAvg with FEDERATED_STREAMING)
+ * Returns the number of neighbors included in aggregation
+ */
+uint8_t federated_aggregate_trimmed(void);
+
+/**
+ * Aggregate Q-tables using Multi-Krum: tables far from the others (broken
+ * radio, freshly randomized after a reboot) are rejected as a whole and the
+ * rest averaged. The local table is a candidate like any neighbor's
+ * (FedAvg with FEDERATED_STREAMING)
+ * Returns the number of neighbor tables included in aggregation
+ */
+uint8_t federated_aggregate_krum(void);
+
+/**
+ * Aggregate Q-tables using sample-weighted averaging with each neighbor's
+ * weight decayed by the age of its table (FEDERATED_STALENESS_HALF_LIFE)
+ * Returns the number of neighbors with a non-zero weight
+ */
+uint8_t federated_aggregate_staleness(void);
+
 /**
  * Main federated aggregation function
  * Returns the number of neighbors included in aggregation
@@ -95,17 +679,22 @@ uint8_t federated_aggregate(void);
  * Get the local Q-table to send to neighbors
  * Returns pointer to local Q-table
  */
-float* get_local_q_table_for_sharing(void);
+const q_value_t* get_local_q_table_for_sharing(void);
 
 /**
- * Increment local sample count
+ * Increment local sample count (saturates at UINT16_MAX)
  */
 void increment_local_samples(void);
 
 /**
  * Get current local sample count
  */
-uint8_t get_local_sample_count(void);
+uint16_t get_local_sample_count(void);
+
+/**
+ * Set local sample count (checkpoint warm start)
+ */
+void set_local_sample_count(uint16_t samples);
 
 /**
  * Clean up stale neighbor entries
@@ -116,18 +705,29 @@ void cleanup_stale_neighbors(uint32_t timeout_seconds);
 /**
  * Get federated learning statistics
  */
-void get_federated_stats(uint8_t *num_neighbors, uint8_t *local_samples, 
+void get_federated_stats(uint8_t *num_neighbors, uint16_t *local_samples, 
                          fed_aggregation_method_t *method);
 
+/**
+ * Number of neighbors replaced because the table was full
+ */
+uint16_t get_neighbor_evictions(void);
+
+/**
+ * Federated state of this node (lets a host simulation run several nodes
+ * through the module by swapping it)
+ */
+federated_state_t *get_federated_state(void);
+
 /**
  * Set aggregation method
  */
 void set_aggregation_method(fed_aggregation_method_t method);
 
 /**
- * Set local model weight for aggregation (0.0 to 1.0)
+ * Set local model weight for aggregation (0 to Q_ONE)
  * Higher weight = trust local model more
  */
-void set_local_model_weight(float weight);
+void set_local_model_weight(q_value_t weight);
 
 #endif /* FEDERATED_LEARNING_HEADER */
\ No newline at end of file
@@ -8,24 +8,57 @@
 
 /********** global variables ***********/
 // parameters to calculate the reward (TSCH-based)
-float theta1 = 3.0;           // weight for successful transmissions
-float theta2 = 0.5;           // weight for buffer management
-float theta3 = 2.0;           // weight for retransmission penalty
-float theta4 = 0.5;           // weight for conflicts
-float conflict_penalty = 100.0; // penalty per conflict detected
+q_value_t theta1 = Q_FROM_FLOAT(3.0);           // weight for successful transmissions
+q_value_t theta2 = Q_FROM_FLOAT(0.5);           // weight for buffer management
+q_value_t theta3 = Q_FROM_FLOAT(2.0);           // weight for retransmission penalty
+q_value_t theta4 = Q_FROM_FLOAT(0.5);           // weight for conflicts
+q_value_t conflict_penalty = Q_FROM_FLOAT(100.0); // penalty per conflict detected
 
 // Maximum buffer difference
 #define MAX_BUFFER_PENALTY 20
 
 // Q-value updating paramaters
-float learning_rate = 0.1;
-float discount_factor = 0.9;
+q_value_t learning_rate = Q_FROM_FLOAT(0.1);
+q_value_t discount_factor = Q_FROM_FLOAT(0.9);
 
-// default state varibale
-env_state *current_state;
+// step-size schedule (enum q_step_size_schedule)
+static uint8_t step_size_schedule = Q_LEARNING_STEP_SIZE;
 
-// Q-table to store q-values, 2 index means -> action is 3, first three slots are active
-float q_list[Q_VALUE_LIST_SIZE];
+// number of updates of each (state, action) pair and of each state (UCB1's N)
+static uint16_t q_visits[Q_NUM_STATES][Q_VALUE_LIST_SIZE];
+static uint32_t state_visits[Q_NUM_STATES];
+
+// exploration policy (enum q_exploration_policy) and its parameter
+static uint8_t exploration_policy = Q_LEARNING_POLICY;
+static q_value_t exploration = Q_FROM_FLOAT(Q_EPSILON_INITIAL);
+static uint8_t exploration_set;  // exploration holds a value for exploration_policy
+
+// current state and the state in which the last action was taken
+static env_state current_state;
+static uint8_t previous_state_index = 0;
+
+// Q-table to store q-values, one row of actions per state
+// 2 index means -> action is 3, first three slots are active
+q_value_t q_list[Q_NUM_STATES][Q_VALUE_LIST_SIZE];
+
+// cached index of the highest q-value per state, maintained by set_q_value()
+static uint8_t best_q_index[Q_NUM_STATES];
+// set when the cached maximum of a state was decreased and must be re-scanned
+static uint8_t best_q_stale[Q_NUM_STATES];
+
+#if Q_LEARNING_HIERARCHICAL
+// coarse Q-table, one value per bin of Q_COARSE_BIN_WIDTH actions
+static q_value_t q_coarse[Q_NUM_STATES][Q_COARSE_BINS];
+// search phase, bin being refined, stability counter of the best bin and
+// cycles spent in the fine phase, per state
+static uint8_t search_phase[Q_NUM_STATES];
+static uint8_t refine_bin[Q_NUM_STATES];
+static uint8_t stable_cycles[Q_NUM_STATES];
+static uint8_t fine_cycles[Q_NUM_STATES];
+// bins / actions of the refined bin not tried yet, swept once before going greedy
+static uint32_t untried_bins[Q_NUM_STATES];
+static uint32_t untried_fine[Q_NUM_STATES];
+#endif /* Q_LEARNING_HIERARCHICAL */
 
 // Structure to track link allocations
 typedef struct {
@@ -34,6 +67,143 @@ typedef struct {
     uint8_t count;
 } link_allocation_t;
 
+/********** Helper Functions *********/
+
+/**
+ * Uniform random value in [0, 1) in the Q-value representation
+ * random_rand() yields 16 random bits (RANDOM_RAND_MAX = 0xffff), which in
+ * fixed-point mode are shifted straight into the fractional part
+ */
+static q_value_t random_unit(void) {
+#if Q_LEARNING_FIXED_POINT
+#if Q_FIXED_FRAC_BITS >= 16
+    return (q_value_t)random_rand() << (Q_FIXED_FRAC_BITS - 16);
+#else
+    return (q_value_t)(random_rand() >> (16 - Q_FIXED_FRAC_BITS));
+#endif
+#else
+    return (float)random_rand() / RANDOM_RAND_MAX;
+#endif /* Q_LEARNING_FIXED_POINT */
+}
+
+// n^-0.6 for n = 1..32, larger counts are halved down into the table
+// (each halving is a factor 2^-0.6)
+#define POLY_LUT_SIZE 32
+static const q_value_t poly_lut[POLY_LUT_SIZE] = {
+    Q_FROM_FLOAT(1.000000), Q_FROM_FLOAT(0.659754), Q_FROM_FLOAT(0.517282), Q_FROM_FLOAT(0.435275),
+    Q_FROM_FLOAT(0.380731), Q_FROM_FLOAT(0.341279), Q_FROM_FLOAT(0.311129), Q_FROM_FLOAT(0.287175),
+    Q_FROM_FLOAT(0.267581), Q_FROM_FLOAT(0.251189), Q_FROM_FLOAT(0.237227), Q_FROM_FLOAT(0.225160),
+    Q_FROM_FLOAT(0.214602), Q_FROM_FLOAT(0.205269), Q_FROM_FLOAT(0.196945), Q_FROM_FLOAT(0.189465),
+    Q_FROM_FLOAT(0.182697), Q_FROM_FLOAT(0.176537), Q_FROM_FLOAT(0.170902), Q_FROM_FLOAT(0.165723),
+    Q_FROM_FLOAT(0.160942), Q_FROM_FLOAT(0.156512), Q_FROM_FLOAT(0.152392), Q_FROM_FLOAT(0.148550),
+    Q_FROM_FLOAT(0.144956), Q_FROM_FLOAT(0.141585), Q_FROM_FLOAT(0.138415), Q_FROM_FLOAT(0.135427),
+    Q_FROM_FLOAT(0.132605), Q_FROM_FLOAT(0.129935), Q_FROM_FLOAT(0.127404), Q_FROM_FLOAT(0.125000)
+};
+
+static q_value_t poly_step(uint16_t n) {
+    q_value_t value;
+    uint8_t halvings = 0;
+    while (n > POLY_LUT_SIZE) {
+        n >>= 1;
+        halvings++;
+    }
+    value = poly_lut[n - 1];
+    while (halvings--) {
+        value = Q_MUL(value, Q_FROM_FLOAT(0.659754));
+    }
+    return value;
+}
+
+/**
+ * e^x for x <= 0, without FPU: e^x = 2^-y with y = -x * log2(e), split into
+ * an integer shift and 2^-f ~ 1 - 0.6699 f + 0.1699 f^2 (error < 0.3%)
+ */
+static q_value_t exp_neg(q_value_t x) {
+    q_value_t y = Q_MUL(-x, Q_FROM_FLOAT(1.442695));
+    uint8_t shift = 0;
+    
+    if (y >= Q_FROM_INT(16)) {
+        return 0;  // below 2^-16, the fixed-point resolution
+    }
+    while (y >= Q_ONE) {
+        y -= Q_ONE;
+        shift++;
+    }
+    q_value_t p = Q_ONE - Q_MUL(y, Q_FROM_FLOAT(0.6699) - Q_MUL(y, Q_FROM_FLOAT(0.1699)));
+    return p / ((int32_t)1 << shift);
+}
+
+/**
+ * ln(n) for n >= 1: log2 from the position of the highest bit plus
+ * log2(1 + f) ~ 1.3466 f - 0.3466 f^2 for the mantissa (error < 0.008)
+ */
+static q_value_t ln_int(uint32_t n) {
+    uint8_t msb = 0;
+    while ((n >> msb) > 1) {
+        msb++;
+    }
+    q_value_t f = Q_FROM_RATIO(n - ((uint32_t)1 << msb), (uint32_t)1 << msb);
+    q_value_t log2 = Q_FROM_INT(msb) + Q_MUL(f, Q_FROM_FLOAT(1.3466) - Q_MUL(f, Q_FROM_FLOAT(0.3466)));
+    return Q_MUL(log2, Q_FROM_FLOAT(0.693147));
+}
+
+/**
+ * Square root of a non-negative value (Newton iterations)
+ */
+static q_value_t sqrt_q(q_value_t x) {
+    if (x <= 0) return 0;
+    q_value_t r = x > Q_ONE ? x / 2 : Q_ONE;
+    for (uint8_t i = 0; i < 8; i++) {
+        r = (r + Q_DIV(x, r)) / 2;
+    }
+    return r;
+}
+
+#if Q_LEARNING_HIERARCHICAL
+#if Q_COARSE_BINS > 31 || Q_COARSE_BIN_WIDTH > 31
+#error "Hierarchical search tracks bins and actions per bin in 32-bit masks"
+#endif
+#if Q_COARSE_RESURVEY_CYCLES > 255
+#error "Q_COARSE_RESURVEY_CYCLES is counted in 8 bits"
+#endif
+
+/**
+ * Index of the lowest set bit of a non-zero mask
+ */
+static uint8_t lowest_bit(uint32_t mask) {
+    uint8_t i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Number of actions in a coarse bin (the last bin may be narrower)
+ */
+static uint8_t bin_width(uint8_t bin) {
+    uint8_t first = bin * Q_COARSE_BIN_WIDTH;
+    if (first + Q_COARSE_BIN_WIDTH > Q_VALUE_LIST_SIZE) {
+        return Q_VALUE_LIST_SIZE - first;
+    }
+    return Q_COARSE_BIN_WIDTH;
+}
+
+/**
+ * Bin with the highest coarse q-value in a state
+ */
+static uint8_t best_coarse_bin(uint8_t state) {
+    uint8_t best = 0;
+    for (uint8_t b = 1; b < Q_COARSE_BINS; b++) {
+        if (q_coarse[state][b] > q_coarse[state][best]) {
+            best = b;
+        }
+    }
+    return best;
+}
+#endif /* Q_LEARNING_HIERARCHICAL */
+
 /********** TSCH Reward Functions *********/
 
 /**
@@ -45,24 +215,24 @@ typedef struct {
  * - n_rx: number of successful receptions
  * - n_buff_prev: buffer size before scheduling period
  * - n_buff_new: buffer size after scheduling period
- * - avg_retrans: average number of retransmissions per packet (1.0 = no retrans)
+ * - avg_retrans: average number of retransmissions per packet (Q_ONE = no retrans)
  * 
  * Returns: reward value (throughput - buffer penalties - retransmission cost)
  */
-float tsch_reward_function(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev, 
-                          uint8_t n_buff_new, float avg_retrans) {
-    float throughput = theta1 * (n_tx + n_rx);
+q_value_t tsch_reward_function(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev, 
+                              uint8_t n_buff_new, q_value_t avg_retrans) {
+    q_value_t throughput = theta1 * (n_tx + n_rx);
     
     // Calculate buffer difference
     int buffer_diff = (int)n_buff_prev - (int)n_buff_new;
     if (buffer_diff < 0) buffer_diff = 0;  // no penalty if buffer increased
     if (buffer_diff > MAX_BUFFER_PENALTY) buffer_diff = MAX_BUFFER_PENALTY;  // cap penalty
     
-    float buffer_penalty = theta2 * buffer_diff;
+    q_value_t buffer_penalty = theta2 * buffer_diff;
     
-    float retrans_penalty = 0.0;
-    if (avg_retrans > 1.0) {
-        retrans_penalty = theta3 * (avg_retrans - 1.0);
+    q_value_t retrans_penalty = 0;
+    if (avg_retrans > Q_ONE) {
+        retrans_penalty = Q_MUL(theta3, avg_retrans - Q_ONE);
     }
     
     return throughput - buffer_penalty - retrans_penalty;
@@ -71,19 +241,37 @@ float tsch_reward_function(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev,
 /**
  * Legacy reward function
  */
-float reward(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev, uint8_t n_buff_new) {
+q_value_t reward(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev, uint8_t n_buff_new) {
     return (theta1 * (n_tx + n_rx) - theta2 * (n_buff_prev - n_buff_new));
 }
 
-// Function to find the action with highest q-value, returns the index of max value
-uint8_t get_highest_q_val(void) {
-    int max_val_index = 0;
-    for (int i = 1; i < Q_VALUE_LIST_SIZE; i++) {
-        if (q_list[i] > q_list[max_val_index]) {
-            max_val_index = i;
+// Function to find the action with highest q-value in a state
+// The index is cached; the full scan only runs after the maximum was decreased
+uint8_t get_highest_q_val_in_state(uint8_t state) {
+    if (state >= Q_NUM_STATES) return 0;
+    
+    if (best_q_stale[state]) {
+        const q_value_t *row = q_list[state];
+        int max_val_index = 0;
+        for (int i = 1; i < Q_VALUE_LIST_SIZE; i++) {
+            if (row[i] > row[max_val_index]) {
+                max_val_index = i;
+            }
         }
+        best_q_index[state] = max_val_index;
+        best_q_stale[state] = 0;
     }
-    return max_val_index;
+    return best_q_index[state];
+}
+
+// Function to find the action with highest q-value, returns the index of max value
+uint8_t get_highest_q_val(void) {
+    return get_highest_q_val_in_state(current_state.index);
+}
+
+// Function to return the highest q-value of the current state
+q_value_t get_highest_q_value(void) {
+    return q_list[current_state.index][get_highest_q_val()];
 }
 
 /**
@@ -91,17 +279,52 @@ uint8_t get_highest_q_val(void) {
  * Balances exploration (random actions) and exploitation (best known action)
  * 
  * Parameters:
- * - epsilon: probability of random exploration (0.0 to 1.0)
+ * - epsilon: probability of random exploration (0 to Q_ONE)
  *   - epsilon = 0.0: pure exploitation (always choose best action)
  *   - epsilon = 1.0: pure exploration (always random)
  *   - typical: 0.1 to 0.3 for good balance
  * 
  * Returns: selected action index
  */
-uint8_t get_action_epsilon_greedy(float epsilon) {
+uint8_t get_action_epsilon_greedy(q_value_t epsilon) {
     // Generate random number between 0 and 1
-    float random_val = (float)random_rand() / RANDOM_RAND_MAX;
+    q_value_t random_val = random_unit();
     
+#if Q_LEARNING_HIERARCHICAL
+    uint8_t state = current_state.index;
+    
+    if (search_phase[state] == Q_SEARCH_COARSE) {
+        // Coarse phase: pick a bin (each bin is tried once first), act with
+        // the slotframe size at its centre
+        uint8_t bin;
+        if (untried_bins[state]) {
+            bin = lowest_bit(untried_bins[state]);
+        } else {
+            bin = random_val < epsilon ? random_rand() % Q_COARSE_BINS : best_coarse_bin(state);
+        }
+        uint8_t action = bin * Q_COARSE_BIN_WIDTH + Q_COARSE_BIN_WIDTH / 2;
+        return action < Q_VALUE_LIST_SIZE ? action : Q_VALUE_LIST_SIZE - 1;
+    }
+    
+    // Fine phase: epsilon-greedy restricted to the winning bin, after each
+    // of its actions was tried once
+    uint8_t first = refine_bin[state] * Q_COARSE_BIN_WIDTH;
+    uint8_t width = bin_width(refine_bin[state]);
+    
+    if (untried_fine[state]) {
+        return first + lowest_bit(untried_fine[state]);
+    }
+    if (random_val < epsilon) {
+        return first + random_rand() % width;
+    }
+    uint8_t best = first;
+    for (uint8_t a = first + 1; a < first + width; a++) {
+        if (q_list[state][a] > q_list[state][best]) {
+            best = a;
+        }
+    }
+    return best;
+#else
     if (random_val < epsilon) {
         // Exploration: choose random action
         return random_rand() % Q_VALUE_LIST_SIZE;
@@ -109,29 +332,426 @@ uint8_t get_action_epsilon_greedy(float epsilon) {
         // Exploitation: choose best known action
         return get_highest_q_val();
     }
+#endif /* Q_LEARNING_HIERARCHICAL */
+}
+
+/**
+ * UCB1: actions never updated in the current state are tried first (lowest
+ * index first), then the action maximising Q + c * sqrt(ln N / n)
+ */
+static uint8_t get_action_ucb1(void) {
+    uint8_t state = current_state.index;
+    const q_value_t *row = q_list[state];
+    const uint16_t *visits = q_visits[state];
+    
+    for (uint8_t a = 0; a < Q_VALUE_LIST_SIZE; a++) {
+        if (visits[a] == 0) {
+            return a;
+        }
+    }
+    
+    q_value_t log_n = ln_int(state_visits[state]);
+    uint8_t best = 0;
+    q_value_t best_score = 0;
+    for (uint8_t a = 0; a < Q_VALUE_LIST_SIZE; a++) {
+        q_value_t score = row[a] + Q_MUL(exploration, sqrt_q(log_n / visits[a]));
+        if (a == 0 || score > best_score) {
+            best = a;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+/**
+ * Softmax weight e^((Q - max Q) / temperature) of one action
+ */
+static q_value_t softmax_weight(q_value_t q, q_value_t max_q) {
+    q_value_t diff = q - max_q;
+    if (diff < -Q_MUL(exploration, Q_FROM_INT(12))) {
+        return 0;  // e^-12 is below the fixed-point resolution
+    }
+    return exp_neg(Q_DIV(diff, exploration));
+}
+
+/**
+ * Softmax: sample an action with probability proportional to its weight
+ * (two passes instead of a weight array, the row is recomputed)
+ */
+static uint8_t get_action_softmax(void) {
+    const q_value_t *row = q_list[current_state.index];
+    q_value_t max_q = row[get_highest_q_val()];
+    q_accum_t total = 0;
+    
+    for (uint8_t a = 0; a < Q_VALUE_LIST_SIZE; a++) {
+        total += softmax_weight(row[a], max_q);
+    }
+    
+    // the best action has weight Q_ONE, so total >= Q_ONE
+    q_accum_t pick = Q_MUL(random_unit(), (q_value_t)total);
+    for (uint8_t a = 0; a < Q_VALUE_LIST_SIZE; a++) {
+        q_value_t weight = softmax_weight(row[a], max_q);
+        if (pick < weight) {
+            return a;
+        }
+        pick -= weight;
+    }
+    return get_highest_q_val();
+}
+
+/**
+ * Select the next action with the active exploration policy
+ */
+uint8_t select_action(void) {
+    if (!exploration_set) {
+        set_exploration_policy(exploration_policy);
+    }
+    
+    switch (exploration_policy) {
+        case Q_POLICY_UCB1:
+            return get_action_ucb1();
+        case Q_POLICY_SOFTMAX:
+            return get_action_softmax();
+        case Q_POLICY_EPSILON_GREEDY:
+        default:
+            return get_action_epsilon_greedy(exploration);
+    }
+}
+
+/**
+ * Select the exploration policy and reset its parameter
+ * The hierarchical search sweeps its bins itself and only runs with epsilon-greedy
+ */
+void set_exploration_policy(uint8_t policy) {
+#if Q_LEARNING_HIERARCHICAL
+    policy = Q_POLICY_EPSILON_GREEDY;
+#endif
+    switch (policy) {
+        case Q_POLICY_UCB1:
+            exploration = Q_FROM_FLOAT(Q_UCB_C);
+            break;
+        case Q_POLICY_SOFTMAX:
+            exploration = Q_FROM_FLOAT(Q_SOFTMAX_TEMP_INITIAL);
+            break;
+        case Q_POLICY_EPSILON_GREEDY:
+            exploration = Q_FROM_FLOAT(Q_EPSILON_INITIAL);
+            break;
+        default:
+            return;
+    }
+    exploration_policy = policy;
+    exploration_set = 1;
+}
+
+// Current exploration policy
+uint8_t get_exploration_policy(void) {
+    return exploration_policy;
+}
+
+// Printable name of an exploration policy
+const char *get_exploration_policy_name(uint8_t policy) {
+    switch (policy) {
+        case Q_POLICY_EPSILON_GREEDY: return "epsilon-greedy";
+        case Q_POLICY_UCB1: return "ucb1";
+        case Q_POLICY_SOFTMAX: return "softmax";
+        default: return "unknown";
+    }
+}
+
+// Exploration parameter of the active policy
+q_value_t get_exploration(void) {
+    if (!exploration_set) {
+        set_exploration_policy(exploration_policy);
+    }
+    return exploration;
+}
+
+// Set the exploration parameter
+void set_exploration(q_value_t value) {
+    if (value <= 0) return;
+    exploration = value;
+    exploration_set = 1;
+}
+
+/**
+ * End-of-cycle decay of the exploration parameter
+ * (UCB1's bonus already shrinks with the visit counts)
+ */
+void decay_exploration(void) {
+    if (!exploration_set) {
+        set_exploration_policy(exploration_policy);
+    }
+    
+    switch (exploration_policy) {
+        case Q_POLICY_EPSILON_GREEDY:
+            exploration = Q_MUL(exploration, Q_FROM_FLOAT(Q_EPSILON_DECAY));
+            if (exploration < Q_FROM_FLOAT(Q_EPSILON_MIN)) {
+                exploration = Q_FROM_FLOAT(Q_EPSILON_MIN);
+            }
+            break;
+        case Q_POLICY_SOFTMAX:
+            exploration = Q_MUL(exploration, Q_FROM_FLOAT(Q_SOFTMAX_TEMP_DECAY));
+            if (exploration < Q_FROM_FLOAT(Q_SOFTMAX_TEMP_MIN)) {
+                exploration = Q_FROM_FLOAT(Q_SOFTMAX_TEMP_MIN);
+            }
+            break;
+        default:
+            break;
+    }
 }
 
-// Function to get the current state (buffer_size and energy_level)
+// Function to get the current state (buffer_size, avg_retrans and state index)
 env_state *get_current_state(void) {
-    current_state->buffer_size = 0;
-    current_state->energy_level = 0;
-    return current_state;
+    return &current_state;
+}
+
+/**
+ * Observe the state reached at the end of a learning cycle
+ * The state index is O(1): buffer bucket * Q_STATE_RETRANS_BUCKETS + retrans bucket
+ * 
+ * Parameters:
+ * - buffer_size: current queue occupancy (0 to Q_STATE_BUFFER_CAPACITY)
+ * - avg_retrans: average transmissions per packet (Q_ONE = no retrans)
+ * 
+ * Returns: index of the new current state
+ */
+uint8_t observe_state(uint8_t buffer_size, q_value_t avg_retrans) {
+    uint8_t buffer_bucket = 0;
+    uint8_t retrans_bucket = 0;
+    
+#if Q_STATE_BUFFER_BUCKETS > 1
+    // Equal-width occupancy buckets over 0..Q_STATE_BUFFER_CAPACITY
+    buffer_bucket = (uint16_t)buffer_size * Q_STATE_BUFFER_BUCKETS / (Q_STATE_BUFFER_CAPACITY + 1);
+    if (buffer_bucket >= Q_STATE_BUFFER_BUCKETS) buffer_bucket = Q_STATE_BUFFER_BUCKETS - 1;
+#endif
+    
+#if Q_STATE_RETRANS_BUCKETS > 1
+    // Buckets of Q_STATE_RETRANS_STEP retransmissions above the first attempt
+    if (avg_retrans > Q_ONE) {
+        q_value_t extra = avg_retrans - Q_ONE;
+        while (retrans_bucket < Q_STATE_RETRANS_BUCKETS - 1 &&
+               extra >= Q_FROM_FLOAT(Q_STATE_RETRANS_STEP)) {
+            extra -= Q_FROM_FLOAT(Q_STATE_RETRANS_STEP);
+            retrans_bucket++;
+        }
+    }
+#endif
+    
+    previous_state_index = current_state.index;
+    current_state.buffer_size = buffer_size;
+    current_state.avg_retrans = avg_retrans;
+    current_state.index = buffer_bucket * Q_STATE_RETRANS_BUCKETS + retrans_bucket;
+    return current_state.index;
+}
+
+/**
+ * Step size for the n-th visit of a (state, action) pair
+ * Rarely tried actions move fast towards their observed return, often tried
+ * ones average over many cycles; the decaying schedules never go below
+ * Q_STEP_SIZE_MIN (nor above 1)
+ */
+q_value_t get_step_size(uint16_t visits) {
+    q_value_t alpha;
+    
+    if (visits == 0) visits = 1;
+    
+    switch (step_size_schedule) {
+        case Q_STEP_HARMONIC:
+            alpha = Q_FROM_RATIO(1, visits);
+            break;
+        case Q_STEP_POLYNOMIAL:
+            alpha = poly_step(visits);
+            break;
+        case Q_STEP_DECAY_FLOOR:
+            alpha = (q_value_t)((q_accum_t)learning_rate * Q_STEP_DECAY_VISITS /
+                                (Q_STEP_DECAY_VISITS + visits));
+            break;
+        case Q_STEP_CONSTANT:
+        default:
+            return learning_rate;
+    }
+    
+    if (alpha < Q_FROM_FLOAT(Q_STEP_SIZE_MIN)) {
+        alpha = Q_FROM_FLOAT(Q_STEP_SIZE_MIN);
+    }
+    return alpha;
 }
 
 // Updating the q-value table with improved formula
-void update_q_table(uint8_t action, float got_reward) {
-    q_list[action] = (1 - learning_rate) * q_list[action] + 
-                     learning_rate * (got_reward + discount_factor * q_list[get_highest_q_val()]);
+// The action was taken in the previous state and led to the current one
+void update_q_table(uint8_t action, q_value_t got_reward) {
+    if (action >= Q_VALUE_LIST_SIZE) return;
+    
+    uint16_t *visits = &q_visits[previous_state_index][action];
+    if (*visits < 0xffff) {
+        (*visits)++;
+        state_visits[previous_state_index]++;
+    }
+    q_value_t alpha = get_step_size(*visits);
+    
+    uint16_t index = (uint16_t)previous_state_index * Q_VALUE_LIST_SIZE + action;
+    set_q_value(index, Q_MUL(Q_ONE - alpha, q_list[previous_state_index][action]) + 
+                       Q_MUL(alpha, got_reward + Q_MUL(discount_factor, get_highest_q_value())));
+    
+#if Q_LEARNING_HIERARCHICAL
+    // The coarse table learns from every cycle, also while refining, so the
+    // refined bin follows the coarse optimum when traffic changes
+    uint8_t state = previous_state_index;
+    uint8_t bin = get_action_bin(action);
+    q_value_t next_best = q_coarse[current_state.index][best_coarse_bin(current_state.index)];
+    uint8_t old_best = best_coarse_bin(state);
+    
+    q_coarse[state][bin] = Q_MUL(Q_ONE - learning_rate, q_coarse[state][bin]) + 
+                           Q_MUL(learning_rate, got_reward + Q_MUL(discount_factor, next_best));
+    untried_bins[state] &= ~((uint32_t)1 << bin);
+    if (bin == refine_bin[state]) {
+        untried_fine[state] &= ~((uint32_t)1 << (action - bin * Q_COARSE_BIN_WIDTH));
+    }
+    
+    uint8_t new_best = best_coarse_bin(state);
+    if (new_best != old_best || untried_bins[state]) {
+        stable_cycles[state] = 0;
+    } else if (stable_cycles[state] < Q_COARSE_STABLE_CYCLES) {
+        stable_cycles[state]++;
+    }
+    
+    if (search_phase[state] == Q_SEARCH_FINE) {
+        // Only the refined bin is updated while refining, the others keep
+        // the value of the last survey: survey them all again when the
+        // refined bin falls behind one of them (its reward dropped) and
+        // periodically, in case one of them improved meanwhile
+        uint8_t resurvey = new_best != refine_bin[state];
+#if Q_COARSE_RESURVEY_CYCLES
+        resurvey |= ++fine_cycles[state] >= Q_COARSE_RESURVEY_CYCLES;
+#endif
+        if (resurvey) {
+            search_phase[state] = Q_SEARCH_COARSE;
+            stable_cycles[state] = 0;
+            untried_bins[state] = ((uint32_t)1 << Q_COARSE_BINS) - 1;
+        }
+    } else if (stable_cycles[state] >= Q_COARSE_STABLE_CYCLES) {
+        search_phase[state] = Q_SEARCH_FINE;
+        fine_cycles[state] = 0;
+    }
+    if (new_best != refine_bin[state]) {
+        // refine a new bin: sweep its actions again
+        refine_bin[state] = new_best;
+        untried_fine[state] = ((uint32_t)1 << bin_width(new_best)) - 1;
+    }
+#endif /* Q_LEARNING_HIERARCHICAL */
 }
 
 // function to return the main q-list
-float * get_q_table(void) {
-    return q_list;
+const q_value_t * get_q_table(void) {
+    return &q_list[0][0];
+}
+
+// function to read a single q-value
+q_value_t get_q_value(uint16_t index) {
+    if (index >= Q_TABLE_SIZE) return 0;
+    return q_list[index / Q_VALUE_LIST_SIZE][index % Q_VALUE_LIST_SIZE];
+}
+
+// function to write a single q-value, keeping the cached maximum of its state up to date
+// (ties resolve to the lowest index, exactly like the full scan)
+void set_q_value(uint16_t index, q_value_t value) {
+    if (index >= Q_TABLE_SIZE) return;
+    
+    uint8_t state = index / Q_VALUE_LIST_SIZE;
+    uint8_t action = index % Q_VALUE_LIST_SIZE;
+    q_value_t *row = q_list[state];
+    q_value_t old_value = row[action];
+    row[action] = value;
+    
+    if (best_q_stale[state]) {
+        return;  // a re-scan is already pending
+    }
+    if (action == best_q_index[state]) {
+        if (value < old_value) {
+            best_q_stale[state] = 1;  // the maximum decreased, another entry may now lead
+        }
+    } else if (value > row[best_q_index[state]] ||
+               (value == row[best_q_index[state]] && action < best_q_index[state])) {
+        best_q_index[state] = action;
+    }
 }
 
 // generating random q-values
 void generate_random_q_values(void) {
-    for (int i = 0; i < Q_VALUE_LIST_SIZE; i++) {
-        q_list[i] = (float) random_rand() / RANDOM_RAND_MAX;
+    for (int s = 0; s < Q_NUM_STATES; s++) {
+        best_q_stale[s] = 1;
+    }
+    for (int i = 0; i < Q_TABLE_SIZE; i++) {
+        set_q_value(i, random_unit());
+    }
+    memset(q_visits, 0, sizeof(q_visits));
+    memset(state_visits, 0, sizeof(state_visits));
+#if Q_LEARNING_HIERARCHICAL
+    for (int s = 0; s < Q_NUM_STATES; s++) {
+        for (int b = 0; b < Q_COARSE_BINS; b++) {
+            q_coarse[s][b] = random_unit();
+        }
+        search_phase[s] = Q_SEARCH_COARSE;
+        stable_cycles[s] = 0;
+        fine_cycles[s] = 0;
+        refine_bin[s] = 0;
+        untried_bins[s] = ((uint32_t)1 << Q_COARSE_BINS) - 1;
+        untried_fine[s] = ((uint32_t)1 << bin_width(0)) - 1;
     }
+#endif /* Q_LEARNING_HIERARCHICAL */
+}
+
+// Visit count of a (state, action) pair
+uint16_t get_visit_count(uint16_t index) {
+    if (index >= Q_TABLE_SIZE) return 0;
+    return q_visits[index / Q_VALUE_LIST_SIZE][index % Q_VALUE_LIST_SIZE];
+}
+
+// Visit counts of all pairs
+const uint16_t * get_visit_counts(void) {
+    return &q_visits[0][0];
+}
+
+// function to write a single visit count
+void set_visit_count(uint16_t index, uint16_t visits) {
+    if (index >= Q_TABLE_SIZE) return;
+    uint8_t state = index / Q_VALUE_LIST_SIZE;
+    uint16_t *entry = &q_visits[state][index % Q_VALUE_LIST_SIZE];
+    state_visits[state] += (int32_t)visits - *entry;
+    *entry = visits;
+}
+
+// Select the step-size schedule
+void set_step_size_schedule(uint8_t schedule) {
+    if (schedule > Q_STEP_DECAY_FLOOR) return;
+    step_size_schedule = schedule;
+}
+
+// Current step-size schedule
+uint8_t get_step_size_schedule(void) {
+    return step_size_schedule;
+}
+
+// Hierarchical search: coarse bin containing an action
+uint8_t get_action_bin(uint8_t action) {
+    uint8_t bin = action / Q_COARSE_BIN_WIDTH;
+    return bin < Q_COARSE_BINS ? bin : Q_COARSE_BINS - 1;
+}
+
+// Hierarchical search: current phase of the current state
+uint8_t get_search_phase(void) {
+#if Q_LEARNING_HIERARCHICAL
+    return search_phase[current_state.index];
+#else
+    return Q_SEARCH_FINE;  // the flat table searches all actions directly
+#endif
+}
+
+// Hierarchical search: bin being refined in the current state
+uint8_t get_refine_bin(void) {
+#if Q_LEARNING_HIERARCHICAL
+    return refine_bin[current_state.index];
+#else
+    return 0;
+#endif
 }
\ No newline at end of file
@@ -11,6 +11,114 @@
 #define Q_VALUE_LIST_SIZE 101  // TSCH_SCHEDULE_DEFAULT_LENGTH = 101
 #endif
 
+// Discretised state: queue occupancy buckets x average retransmission buckets
+// (1 x 1 is the stateless learner, a single row of Q_VALUE_LIST_SIZE actions)
+#ifndef Q_STATE_BUFFER_BUCKETS
+#define Q_STATE_BUFFER_BUCKETS 1
+#endif
+#ifndef Q_STATE_RETRANS_BUCKETS
+#define Q_STATE_RETRANS_BUCKETS 1
+#endif
+
+// Queue capacity used to bucket the buffer occupancy
+#ifndef Q_STATE_BUFFER_CAPACITY
+#ifdef QUEUEBUF_CONF_NUM
+#define Q_STATE_BUFFER_CAPACITY QUEUEBUF_CONF_NUM
+#else
+#define Q_STATE_BUFFER_CAPACITY 8
+#endif
+#endif
+
+// Width of one retransmission bucket (average transmissions per packet)
+#ifndef Q_STATE_RETRANS_STEP
+#define Q_STATE_RETRANS_STEP 1.0
+#endif
+
+// Number of states and total number of Q-values kept by the learner
+// (RAM used by the Q-table = Q_TABLE_SIZE * sizeof(q_value_t))
+#define Q_NUM_STATES (Q_STATE_BUFFER_BUCKETS * Q_STATE_RETRANS_BUCKETS)
+#define Q_TABLE_SIZE (Q_NUM_STATES * Q_VALUE_LIST_SIZE)
+
+// Coarse-to-fine hierarchical action search: learn over Q_COARSE_BINS bins of
+// slotframe sizes first, then refine inside the winning bin
+#ifdef Q_LEARNING_CONF_HIERARCHICAL
+#define Q_LEARNING_HIERARCHICAL Q_LEARNING_CONF_HIERARCHICAL
+#else
+#define Q_LEARNING_HIERARCHICAL 0
+#endif
+
+// Number of coarse bins spanning the action space (8 bins -> sizes 8..101)
+#ifndef Q_COARSE_BINS
+#define Q_COARSE_BINS 8
+#endif
+#define Q_COARSE_BIN_WIDTH ((Q_VALUE_LIST_SIZE + Q_COARSE_BINS - 1) / Q_COARSE_BINS)
+
+// Cycles the best coarse bin must stay unchanged before refining inside it
+#ifndef Q_COARSE_STABLE_CYCLES
+#define Q_COARSE_STABLE_CYCLES 4
+#endif
+
+// Cycles spent refining a bin before all bins are surveyed again, so bins
+// that improved while frozen are noticed (0 = only when the refined bin
+// falls behind another one)
+#ifndef Q_COARSE_RESURVEY_CYCLES
+#define Q_COARSE_RESURVEY_CYCLES 100
+#endif
+
+// Step-size schedule of the Q-update, driven by the visit count n of the
+// updated (state, action) pair (enum q_step_size_schedule)
+#ifdef Q_LEARNING_CONF_STEP_SIZE
+#define Q_LEARNING_STEP_SIZE Q_LEARNING_CONF_STEP_SIZE
+#else
+#define Q_LEARNING_STEP_SIZE Q_STEP_CONSTANT
+#endif
+
+// Lower bound of the decaying step sizes, so the learner keeps tracking
+// traffic changes after many visits
+#ifndef Q_STEP_SIZE_MIN
+#define Q_STEP_SIZE_MIN 0.02
+#endif
+
+// Q_STEP_DECAY_FLOOR: visits after which the step size is halved
+#ifndef Q_STEP_DECAY_VISITS
+#define Q_STEP_DECAY_VISITS 10
+#endif
+
+// Exploration policy (enum q_exploration_policy), can also be changed at
+// runtime with set_exploration_policy()
+#ifdef Q_LEARNING_CONF_POLICY
+#define Q_LEARNING_POLICY Q_LEARNING_CONF_POLICY
+#else
+#define Q_LEARNING_POLICY Q_POLICY_EPSILON_GREEDY
+#endif
+
+// Epsilon-greedy: initial epsilon, decay factor per cycle and floor
+#ifndef Q_EPSILON_INITIAL
+#define Q_EPSILON_INITIAL 0.15
+#endif
+#ifndef Q_EPSILON_DECAY
+#define Q_EPSILON_DECAY 0.995
+#endif
+#ifndef Q_EPSILON_MIN
+#define Q_EPSILON_MIN 0.01
+#endif
+
+// Softmax: initial temperature (in reward units), decay factor per cycle and floor
+#ifndef Q_SOFTMAX_TEMP_INITIAL
+#define Q_SOFTMAX_TEMP_INITIAL 10.0
+#endif
+#ifndef Q_SOFTMAX_TEMP_DECAY
+#define Q_SOFTMAX_TEMP_DECAY 0.99
+#endif
+#ifndef Q_SOFTMAX_TEMP_MIN
+#define Q_SOFTMAX_TEMP_MIN 0.5
+#endif
+
+// UCB1: weight of the confidence bonus c * sqrt(ln N / n) (in reward units)
+#ifndef Q_UCB_C
+#define Q_UCB_C 10.0
+#endif
+
 // printing trans/reception records with slot numbers
 #ifdef PRINT_TRANSMISSION_RECORDS_CONF
 #define PRINT_TRANSMISSION_RECORDS PRINT_TRANSMISSION_RECORDS_CONF
@@ -18,36 +126,163 @@
 #define PRINT_TRANSMISSION_RECORDS 0
 #endif
 
+// fixed-point arithmetic for motes without an FPU (MSP430, Cortex-M0)
+#ifdef Q_LEARNING_CONF_FIXED_POINT
+#define Q_LEARNING_FIXED_POINT Q_LEARNING_CONF_FIXED_POINT
+#else
+#define Q_LEARNING_FIXED_POINT 0
+#endif
+
+// fractional bits of the fixed-point format (16 -> Q16.16, 8 -> Q24.8)
+#ifndef Q_FIXED_FRAC_BITS
+#define Q_FIXED_FRAC_BITS 16
+#endif
+
+/******** Value type *******/
+// q_value_t holds Q-values, rewards and learning parameters.
+// Q_ONE is 1.0 in that representation, q_accum_t is wide enough to sum a
+// whole column of Q-values without overflowing.
+#if Q_LEARNING_FIXED_POINT
+typedef int32_t q_value_t;
+typedef int64_t q_accum_t;
+#define Q_ONE ((q_value_t)1 << Q_FIXED_FRAC_BITS)
+#define Q_FROM_FLOAT(x) ((q_value_t)((x) * Q_ONE + ((x) >= 0 ? 0.5 : -0.5)))
+#define Q_TO_FLOAT(x) ((float)(x) / Q_ONE)
+#define Q_FROM_INT(x) ((q_value_t)(x) * Q_ONE)
+#define Q_FROM_RATIO(num, den) ((q_value_t)(((int64_t)(num) * Q_ONE) / (den)))
+#define Q_MUL(a, b) ((q_value_t)(((int64_t)(a) * (b)) >> Q_FIXED_FRAC_BITS))
+#define Q_DIV(a, b) ((q_value_t)(((int64_t)(a) << Q_FIXED_FRAC_BITS) / (b)))
+#else
+typedef float q_value_t;
+typedef float q_accum_t;
+#define Q_ONE 1.0f
+#define Q_FROM_FLOAT(x) ((q_value_t)(x))
+#define Q_TO_FLOAT(x) ((float)(x))
+#define Q_FROM_INT(x) ((q_value_t)(x))
+#define Q_FROM_RATIO(num, den) ((q_value_t)(num) / (den))
+#define Q_MUL(a, b) ((a) * (b))
+#define Q_DIV(a, b) ((a) / (b))
+#endif /* Q_LEARNING_FIXED_POINT */
+
+// step-size schedules, alpha_n for the n-th visit of a (state, action) pair
+enum q_step_size_schedule {
+    Q_STEP_CONSTANT,      // alpha_n = learning_rate
+    Q_STEP_HARMONIC,      // alpha_n = 1/n (sample average)
+    Q_STEP_POLYNOMIAL,    // alpha_n = 1/n^0.6
+    Q_STEP_DECAY_FLOOR    // alpha_n = learning_rate / (1 + n/Q_STEP_DECAY_VISITS)
+};                        // the decaying ones are clamped to Q_STEP_SIZE_MIN
+
+// exploration policies used by select_action()
+enum q_exploration_policy {
+    Q_POLICY_EPSILON_GREEDY,  // random action with probability epsilon, decaying epsilon
+    Q_POLICY_UCB1,            // every action once, then max Q + c * sqrt(ln N / n)
+    Q_POLICY_SOFTMAX          // Boltzmann sampling, decaying temperature
+};
+
+// phases of the hierarchical action search
+enum q_search_phase { Q_SEARCH_COARSE, Q_SEARCH_FINE };
+
 // structure to store a state of the node
 typedef struct {
-    uint8_t buffer_size;
-    float energy_level;
+    uint8_t buffer_size;     // queue occupancy when the state was observed
+    q_value_t avg_retrans;   // average transmissions per packet in the last cycle
+    uint8_t index;           // discretised state, row of the Q-table
 } env_state;
 
 /********** Functions *********/
 // TSCH-based reward function with retransmission penalty
-float tsch_reward_function(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev, 
-                          uint8_t n_buff_new, float avg_retrans);
+q_value_t tsch_reward_function(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff_prev, 
+                              uint8_t n_buff_new, q_value_t avg_retrans);
 
 // Legacy reward function
-float reward(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff, uint8_t n_buff_new);
+q_value_t reward(uint8_t n_tx, uint8_t n_rx, uint8_t n_buff, uint8_t n_buff_new);
 
-// Function to find the action with highest q-value, returns the index of max value
+// Function to find the action with highest q-value in the current state, returns the index of max value
+// (cached, O(1) unless the previous maximum was decreased)
 uint8_t get_highest_q_val(void);
 
+// Same as get_highest_q_val() for an arbitrary state
+uint8_t get_highest_q_val_in_state(uint8_t state);
+
+// Function to return the highest q-value of the current state
+q_value_t get_highest_q_value(void);
+
 // Function to select action using epsilon-greedy strategy (exploration vs exploitation)
-uint8_t get_action_epsilon_greedy(float epsilon);
+uint8_t get_action_epsilon_greedy(q_value_t epsilon);
+
+// Function to select the action of the next cycle in the current state with
+// the active exploration policy
+uint8_t select_action(void);
+
+// Select the exploration policy (enum q_exploration_policy), resets the
+// exploration parameter to the policy's initial value
+void set_exploration_policy(uint8_t policy);
 
-// Function to get the current state (buffer_size and energy_level)
+// Current exploration policy
+uint8_t get_exploration_policy(void);
+
+// Printable name of an exploration policy
+const char *get_exploration_policy_name(uint8_t policy);
+
+// Exploration parameter of the active policy: epsilon, softmax temperature or UCB1 c
+q_value_t get_exploration(void);
+
+// Set the exploration parameter (checkpoint warm start, simulators)
+void set_exploration(q_value_t value);
+
+// End-of-cycle decay of epsilon / temperature down to their floor
+void decay_exploration(void);
+
+// Function to get the current state (buffer_size, avg_retrans and state index)
 env_state *get_current_state(void);
 
-// Updating the q-value table
-void update_q_table(uint8_t action, float got_reward);
+// Function to observe the state reached at the end of a cycle, returns its index
+// Must be called before update_q_table(), the previous state becomes the one
+// in which the action was taken
+uint8_t observe_state(uint8_t buffer_size, q_value_t avg_retrans);
 
-// function to return the main q-list
-float * get_q_table(void);
+// Updating the q-value table: Q(previous state, action) with max Q(current state)
+void update_q_table(uint8_t action, q_value_t got_reward);
 
-// generating random q-values
+// function to return the main q-list, Q_TABLE_SIZE values laid out state by
+// state (read-only, write through set_q_value)
+const q_value_t * get_q_table(void);
+
+// function to read a single q-value (index = state * Q_VALUE_LIST_SIZE + action)
+q_value_t get_q_value(uint16_t index);
+
+// function to write a single q-value, every write to the q-list goes through it
+void set_q_value(uint16_t index, q_value_t value);
+
+// generating random q-values (also clears the visit counts)
 void generate_random_q_values(void);
 
+// Visit count of a (state, action) pair (index = state * Q_VALUE_LIST_SIZE + action),
+// saturates at 0xffff
+uint16_t get_visit_count(uint16_t index);
+
+// Visit counts of all Q_TABLE_SIZE pairs, same layout as get_q_table()
+const uint16_t * get_visit_counts(void);
+
+// function to write a single visit count (checkpoints, simulators)
+void set_visit_count(uint16_t index, uint16_t visits);
+
+// Select the step-size schedule (enum q_step_size_schedule)
+void set_step_size_schedule(uint8_t schedule);
+
+// Current step-size schedule
+uint8_t get_step_size_schedule(void);
+
+// Step size the current schedule applies to the given visit count
+q_value_t get_step_size(uint16_t visits);
+
+// Hierarchical search: coarse bin containing an action
+uint8_t get_action_bin(uint8_t action);
+
+// Hierarchical search: current phase (enum q_search_phase) of the current state
+uint8_t get_search_phase(void);
+
+// Hierarchical search: bin being refined in the current state
+uint8_t get_refine_bin(void);
+
 #endif /* Q_LEARNING_HEADER */
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "slot-configuration.h"
 #include "q-learning.h"
 #include "net/linkaddr.h"
+#include "lib/random.h"
+#include "sys/critical.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -12,41 +14,262 @@
 /********** Global Variables ***********/
 static slot_manager_t slot_manager;
 
-// Channel offset diversity to reduce interference
-static const uint8_t channel_offsets[] __attribute__((unused)) = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
-#define NUM_CHANNEL_OFFSETS 16
+#define NUM_CHANNEL_OFFSETS SLOT_CHANNEL_OFFSETS
+
+#if SLOT_INTERFERENCE_MAP
+// Interference scores, two channel offsets per byte (low nibble = even offset)
+static uint8_t interference_map[MAX_TRACKED_SLOTS][NUM_CHANNEL_OFFSETS / 2];
+#endif
+
+#if SLOT_BANDIT
+// Arm values per cell, indexed by slot_config_type_t (INACTIVE, SHARED, DEDICATED_TX)
+static slot_bandit_value_t bandit_values[MAX_TRACKED_SLOTS][SLOT_BANDIT_ARMS];
+#endif
 
 /********** Private Helper Functions ***********/
 
 /**
- * Compare function for sorting slots by usage
- * Reserved for future use (advanced slot prioritization)
+ * Saturating counter updates
+ */
+static inline void counter_inc(slot_counter_t *counter) {
+    if (*counter != SLOT_COUNTER_MAX) {
+        (*counter)++;
+    }
+}
+
+static inline void counter_add(slot_counter_t *counter, uint16_t amount) {
+    *counter = (uint32_t)*counter + amount > SLOT_COUNTER_MAX ?
+               SLOT_COUNTER_MAX : (slot_counter_t)(*counter + amount);
+}
+
+/**
+ * Number of times a slot was used (successful tx + rx)
+ */
+static inline uint32_t slot_usage(uint8_t slot_id) {
+    return (uint32_t)slot_manager.slots.successful_tx[slot_id] +
+           slot_manager.slots.successful_rx[slot_id];
+}
+
+/**
+ * Primary neighbor of a slot, linkaddr_null if none
+ */
+static const linkaddr_t *slot_neighbor(uint8_t slot_id) {
+    uint8_t index = slot_manager.slots.neighbor[slot_id];
+    return index == SLOT_NO_NEIGHBOR ? &linkaddr_null : &slot_manager.slots.neighbors[index];
+}
+
+/**
+ * Whether any slot still refers to a neighbor table entry
+ */
+static uint8_t neighbor_referenced(uint8_t index) {
+    return memchr(slot_manager.slots.neighbor, index, MAX_TRACKED_SLOTS) != NULL;
+}
+
+/**
+ * Index of a neighbor in the table, adding it if needed (an entry no slot
+ * refers to any more is reused when the table is full)
+ * Returns SLOT_NO_NEIGHBOR when there is no room
+ */
+static uint8_t neighbor_index(const linkaddr_t *addr) {
+    slot_table_t *t = &slot_manager.slots;
+    uint8_t index;
+    
+    for (index = 0; index < t->num_neighbors; index++) {
+        if (linkaddr_cmp(&t->neighbors[index], addr)) {
+            return index;
+        }
+    }
+    if (t->num_neighbors < SLOT_MAX_NEIGHBORS) {
+        index = t->num_neighbors++;
+    } else {
+        for (index = 0; index < SLOT_MAX_NEIGHBORS && neighbor_referenced(index); index++);
+        if (index == SLOT_MAX_NEIGHBORS) {
+            LOG_WARN("Slot neighbor table full (%u entries)\n", SLOT_MAX_NEIGHBORS);
+            return SLOT_NO_NEIGHBOR;
+        }
+    }
+    linkaddr_copy(&t->neighbors[index], addr);
+    return index;
+}
+
+/**
+ * Set the primary neighbor of a slot (NULL or linkaddr_null clears it)
+ */
+static void set_slot_neighbor(uint8_t slot_id, const linkaddr_t *addr) {
+    if (addr == NULL || linkaddr_cmp(addr, &linkaddr_null)) {
+        slot_manager.slots.neighbor[slot_id] = SLOT_NO_NEIGHBOR;
+    } else {
+        slot_manager.slots.neighbor[slot_id] = neighbor_index(addr);
+    }
+}
+
+/**
+ * Zero the counters of the slots in [from, to)
+ */
+static void clear_counters(uint8_t from, uint8_t to) {
+    slot_table_t *t = &slot_manager.slots;
+    size_t len = (to - from) * sizeof(slot_counter_t);
+    
+    if (to <= from) {
+        return;
+    }
+    memset(&t->successful_tx[from], 0, len);
+    memset(&t->successful_rx[from], 0, len);
+    memset(&t->collisions[from], 0, len);
+    memset(&t->total_attempts[from], 0, len);
+    memset(&t->retransmissions[from], 0, len);
+    memset(&t->slot_reward[from], 0, (to - from) * sizeof(slot_reward_t));
+}
+
+#if SLOT_INTERFERENCE_MAP
+/**
+ * Interference score nibble of a (slot, channel offset) pair
+ */
+static inline uint8_t interference_get(uint8_t slot_id, uint8_t channel_offset) {
+    uint8_t cell = interference_map[slot_id][channel_offset >> 1];
+    return channel_offset & 1 ? cell >> 4 : cell & 0x0f;
+}
+
+static inline void interference_set(uint8_t slot_id, uint8_t channel_offset, uint8_t score) {
+    uint8_t *cell = &interference_map[slot_id][channel_offset >> 1];
+    *cell = channel_offset & 1 ? (*cell & 0x0f) | (score << 4) : (*cell & 0xf0) | score;
+}
+
+/**
+ * Age all scores by a quarter (rounded up, so 1 decays to 0)
+ * The slot operation records events from the rtimer interrupt, so each
+ * slot's row is aged with interrupts off; one row at a time keeps the
+ * interrupt latency short
+ */
+static void interference_decay(void) {
+    for (uint8_t slot = 0; slot < MAX_TRACKED_SLOTS; slot++) {
+        int_master_status_t status = critical_enter();
+        uint8_t *cell = interference_map[slot];
+        for (uint8_t i = 0; i < NUM_CHANNEL_OFFSETS / 2; i++, cell++) {
+            if (*cell != 0) {
+                uint8_t low = *cell & 0x0f;
+                uint8_t high = *cell >> 4;
+                low -= (low + 3) >> 2;
+                high -= (high + 3) >> 2;
+                *cell = low | (high << 4);
+            }
+        }
+        critical_exit(status);
+    }
+}
+#endif /* SLOT_INTERFERENCE_MAP */
+
+/**
+ * Install the link of a slot matching its configuration
+ */
+static void install_slot_link(struct tsch_slotframe *sf, struct tsch_link **links, uint8_t i) {
+    slot_table_t *t = &slot_manager.slots;
+    
+    switch (t->current_config[i]) {
+        case SLOT_CONFIG_INACTIVE:
+            if (links[i] != NULL) {
+                tsch_schedule_remove_link(sf, links[i]);
+                links[i] = NULL;
+            }
+            break;
+        case SLOT_CONFIG_DEDICATED_TX:
+            if (links[i] != NULL) {
+                tsch_schedule_remove_link(sf, links[i]);
+            }
+            links[i] = tsch_schedule_add_link(sf, LINK_OPTION_TX, LINK_TYPE_NORMAL,
+                                              slot_neighbor(i), i,
+                                              t->channel_offset[i], 1);
+            break;
+        case SLOT_CONFIG_SHARED:
+            if (links[i] != NULL && (links[i]->link_options & LINK_OPTION_SHARED) &&
+                links[i]->channel_offset == t->channel_offset[i]) {
+                break;  // already installed as created by the schedule
+            }
+            if (links[i] != NULL) {
+                tsch_schedule_remove_link(sf, links[i]);
+            }
+            links[i] = tsch_schedule_add_link(sf, 
+                                              LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+                                              LINK_TYPE_NORMAL, &tsch_broadcast_address, i,
+                                              t->channel_offset[i], 1);
+            break;
+        default:
+            break;
+    }
+}
+
+#if SLOT_BANDIT
+/**
+ * Whether a cell can take an arm (dedicated needs a unicast neighbor)
+ */
+static uint8_t bandit_arm_available(uint8_t slot_id, uint8_t arm) {
+    if (arm != SLOT_CONFIG_DEDICATED_TX) {
+        return 1;
+    }
+    return slot_manager.slots.neighbor[slot_id] != SLOT_NO_NEIGHBOR &&
+           !linkaddr_cmp(slot_neighbor(slot_id), &tsch_broadcast_address);
+}
+
+/**
+ * Move the value of the arm the cell used towards its slot reward
  */
-static int compare_slot_usage(const void *a, const void *b) __attribute__((unused));
-static int compare_slot_usage(const void *a, const void *b) {
-    slot_statistics_t *slot_a = (slot_statistics_t *)a;
-    slot_statistics_t *slot_b = (slot_statistics_t *)b;
-    return (slot_b->usage_count - slot_a->usage_count);
+static void bandit_update(uint8_t slot_id) {
+    uint8_t arm = slot_manager.slots.current_config[slot_id];
+    if (arm >= SLOT_BANDIT_ARMS) return;
+    
+    int32_t target = slot_manager.slots.slot_reward[slot_id];
+    slot_bandit_value_t *value = &bandit_values[slot_id][arm];
+    *value += (target - *value) / (1 << SLOT_BANDIT_STEP_SHIFT);
 }
 
 /**
- * Calculate slot utilization percentage
+ * Epsilon-greedy arm of a cell; ties keep the current configuration
  */
-static float calculate_slot_utilization(slot_statistics_t *slot) {
-    if (slot->total_attempts == 0) {
-        return 0.0;
+static uint8_t bandit_select(uint8_t slot_id) {
+    uint8_t arm;
+    
+    if (random_rand() % 100 < SLOT_BANDIT_EPSILON) {
+        do {
+            arm = random_rand() % SLOT_BANDIT_ARMS;
+        } while (!bandit_arm_available(slot_id, arm));
+        return arm;
+    }
+    
+    uint8_t best = slot_manager.slots.current_config[slot_id];
+    if (best >= SLOT_BANDIT_ARMS || !bandit_arm_available(slot_id, best)) {
+        best = SLOT_CONFIG_SHARED;
+    }
+    for (arm = 0; arm < SLOT_BANDIT_ARMS; arm++) {
+        if (bandit_arm_available(slot_id, arm) &&
+            bandit_values[slot_id][arm] > bandit_values[slot_id][best]) {
+            best = arm;
+        }
     }
-    return (float)(slot->successful_tx + slot->successful_rx) / slot->total_attempts * 100.0;
+    return best;
 }
+#endif /* SLOT_BANDIT */
 
+#if !SLOT_BANDIT
 /**
- * Calculate collision rate for a slot
+ * Calculate slot utilization percentage (rounded down)
  */
-static float calculate_collision_rate(slot_statistics_t *slot) {
-    if (slot->total_attempts == 0) {
-        return 0.0;
+static uint8_t calculate_slot_utilization(uint8_t slot_id) {
+    if (slot_manager.slots.total_attempts[slot_id] == 0) {
+        return 0;
     }
-    return (float)slot->collisions / slot->total_attempts * 100.0;
+    return (uint8_t)(100 * slot_usage(slot_id) / slot_manager.slots.total_attempts[slot_id]);
+}
+#endif
+
+/**
+ * Calculate collision rate for a slot (percentage, rounded down)
+ */
+static uint8_t calculate_collision_rate(uint8_t slot_id) {
+    if (slot_manager.slots.total_attempts[slot_id] == 0) {
+        return 0;
+    }
+    return (uint8_t)(100 * (uint32_t)slot_manager.slots.collisions[slot_id] /
+                     slot_manager.slots.total_attempts[slot_id]);
 }
 
 /********** Public Functions ***********/
@@ -56,6 +279,13 @@ static float calculate_collision_rate(slot_statistics_t *slot) {
  */
 void slot_config_init(uint8_t initial_slotframe_size) {
     memset(&slot_manager, 0, sizeof(slot_manager_t));
+    memset(slot_manager.slots.neighbor, SLOT_NO_NEIGHBOR, sizeof(slot_manager.slots.neighbor));
+#if SLOT_INTERFERENCE_MAP
+    memset(interference_map, 0, sizeof(interference_map));
+#endif
+#if SLOT_BANDIT
+    memset(bandit_values, 0, sizeof(bandit_values));
+#endif
     
     slot_manager.slotframe_size = initial_slotframe_size;
     slot_manager.num_active_slots = initial_slotframe_size;
@@ -64,14 +294,13 @@ void slot_config_init(uint8_t initial_slotframe_size) {
     slot_manager.learning_cycle_count = 0;
     
     // Initialize slot 0 as advertising
-    slot_manager.slots[0].current_config = SLOT_CONFIG_ADVERTISING;
-    slot_manager.slots[0].channel_offset = 0;
+    slot_manager.slots.current_config[0] = SLOT_CONFIG_ADVERTISING;
+    slot_manager.slots.channel_offset[0] = 0;
     
     // Initialize other slots as shared
     for (int i = 1; i < initial_slotframe_size; i++) {
-        slot_manager.slots[i].current_config = SLOT_CONFIG_SHARED;
-        slot_manager.slots[i].channel_offset = 0;
-        linkaddr_copy(&slot_manager.slots[i].primary_neighbor, &linkaddr_null);
+        slot_manager.slots.current_config[i] = SLOT_CONFIG_SHARED;
+        slot_manager.slots.channel_offset[i] = 0;
     }
     
     LOG_INFO("Slot configuration manager initialized: size=%u\n", initial_slotframe_size);
@@ -83,16 +312,15 @@ void slot_config_init(uint8_t initial_slotframe_size) {
 void slot_record_tx(uint8_t slot_id, linkaddr_t *dest, uint8_t retrans_count) {
     if (slot_id >= MAX_TRACKED_SLOTS) return;
     
-    slot_statistics_t *slot = &slot_manager.slots[slot_id];
-    slot->successful_tx++;
-    slot->total_attempts++;
-    slot->usage_count++;
-    slot->retransmissions += retrans_count;
+    slot_table_t *t = &slot_manager.slots;
+    counter_inc(&t->successful_tx[slot_id]);
+    counter_inc(&t->total_attempts[slot_id]);
+    counter_add(&t->retransmissions[slot_id], retrans_count);
     
     // Track primary neighbor for potential dedicated slot
     if (dest != NULL && !linkaddr_cmp(dest, &linkaddr_null)) {
-        if (linkaddr_cmp(&slot->primary_neighbor, &linkaddr_null)) {
-            linkaddr_copy(&slot->primary_neighbor, dest);
+        if (t->neighbor[slot_id] == SLOT_NO_NEIGHBOR) {
+            set_slot_neighbor(slot_id, dest);
         }
     }
 }
@@ -103,15 +331,14 @@ void slot_record_tx(uint8_t slot_id, linkaddr_t *dest, uint8_t retrans_count) {
 void slot_record_rx(uint8_t slot_id, linkaddr_t *src) {
     if (slot_id >= MAX_TRACKED_SLOTS) return;
     
-    slot_statistics_t *slot = &slot_manager.slots[slot_id];
-    slot->successful_rx++;
-    slot->total_attempts++;
-    slot->usage_count++;
+    slot_table_t *t = &slot_manager.slots;
+    counter_inc(&t->successful_rx[slot_id]);
+    counter_inc(&t->total_attempts[slot_id]);
     
     // Track primary neighbor
     if (src != NULL && !linkaddr_cmp(src, &linkaddr_null)) {
-        if (linkaddr_cmp(&slot->primary_neighbor, &linkaddr_null)) {
-            linkaddr_copy(&slot->primary_neighbor, src);
+        if (t->neighbor[slot_id] == SLOT_NO_NEIGHBOR) {
+            set_slot_neighbor(slot_id, src);
         }
     }
 }
@@ -122,34 +349,83 @@ void slot_record_rx(uint8_t slot_id, linkaddr_t *src) {
 void slot_record_collision(uint8_t slot_id) {
     if (slot_id >= MAX_TRACKED_SLOTS) return;
     
-    slot_statistics_t *slot = &slot_manager.slots[slot_id];
-    slot->collisions++;
-    slot->total_attempts++;
+    counter_inc(&slot_manager.slots.collisions[slot_id]);
+    counter_inc(&slot_manager.slots.total_attempts[slot_id]);
+}
+
+/**
+ * Record an interference event on a (slot, channel offset) pair
+ */
+void slot_record_interference(uint8_t slot_id, uint8_t channel_offset,
+                              slot_interference_event_t event) {
+#if SLOT_INTERFERENCE_MAP
+    static const uint8_t weights[] = {
+        SLOT_INTERFERENCE_COLLISION, SLOT_INTERFERENCE_NOACK, SLOT_INTERFERENCE_NOISE
+    };
+    
+    if (slot_id >= MAX_TRACKED_SLOTS || channel_offset >= NUM_CHANNEL_OFFSETS ||
+        event > SLOT_EVENT_NOISE) return;
+    
+    uint8_t score = interference_get(slot_id, channel_offset) + weights[event];
+    interference_set(slot_id, channel_offset, score > 15 ? 15 : score);
+#endif
+}
+
+/**
+ * Record the RSSI of an idle listen
+ */
+void slot_record_rssi(uint8_t slot_id, uint8_t channel_offset, int16_t rssi) {
+    if (rssi >= SLOT_INTERFERENCE_RSSI_THRESHOLD) {
+        slot_record_interference(slot_id, channel_offset, SLOT_EVENT_NOISE);
+    }
+}
+
+/**
+ * Decayed interference score of a (slot, channel offset) pair
+ */
+uint8_t get_slot_interference(uint8_t slot_id, uint8_t channel_offset) {
+#if SLOT_INTERFERENCE_MAP
+    if (slot_id < MAX_TRACKED_SLOTS && channel_offset < NUM_CHANNEL_OFFSETS) {
+        return interference_get(slot_id, channel_offset);
+    }
+#endif
+    return 0;
 }
 
 /**
  * Analyze slot statistics and compute rewards per slot
  */
-float analyze_slot_performance(void) {
-    float total_reward = 0.0;
+slot_reward_t analyze_slot_performance(void) {
+    slot_table_t *t = &slot_manager.slots;
+    int32_t total_reward = 0;
     uint8_t active_slots = 0;
     
     for (int i = 0; i < slot_manager.slotframe_size; i++) {
-        slot_statistics_t *slot = &slot_manager.slots[i];
+        uint32_t throughput = slot_usage(i);
         
-        if (slot->usage_count > 0 || slot->current_config != SLOT_CONFIG_INACTIVE) {
-            // Compute slot reward: throughput - collisions - retransmissions
-            float throughput = (float)(slot->successful_tx + slot->successful_rx);
-            float collision_penalty = (float)slot->collisions * 2.0;
-            float retrans_penalty = (float)slot->retransmissions * 0.5;
+        if (throughput > 0 || t->current_config[i] != SLOT_CONFIG_INACTIVE) {
+            // Compute slot reward: throughput - 2 * collisions - retransmissions / 2,
+            // counted in halves
+            int32_t halves = 2 * (int32_t)throughput - 4 * (int32_t)t->collisions[i] -
+                             (int32_t)t->retransmissions[i];
+            if (halves > 2 * SLOT_REWARD_LIMIT) {
+                halves = 2 * SLOT_REWARD_LIMIT;
+            } else if (halves < -2 * SLOT_REWARD_LIMIT) {
+                halves = -2 * SLOT_REWARD_LIMIT;
+            }
             
-            slot->slot_reward = throughput - collision_penalty - retrans_penalty;
-            total_reward += slot->slot_reward;
+            t->slot_reward[i] = (slot_reward_t)(halves * (1 << (SLOT_REWARD_FRAC_BITS - 1)));
+            total_reward += t->slot_reward[i];
             active_slots++;
         }
+#if SLOT_BANDIT
+        if (i > 0) {
+            bandit_update(i);
+        }
+#endif
     }
     
-    return active_slots > 0 ? total_reward / active_slots : 0.0;
+    return active_slots > 0 ? (slot_reward_t)(total_reward / active_slots) : 0;
 }
 
 /**
@@ -168,40 +444,67 @@ void reconfigure_slots_adaptive(struct tsch_slotframe *sf, struct tsch_link **li
     uint8_t channels_optimized = 0;
     
     // Analyze each slot
+    slot_table_t *t = &slot_manager.slots;
     for (int i = 1; i < slot_manager.slotframe_size; i++) {  // Skip slot 0 (advertising)
-        slot_statistics_t *slot = &slot_manager.slots[i];
-        
+#if SLOT_BANDIT
+        // Decisions 1 and 2 learned: the cell takes the arm its bandit selects
+        uint8_t arm = bandit_select(i);
+        // slot_reward has no throughput floor (heavy contention makes every
+        // cell negative), so keep deactivations within the third that
+        // compute_slot_efficiency_reward() tolerates
+        if (arm == SLOT_CONFIG_INACTIVE && t->current_config[i] != SLOT_CONFIG_INACTIVE &&
+            slot_manager.slotframe_size - slot_manager.num_active_slots + 1 >
+            slot_manager.slotframe_size / 3) {
+            arm = bandit_arm_available(i, SLOT_CONFIG_DEDICATED_TX) &&
+                  bandit_values[i][SLOT_CONFIG_DEDICATED_TX] > bandit_values[i][SLOT_CONFIG_SHARED] ?
+                  SLOT_CONFIG_DEDICATED_TX : SLOT_CONFIG_SHARED;
+        }
+        if (arm != t->current_config[i]) {
+            LOG_INFO("Slot %u: bandit config %u->%u (value=%.2f)\n", i,
+                     t->current_config[i], arm,
+                     (double)SLOT_REWARD_TO_FLOAT(bandit_values[i][arm]));
+            slot_config_restore(i, arm, t->channel_offset[i], slot_neighbor(i));
+            install_slot_link(sf, links, i);
+            if (arm == SLOT_CONFIG_INACTIVE) {
+                slots_deactivated++;
+            } else if (arm == SLOT_CONFIG_DEDICATED_TX) {
+                slots_converted_dedicated++;
+            }
+        }
+#endif
         if (links[i] == NULL) continue;
         
+#if !SLOT_BANDIT
         // Calculate utilization
-        float utilization = calculate_slot_utilization(slot);
-        float collision_rate = calculate_collision_rate(slot);
+        uint8_t utilization = calculate_slot_utilization(i);
+        uint32_t usage = slot_usage(i);
         
         // Decision 1: Deactivate underutilized slots
-        if (slot->usage_count < SLOT_USAGE_THRESHOLD && 
-            slot->current_config != SLOT_CONFIG_INACTIVE) {
+        if (usage < SLOT_USAGE_THRESHOLD && 
+            t->current_config[i] != SLOT_CONFIG_INACTIVE) {
             
-            LOG_INFO("Slot %u: deactivating (usage=%u, util=%.1f%%)\n", 
-                     i, slot->usage_count, (double)utilization);
+            LOG_INFO("Slot %u: deactivating (usage=%u, util=%u%%)\n", 
+                     i, (unsigned)usage, utilization);
             
             // Remove link
             tsch_schedule_remove_link(sf, links[i]);
             links[i] = NULL;
-            slot->current_config = SLOT_CONFIG_INACTIVE;
+            t->current_config[i] = SLOT_CONFIG_INACTIVE;
             slot_manager.num_active_slots--;
             slots_deactivated++;
             continue;
         }
         
         // Decision 2: Convert high-traffic shared slots to dedicated
-        if (slot->successful_tx >= DEDICATED_THRESHOLD && 
-            slot->current_config == SLOT_CONFIG_SHARED &&
-            !linkaddr_cmp(&slot->primary_neighbor, &linkaddr_null) &&
-            !linkaddr_cmp(&slot->primary_neighbor, &tsch_broadcast_address)) {
+        const linkaddr_t *neighbor = slot_neighbor(i);
+        if (t->successful_tx[i] >= DEDICATED_THRESHOLD && 
+            t->current_config[i] == SLOT_CONFIG_SHARED &&
+            t->neighbor[i] != SLOT_NO_NEIGHBOR &&
+            !linkaddr_cmp(neighbor, &tsch_broadcast_address)) {
             
             LOG_INFO("Slot %u: converting to dedicated TX (tx=%u, neighbor=%02x:%02x)\n", 
-                     i, slot->successful_tx,
-                     slot->primary_neighbor.u8[0], slot->primary_neighbor.u8[1]);
+                     i, t->successful_tx[i],
+                     neighbor->u8[0], neighbor->u8[1]);
             
             // Remove old link
             tsch_schedule_remove_link(sf, links[i]);
@@ -210,26 +513,30 @@ void reconfigure_slots_adaptive(struct tsch_slotframe *sf, struct tsch_link **li
             links[i] = tsch_schedule_add_link(sf,
                                               LINK_OPTION_TX,  // TX only
                                               LINK_TYPE_NORMAL,
-                                              &slot->primary_neighbor,
+                                              neighbor,
                                               i, 
-                                              slot->channel_offset,
+                                              t->channel_offset[i],
                                               1);
             
-            slot->current_config = SLOT_CONFIG_DEDICATED_TX;
+            t->current_config[i] = SLOT_CONFIG_DEDICATED_TX;
             slot_manager.num_dedicated_slots++;
             slot_manager.num_shared_slots--;
             slots_converted_dedicated++;
             continue;
         }
+#endif /* !SLOT_BANDIT */
         
         // Decision 3: Optimize channel offset for high-collision slots
-        if (collision_rate > 20.0 && slot->collisions > 5) {
+        // (more than 20% of the attempts, compared without rounding)
+        if (5 * (uint32_t)t->collisions[i] > t->total_attempts[i] && t->collisions[i] > 5) {
+            // A resize rebuilds the schedule, start from the installed offset
+            t->channel_offset[i] = links[i]->channel_offset;
             uint8_t new_channel = recommend_channel_offset(i);
             
-            if (new_channel != slot->channel_offset) {
-                LOG_INFO("Slot %u: changing channel offset %u->%u (collisions=%u, rate=%.1f%%)\n",
-                         i, slot->channel_offset, new_channel, 
-                         slot->collisions, (double)collision_rate);
+            if (new_channel != t->channel_offset[i]) {
+                LOG_INFO("Slot %u: changing channel offset %u->%u (collisions=%u, rate=%u%%)\n",
+                         i, t->channel_offset[i], new_channel, 
+                         t->collisions[i], calculate_collision_rate(i));
                 
                 // Remove old link
                 uint8_t options = links[i]->link_options;
@@ -241,7 +548,7 @@ void reconfigure_slots_adaptive(struct tsch_slotframe *sf, struct tsch_link **li
                 
                 // Add link with new channel
                 links[i] = tsch_schedule_add_link(sf, options, type, &addr, i, new_channel, 1);
-                slot->channel_offset = new_channel;
+                t->channel_offset[i] = new_channel;
                 channels_optimized++;
             }
         }
@@ -261,18 +568,11 @@ void reconfigure_slots_adaptive(struct tsch_slotframe *sf, struct tsch_link **li
  * NOT when resizing slotframe. This preserves learning across size changes.
  */
 void reset_slot_statistics(void) {
-    for (int i = 0; i < slot_manager.slotframe_size; i++) {
-        slot_statistics_t *slot = &slot_manager.slots[i];
-        
-        // Keep configuration and primary neighbor, reset counters
-        slot->successful_tx = 0;
-        slot->successful_rx = 0;
-        slot->collisions = 0;
-        slot->total_attempts = 0;
-        slot->retransmissions = 0;
-        slot->usage_count = 0;
-        slot->slot_reward = 0.0;
-    }
+    // Keep configuration and primary neighbor, reset counters
+    clear_counters(0, slot_manager.slotframe_size);
+#if SLOT_INTERFERENCE_MAP
+    interference_decay();
+#endif
     
     slot_manager.learning_cycle_count++;
     LOG_INFO("Slot statistics reset for cycle %u (configuration preserved)\n", 
@@ -287,17 +587,30 @@ slot_config_type_t get_slot_recommendation(uint8_t slot_id) {
         return SLOT_CONFIG_INACTIVE;
     }
     
-    return (slot_config_type_t)slot_manager.slots[slot_id].current_config;
+    return (slot_config_type_t)slot_manager.slots.current_config[slot_id];
 }
 
 /**
- * Get statistics for a specific slot
+ * Copy the statistics of a specific slot
  */
-slot_statistics_t* get_slot_statistics(uint8_t slot_id) {
-    if (slot_id >= MAX_TRACKED_SLOTS) {
-        return NULL;
+uint8_t get_slot_statistics(uint8_t slot_id, slot_statistics_t *stats) {
+    if (slot_id >= MAX_TRACKED_SLOTS || stats == NULL) {
+        return 0;
     }
-    return &slot_manager.slots[slot_id];
+    slot_table_t *t = &slot_manager.slots;
+    uint32_t usage = slot_usage(slot_id);
+    
+    stats->successful_tx = t->successful_tx[slot_id];
+    stats->successful_rx = t->successful_rx[slot_id];
+    stats->collisions = t->collisions[slot_id];
+    stats->total_attempts = t->total_attempts[slot_id];
+    stats->retransmissions = t->retransmissions[slot_id];
+    stats->usage_count = usage > SLOT_COUNTER_MAX ? SLOT_COUNTER_MAX : usage;
+    stats->current_config = t->current_config[slot_id];
+    stats->channel_offset = t->channel_offset[slot_id];
+    linkaddr_copy(&stats->primary_neighbor, slot_neighbor(slot_id));
+    stats->slot_reward = t->slot_reward[slot_id];
+    return 1;
 }
 
 /**
@@ -318,6 +631,7 @@ void update_slotframe_size(uint8_t new_size) {
     }
     
     uint8_t old_size = slot_manager.slotframe_size;
+    slot_table_t *t = &slot_manager.slots;
     
     if (new_size == old_size) {
         return;  // No change needed
@@ -332,19 +646,11 @@ void update_slotframe_size(uint8_t new_size) {
     if (new_size > old_size) {
         LOG_INFO("Expanding: initializing slots %u to %u\n", old_size, new_size - 1);
         
-        for (int i = old_size; i < new_size; i++) {
-            // Only reset counters, preserve history for slots 0 to old_size-1
-            slot_manager.slots[i].successful_tx = 0;
-            slot_manager.slots[i].successful_rx = 0;
-            slot_manager.slots[i].collisions = 0;
-            slot_manager.slots[i].total_attempts = 0;
-            slot_manager.slots[i].retransmissions = 0;
-            slot_manager.slots[i].usage_count = 0;
-            slot_manager.slots[i].slot_reward = 0.0;
-            slot_manager.slots[i].current_config = SLOT_CONFIG_SHARED;
-            slot_manager.slots[i].channel_offset = 0;
-            linkaddr_copy(&slot_manager.slots[i].primary_neighbor, &linkaddr_null);
-        }
+        // Only reset counters, preserve history for slots 0 to old_size-1
+        clear_counters(old_size, new_size);
+        memset(&t->current_config[old_size], SLOT_CONFIG_SHARED, new_size - old_size);
+        memset(&t->channel_offset[old_size], 0, new_size - old_size);
+        memset(&t->neighbor[old_size], SLOT_NO_NEIGHBOR, new_size - old_size);
         slot_manager.num_active_slots += (new_size - old_size);
         slot_manager.num_shared_slots += (new_size - old_size);
         
@@ -356,16 +662,16 @@ void update_slotframe_size(uint8_t new_size) {
         LOG_INFO("Shrinking: deactivating slots %u to %u\n", new_size, old_size - 1);
         
         for (int i = new_size; i < old_size; i++) {
-            if (slot_manager.slots[i].current_config != SLOT_CONFIG_INACTIVE) {
+            if (t->current_config[i] != SLOT_CONFIG_INACTIVE) {
                 slot_manager.num_active_slots--;
-                if (slot_manager.slots[i].current_config == SLOT_CONFIG_DEDICATED_TX ||
-                    slot_manager.slots[i].current_config == SLOT_CONFIG_DEDICATED_RX) {
+                if (t->current_config[i] == SLOT_CONFIG_DEDICATED_TX ||
+                    t->current_config[i] == SLOT_CONFIG_DEDICATED_RX) {
                     slot_manager.num_dedicated_slots--;
                 } else {
                     slot_manager.num_shared_slots--;
                 }
             }
-            slot_manager.slots[i].current_config = SLOT_CONFIG_INACTIVE;
+            t->current_config[i] = SLOT_CONFIG_INACTIVE;
             // Keep statistics for potential future re-expansion
         }
         
@@ -374,10 +680,63 @@ void update_slotframe_size(uint8_t new_size) {
     }
 }
 
+/**
+ * Restore the configuration of one slot
+ */
+void slot_config_restore(uint8_t slot_id, uint8_t config, uint8_t channel_offset,
+                         const linkaddr_t *neighbor) {
+    if (slot_id == 0 || slot_id >= slot_manager.slotframe_size) return;  // slot 0 stays advertising
+    
+    slot_table_t *t = &slot_manager.slots;
+    uint8_t current = t->current_config[slot_id];
+    
+    // Keep the active/shared/dedicated counters consistent
+    if (current != SLOT_CONFIG_INACTIVE) {
+        slot_manager.num_active_slots--;
+        if (current == SLOT_CONFIG_DEDICATED_TX || current == SLOT_CONFIG_DEDICATED_RX) {
+            slot_manager.num_dedicated_slots--;
+        } else {
+            slot_manager.num_shared_slots--;
+        }
+    }
+    if (config != SLOT_CONFIG_INACTIVE) {
+        slot_manager.num_active_slots++;
+        if (config == SLOT_CONFIG_DEDICATED_TX || config == SLOT_CONFIG_DEDICATED_RX) {
+            slot_manager.num_dedicated_slots++;
+        } else {
+            slot_manager.num_shared_slots++;
+        }
+    }
+    
+    t->current_config[slot_id] = config;
+    t->channel_offset[slot_id] = channel_offset;
+    set_slot_neighbor(slot_id, neighbor);
+}
+
+/**
+ * Install links matching the current slot configuration
+ */
+void apply_slot_configuration(struct tsch_slotframe *sf, struct tsch_link **links) {
+    if (sf == NULL || links == NULL) {
+        LOG_WARN("Cannot apply slot configuration: invalid parameters\n");
+        return;
+    }
+    
+    for (int i = 1; i < slot_manager.slotframe_size; i++) {  // Skip slot 0 (advertising)
+        install_slot_link(sf, links, i);
+    }
+    
+    LOG_INFO("Slot configuration applied: active=%u (dedicated=%u, shared=%u)\n",
+             slot_manager.num_active_slots, slot_manager.num_dedicated_slots,
+             slot_manager.num_shared_slots);
+}
+
 /**
  * Print slot configuration summary
  */
 void print_slot_summary(void) {
+    slot_table_t *t = &slot_manager.slots;
+    
     LOG_INFO("========== Slot Summary ==========\n");
     LOG_INFO("Slotframe size: %u\n", slot_manager.slotframe_size);
     LOG_INFO("Active: %u | Dedicated: %u | Shared: %u\n",
@@ -387,11 +746,10 @@ void print_slot_summary(void) {
     // Show top 5 most used slots
     LOG_INFO("Top utilized slots:\n");
     for (int i = 1; i < slot_manager.slotframe_size && i < 6; i++) {
-        slot_statistics_t *slot = &slot_manager.slots[i];
-        if (slot->usage_count > 0) {
+        if (slot_usage(i) > 0) {
             LOG_INFO("  Slot %u: tx=%u rx=%u coll=%u ch=%u\n",
-                     i, slot->successful_tx, slot->successful_rx,
-                     slot->collisions, slot->channel_offset);
+                     i, t->successful_tx[i], t->successful_rx[i],
+                     t->collisions[i], t->channel_offset[i]);
         }
     }
     LOG_INFO("==================================\n");
@@ -400,52 +758,76 @@ void print_slot_summary(void) {
 /**
  * Compute slot-level reward bonus/penalty
  */
-float compute_slot_efficiency_reward(void) {
-    float efficiency_bonus = 0.0;
+q_value_t compute_slot_efficiency_reward(void) {
+    // Counted in halves, the smallest step of the bonus
+    int16_t efficiency_bonus = 0;
     
     // Bonus for having dedicated slots (more efficient)
-    efficiency_bonus += slot_manager.num_dedicated_slots * 2.0;
+    efficiency_bonus += slot_manager.num_dedicated_slots * 4;
     
     // Penalty for too many inactive slots (wasted space)
     uint8_t inactive_slots = slot_manager.slotframe_size - slot_manager.num_active_slots;
     if (inactive_slots > slot_manager.slotframe_size / 3) {
-        efficiency_bonus -= inactive_slots * 0.5;
+        efficiency_bonus -= inactive_slots;
     }
     
     // Bonus for low overall collision rate
-    uint16_t total_collisions = 0;
-    uint16_t total_attempts = 0;
+    uint32_t total_collisions = 0;
+    uint32_t total_attempts = 0;
     for (int i = 0; i < slot_manager.slotframe_size; i++) {
-        total_collisions += slot_manager.slots[i].collisions;
-        total_attempts += slot_manager.slots[i].total_attempts;
+        total_collisions += slot_manager.slots.collisions[i];
+        total_attempts += slot_manager.slots.total_attempts[i];
     }
     
     if (total_attempts > 0) {
-        float collision_rate = (float)total_collisions / total_attempts;
-        if (collision_rate < 0.1) {  // Less than 10% collision rate
-            efficiency_bonus += 5.0;
-        } else if (collision_rate > 0.3) {  // More than 30% collision rate
-            efficiency_bonus -= 5.0;
+        if (10 * total_collisions < total_attempts) {  // Less than 10% collision rate
+            efficiency_bonus += 10;
+        } else if (10 * total_collisions > 3 * total_attempts) {  // More than 30% collision rate
+            efficiency_bonus -= 10;
         }
     }
     
-    return efficiency_bonus;
+    return Q_FROM_INT(efficiency_bonus) / 2;
 }
 
 /**
- * Recommend channel offset based on collision history
+ * Value of a cell bandit arm
+ */
+slot_bandit_value_t get_slot_bandit_value(uint8_t slot_id, slot_config_type_t config) {
+#if SLOT_BANDIT
+    if (slot_id < MAX_TRACKED_SLOTS && config < SLOT_BANDIT_ARMS) {
+        return bandit_values[slot_id][config];
+    }
+#endif
+    return 0;
+}
+
+/**
+ * Recommend channel offset based on interference history
  */
 uint8_t recommend_channel_offset(uint8_t slot_id) {
     if (slot_id >= MAX_TRACKED_SLOTS) return 0;
     
-    // Simple strategy: try different channel based on slot position
-    // More sophisticated: track per-channel collision rates
-    uint8_t current = slot_manager.slots[slot_id].channel_offset;
+    uint8_t current = slot_manager.slots.channel_offset[slot_id] % NUM_CHANNEL_OFFSETS;
     
+#if SLOT_INTERFERENCE_MAP
+    // Least-interfered offset; scanning from current + 1 keeps the old
+    // rotation order among equally clean (e.g. never used) offsets
+    uint8_t best = current;
+    uint8_t best_score = interference_get(slot_id, current);
+    for (uint8_t k = 1; k < NUM_CHANNEL_OFFSETS && best_score > 0; k++) {
+        uint8_t offset = (current + k) % NUM_CHANNEL_OFFSETS;
+        uint8_t score = interference_get(slot_id, offset);
+        if (score < best_score) {
+            best = offset;
+            best_score = score;
+        }
+    }
+    return best;
+#else
     // Rotate through channels if collisions detected
-    uint8_t new_offset = (current + 1) % NUM_CHANNEL_OFFSETS;
-    
-    return new_offset;
+    return (current + 1) % NUM_CHANNEL_OFFSETS;
+#endif
 }
 
 /**
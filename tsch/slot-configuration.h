@@ -4,6 +4,7 @@
 /********** Libraries **********/
 #include "contiki.h"
 #include "net/mac/tsch/tsch.h"
+#include "q-learning.h"
 
 /******** Configuration *******/
 // Maximum slots to track
@@ -26,6 +27,100 @@
 #define SLOT_RECONFIG_INTERVAL 3  // Reconfigure every 3 Q-learning cycles
 #endif
 
+// Width of the per-slot counters, 8 or 16 bits. They restart every learning
+// cycle and saturate, so 8 bits only clip slots with more than 255 events
+// in one cycle
+#ifdef SLOT_CONF_COUNTER_BITS
+#define SLOT_COUNTER_BITS SLOT_CONF_COUNTER_BITS
+#else
+#define SLOT_COUNTER_BITS 16
+#endif
+
+#if SLOT_COUNTER_BITS == 8
+typedef uint8_t slot_counter_t;
+#define SLOT_COUNTER_MAX UINT8_MAX
+#elif SLOT_COUNTER_BITS == 16
+typedef uint16_t slot_counter_t;
+#define SLOT_COUNTER_MAX UINT16_MAX
+#else
+#error "SLOT_CONF_COUNTER_BITS must be 8 or 16"
+#endif
+
+// Distinct primary neighbors kept for the slots; a slot stores a one-byte
+// index into this table instead of a full link-layer address
+#ifndef SLOT_MAX_NEIGHBORS
+#define SLOT_MAX_NEIGHBORS 32
+#endif
+
+#define SLOT_NO_NEIGHBOR 0xff
+
+// Channel offsets the recommender chooses from
+#ifdef SLOT_CONF_CHANNEL_OFFSETS
+#define SLOT_CHANNEL_OFFSETS SLOT_CONF_CHANNEL_OFFSETS
+#else
+#define SLOT_CHANNEL_OFFSETS 16
+#endif
+
+// Decayed interference score per (slot, channel offset), a 4-bit nibble each
+// (MAX_TRACKED_SLOTS * SLOT_CHANNEL_OFFSETS / 2 bytes). Without it
+// recommend_channel_offset() rotates to the next offset
+#ifdef SLOT_CONF_INTERFERENCE_MAP
+#define SLOT_INTERFERENCE_MAP SLOT_CONF_INTERFERENCE_MAP
+#else
+#define SLOT_INTERFERENCE_MAP 1
+#endif
+
+#if SLOT_INTERFERENCE_MAP && (SLOT_CHANNEL_OFFSETS % 2)
+#error "SLOT_CONF_CHANNEL_OFFSETS must be even with the interference map"
+#endif
+
+// Score added per event (saturating at 15); every learning cycle the
+// scores lose a quarter
+#ifndef SLOT_INTERFERENCE_COLLISION
+#define SLOT_INTERFERENCE_COLLISION 6
+#endif
+#ifndef SLOT_INTERFERENCE_NOACK
+#define SLOT_INTERFERENCE_NOACK 3
+#endif
+#ifndef SLOT_INTERFERENCE_NOISE
+#define SLOT_INTERFERENCE_NOISE 1
+#endif
+
+// Energy above this level during an idle listen counts as noise (dBm)
+#ifndef SLOT_INTERFERENCE_RSSI_THRESHOLD
+#define SLOT_INTERFERENCE_RSSI_THRESHOLD -85
+#endif
+
+// Slot rewards are Q8.8 fixed point, clamped to +-SLOT_REWARD_LIMIT
+#define SLOT_REWARD_FRAC_BITS 8
+#define SLOT_REWARD_LIMIT 127
+#define SLOT_REWARD_TO_FLOAT(r) ((float)(r) / (1 << SLOT_REWARD_FRAC_BITS))
+typedef int16_t slot_reward_t;
+
+// Learning mode: every cell runs an epsilon-greedy bandit over INACTIVE,
+// SHARED and DEDICATED_TX, rewarded with its slot_reward, in place of the
+// usage and dedicated thresholds of reconfigure_slots_adaptive()
+#ifdef SLOT_CONF_BANDIT
+#define SLOT_BANDIT SLOT_CONF_BANDIT
+#else
+#define SLOT_BANDIT 0
+#endif
+
+// Exploration probability of the cell bandit (%)
+#ifndef SLOT_BANDIT_EPSILON
+#define SLOT_BANDIT_EPSILON 10
+#endif
+
+// Step size 2^-SHIFT of the arm value updates (recency weighted)
+#ifndef SLOT_BANDIT_STEP_SHIFT
+#define SLOT_BANDIT_STEP_SHIFT 3
+#endif
+
+// Arm values are Q8.8 fixed point like the slot rewards they average
+#define SLOT_BANDIT_ARMS 3
+#define SLOT_BANDIT_FRAC_BITS SLOT_REWARD_FRAC_BITS
+typedef int16_t slot_bandit_value_t;
+
 /******** Slot Configuration Types *******/
 typedef enum {
     SLOT_CONFIG_INACTIVE,      // Slot is disabled/not used
@@ -35,23 +130,47 @@ typedef enum {
     SLOT_CONFIG_ADVERTISING    // Advertising slot (always slot 0)
 } slot_config_type_t;
 
+/******** Interference Events *******/
+typedef enum {
+    SLOT_EVENT_COLLISION,      // Transmission ended in a collision
+    SLOT_EVENT_NOACK,          // Unicast transmission not acknowledged
+    SLOT_EVENT_NOISE           // Energy above threshold while listening idle
+} slot_interference_event_t;
+
 /******** Slot Statistics Structure *******/
+// Statistics of one slot, a copy assembled by get_slot_statistics()
 typedef struct {
-    uint16_t successful_tx;       // Successful transmissions in this slot
-    uint16_t successful_rx;       // Successful receptions in this slot
-    uint16_t collisions;          // Detected collisions
-    uint16_t total_attempts;      // Total transmission attempts
-    uint16_t retransmissions;     // Number of retransmissions
-    uint8_t current_config;       // Current configuration (slot_config_type_t)
-    uint8_t channel_offset;       // Current channel offset
-    linkaddr_t primary_neighbor;  // Primary neighbor for this slot (if dedicated)
-    float slot_reward;            // Computed reward for this slot
-    uint8_t usage_count;          // Number of times slot was used (for percentages)
+    slot_counter_t successful_tx;       // Successful transmissions in this slot
+    slot_counter_t successful_rx;       // Successful receptions in this slot
+    slot_counter_t collisions;          // Detected collisions
+    slot_counter_t total_attempts;      // Total transmission attempts
+    slot_counter_t retransmissions;     // Number of retransmissions
+    slot_counter_t usage_count;         // Successful tx + rx (for percentages)
+    uint8_t current_config;             // Current configuration (slot_config_type_t)
+    uint8_t channel_offset;             // Current channel offset
+    linkaddr_t primary_neighbor;        // Primary neighbor for this slot (if dedicated)
+    slot_reward_t slot_reward;          // Computed reward for this slot (Q8.8)
 } slot_statistics_t;
 
+// Storage of all slots, one array per field: the passes over the whole
+// slotframe read only the fields they need
+typedef struct {
+    slot_counter_t successful_tx[MAX_TRACKED_SLOTS];
+    slot_counter_t successful_rx[MAX_TRACKED_SLOTS];
+    slot_counter_t collisions[MAX_TRACKED_SLOTS];
+    slot_counter_t total_attempts[MAX_TRACKED_SLOTS];
+    slot_counter_t retransmissions[MAX_TRACKED_SLOTS];
+    slot_reward_t slot_reward[MAX_TRACKED_SLOTS];
+    uint8_t current_config[MAX_TRACKED_SLOTS];
+    uint8_t channel_offset[MAX_TRACKED_SLOTS];
+    uint8_t neighbor[MAX_TRACKED_SLOTS];          // index into neighbors, SLOT_NO_NEIGHBOR
+    linkaddr_t neighbors[SLOT_MAX_NEIGHBORS];     // primary neighbors of the slots
+    uint8_t num_neighbors;
+} slot_table_t;
+
 /******** Global Slot Management *******/
 typedef struct {
-    slot_statistics_t slots[MAX_TRACKED_SLOTS];  // Statistics per slot
+    slot_table_t slots;                           // Statistics per slot
     uint8_t num_active_slots;                     // Number of active slots
     uint8_t num_dedicated_slots;                  // Number of dedicated slots
     uint8_t num_shared_slots;                     // Number of shared slots
@@ -81,16 +200,41 @@ void slot_record_rx(uint8_t slot_id, linkaddr_t *src);
  */
 void slot_record_collision(uint8_t slot_id);
 
+/**
+ * Record an interference event on the channel offset a slot used
+ */
+void slot_record_interference(uint8_t slot_id, uint8_t channel_offset,
+                              slot_interference_event_t event);
+
+/**
+ * Record the RSSI sampled during an idle listen, noise if above
+ * SLOT_INTERFERENCE_RSSI_THRESHOLD
+ */
+void slot_record_rssi(uint8_t slot_id, uint8_t channel_offset, int16_t rssi);
+
+/**
+ * Decayed interference score (0-15) of a slot on a channel offset
+ */
+uint8_t get_slot_interference(uint8_t slot_id, uint8_t channel_offset);
+
+/**
+ * Value of a cell bandit arm (SLOT_CONFIG_INACTIVE, _SHARED or
+ * _DEDICATED_TX) in Q8.8; 0 without SLOT_BANDIT
+ */
+slot_bandit_value_t get_slot_bandit_value(uint8_t slot_id, slot_config_type_t config);
+
 /**
  * Analyze slot statistics and compute rewards per slot
- * Returns average slot reward
+ * (with SLOT_BANDIT also updates the arm of each cell's current configuration)
+ * Returns average slot reward (Q8.8)
  */
-float analyze_slot_performance(void);
+slot_reward_t analyze_slot_performance(void);
 
 /**
  * Reconfigure slots based on learned statistics
  * - Deactivates underutilized slots
  * - Converts high-traffic shared slots to dedicated
+ *   (with SLOT_BANDIT: each cell takes the arm its bandit selects instead)
  * - Optimizes channel offsets to reduce interference
  * 
  * Should be called periodically (e.g., every N Q-learning cycles)
@@ -109,9 +253,10 @@ void reset_slot_statistics(void);
 slot_config_type_t get_slot_recommendation(uint8_t slot_id);
 
 /**
- * Get statistics for a specific slot
+ * Copy the statistics of a specific slot into stats
+ * Returns 0 for a slot that is not tracked
  */
-slot_statistics_t* get_slot_statistics(uint8_t slot_id);
+uint8_t get_slot_statistics(uint8_t slot_id, slot_statistics_t *stats);
 
 /**
  * Get overall slot manager state
@@ -123,6 +268,19 @@ slot_manager_t* get_slot_manager(void);
  */
 void update_slotframe_size(uint8_t new_size);
 
+/**
+ * Restore the configuration of one slot (checkpoint warm start)
+ * Statistics stay zeroed, only the decision taken for the slot is restored
+ */
+void slot_config_restore(uint8_t slot_id, uint8_t config, uint8_t channel_offset,
+                         const linkaddr_t *neighbor);
+
+/**
+ * Install links matching the current slot configuration
+ * (after a warm start the schedule is rebuilt as all-shared first)
+ */
+void apply_slot_configuration(struct tsch_slotframe *sf, struct tsch_link **links);
+
 /**
  * Print slot configuration summary (for debugging)
  */
@@ -130,13 +288,15 @@ void print_slot_summary(void);
 
 /**
  * Compute slot-level reward for Q-learning integration
- * Returns bonus/penalty based on slot configuration efficiency
+ * Returns bonus/penalty based on slot configuration efficiency (a multiple
+ * of 0.5, computed with integers)
  */
-float compute_slot_efficiency_reward(void);
+q_value_t compute_slot_efficiency_reward(void);
 
 /**
- * Identify best channel offset for a slot based on collision history
- * Returns recommended channel offset (0-15)
+ * Identify best channel offset for a slot based on interference history:
+ * the offset with the lowest decayed score, the current one on ties
+ * Returns recommended channel offset (0 - SLOT_CHANNEL_OFFSETS-1)
  */
 uint8_t recommend_channel_offset(uint8_t slot_id);
 
@@ -249,6 +249,112 @@ void unlock_queue_rx(){
 void lock_queue_rx(){
   rx_queue_is_locked = 1;
 }
+
+/* the model exchange cell is left out of the learner's measurements */
+#if FEDERATED_SLOTFRAME
+#define RL_MEASURED_LINK(link) ((link)->slotframe_handle != FEDERATED_SLOTFRAME_HANDLE)
+#else
+#define RL_MEASURED_LINK(link) 1
+#endif
+
+#if FEDERATED_EB_SUMMARY
+/* Model summary payload IE, appended to every outgoing EB:
+ * descriptor (2) | sub-ID | node ID (2) | version (2) | value (2) | state | action
+ * multi-byte fields little endian, as the other IEs */
+#ifndef RL_EB_SUMMARY_SUB_ID
+#define RL_EB_SUMMARY_SUB_ID 0xf3
+#endif
+#define RL_EB_SUMMARY_IE_GROUP 0x5 /* IETF payload IE group */
+#define RL_EB_SUMMARY_CONTENT_LEN 9
+#define RL_EB_SUMMARY_IE_LEN (2 + RL_EB_SUMMARY_CONTENT_LEN)
+/* worst-case MIC added when the EB is secured */
+#define RL_EB_SUMMARY_MIC_HEADROOM 16
+
+/* summaries heard in EBs, drained by the node process (power of two) */
+#ifndef RL_EB_SUMMARY_QUEUE_LEN
+#define RL_EB_SUMMARY_QUEUE_LEN 8
+#endif
+static struct ringbufindex summary_ringbuf;
+static fed_summary_t summary_array[RL_EB_SUMMARY_QUEUE_LEN];
+
+/* Append the local model summary to an EB, returns the new length */
+static int
+add_eb_summary(uint8_t *buf, int len)
+{
+  fed_summary_t summary;
+  uint16_t desc = RL_EB_SUMMARY_CONTENT_LEN | (RL_EB_SUMMARY_IE_GROUP << 11) | (1 << 15);
+  uint8_t *p = buf + len;
+
+  if(len + RL_EB_SUMMARY_IE_LEN + RL_EB_SUMMARY_MIC_HEADROOM > TSCH_PACKET_MAX_LEN) {
+    return len;
+  }
+  fed_get_summary(&summary);
+  p[0] = desc & 0xff;
+  p[1] = desc >> 8;
+  p[2] = RL_EB_SUMMARY_SUB_ID;
+  p[3] = summary.node_id & 0xff;
+  p[4] = summary.node_id >> 8;
+  p[5] = summary.version & 0xff;
+  p[6] = summary.version >> 8;
+  p[7] = (uint16_t)summary.best_value & 0xff;
+  p[8] = (uint16_t)summary.best_value >> 8;
+  p[9] = summary.state;
+  p[10] = summary.best_action;
+  return len + RL_EB_SUMMARY_IE_LEN;
+}
+
+/* Look for a model summary among the IEs of a received EB */
+static void
+parse_eb_summary(const uint8_t *buf, int len)
+{
+  while(len >= 2) {
+    uint16_t desc = buf[0] | (buf[1] << 8);
+    int ie_len;
+    if(desc & (1 << 15)) {
+      /* payload IE */
+      uint8_t group = (desc >> 11) & 0x0f;
+      ie_len = desc & 0x07ff;
+      if(group == 0x0f) {
+        return; /* payload IE list termination */
+      }
+      if(group == RL_EB_SUMMARY_IE_GROUP && ie_len == RL_EB_SUMMARY_CONTENT_LEN
+         && len >= RL_EB_SUMMARY_IE_LEN && buf[2] == RL_EB_SUMMARY_SUB_ID) {
+        int16_t index = ringbufindex_peek_put(&summary_ringbuf);
+        if(index != -1) {
+          fed_summary_t *summary = &summary_array[index];
+          summary->node_id = buf[3] | (buf[4] << 8);
+          summary->version = buf[5] | (buf[6] << 8);
+          summary->best_value = (int16_t)(buf[7] | (buf[8] << 8));
+          summary->state = buf[9];
+          summary->best_action = buf[10];
+          ringbufindex_put(&summary_ringbuf);
+        }
+        return;
+      }
+    } else {
+      /* header IE */
+      ie_len = desc & 0x007f;
+    }
+    buf += 2 + ie_len;
+    len -= 2 + ie_len;
+  }
+}
+
+/* Next model summary heard in an EB, returns 0 when none is pending */
+uint8_t pop_eb_summary(fed_summary_t *summary){
+  int16_t index = ringbufindex_peek_get(&summary_ringbuf);
+  if(index == -1) {
+    return 0;
+  }
+  *summary = summary_array[index];
+  ringbufindex_get(&summary_ringbuf);
+  return 1;
+}
+#else
+uint8_t pop_eb_summary(fed_summary_t *summary){
+  return 0;
+}
+#endif /* FEDERATED_EB_SUMMARY */
 #endif /* RL_TSCH_ENABLED */
 /**************************** My modifications - End **********************************/
 
@@ -615,6 +721,12 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
       /* if this is an EB, then update its Sync-IE */
       if(current_neighbor == n_eb) {
         packet_ready = tsch_packet_update_eb(packet, packet_len, current_packet->tsch_sync_ie_offset);
+/**************************** My modifications - Start ********************************/
+#if RL_TSCH_ENABLED && FEDERATED_EB_SUMMARY
+        /* EBs are built by tsch-packet.c, the summary IE goes last */
+        packet_len = add_eb_summary(packet, packet_len);
+#endif /* RL_TSCH_ENABLED && FEDERATED_EB_SUMMARY */
+/**************************** My modifications - End **********************************/
       } else {
         packet_ready = 1;
       }
@@ -791,7 +903,8 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
 
 /**************************** My modifications - Start ********************************/
 #if RL_TSCH_ENABLED
-  uint8_t check_data = ((((uint8_t *)(queuebuf_dataptr(current_packet->qb)))[0]) & 7) == FRAME802154_DATAFRAME;
+  uint8_t check_data = ((((uint8_t *)(queuebuf_dataptr(current_packet->qb)))[0]) & 7) == FRAME802154_DATAFRAME
+                       && current_link != NULL && RL_MEASURED_LINK(current_link);
   if(current_neighbor != NULL && current_neighbor->is_time_source && 
   mac_tx_status == MAC_TX_OK && tx_queue_is_locked == 0 && check_data) {
     ptk_tx.data_type = UNICAST_DATA;
@@ -809,8 +922,14 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
   }
   
   // Track collisions
-  if(mac_tx_status == MAC_TX_COLLISION && current_link != NULL) {
+  if(mac_tx_status == MAC_TX_COLLISION && current_link != NULL && RL_MEASURED_LINK(current_link)) {
     slot_record_collision(current_link->timeslot);
+    slot_record_interference(current_link->timeslot, current_link->channel_offset, SLOT_EVENT_COLLISION);
+  }
+
+  // Unacknowledged unicasts mark the cell's channel offset as interfered
+  if(mac_tx_status == MAC_TX_NOACK && current_link != NULL && RL_MEASURED_LINK(current_link)) {
+    slot_record_interference(current_link->timeslot, current_link->channel_offset, SLOT_EVENT_NOACK);
   }
 #endif /* RL_TSCH_ENABLED */
 /**************************** My modifications - End **********************************/
@@ -909,6 +1028,17 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
           current_slot_start, tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait] + RADIO_DELAY_BEFORE_DETECT);
     }
     if(!packet_seen) {
+/**************************** My modifications - Start ********************************/
+#if RL_TSCH_ENABLED && SLOT_INTERFERENCE_MAP
+      /* Energy on the cell's channel without a frame is interference */
+      if(RL_MEASURED_LINK(current_link)) {
+        radio_value_t idle_rssi;
+        if(NETSTACK_RADIO.get_value(RADIO_PARAM_RSSI, &idle_rssi) == RADIO_RESULT_OK) {
+          slot_record_rssi(current_link->timeslot, current_link->channel_offset, idle_rssi);
+        }
+      }
+#endif /* RL_TSCH_ENABLED && SLOT_INTERFERENCE_MAP */
+/**************************** My modifications - End **********************************/
       /* no packets on air */
       tsch_radio_off(TSCH_RADIO_CMD_OFF_FORCE);
     } else {
@@ -1059,7 +1189,7 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
 /**************************** My modifications - Start ********************************/
 #if RL_TSCH_ENABLED
   //uint8_t check_data = ((((uint8_t *)(queuebuf_dataptr(current_packet->qb)))[0]) & 7) == FRAME802154_DATAFRAME;
-  if(frame.fcf.frame_type == FRAME802154_DATAFRAME) 
+  if(frame.fcf.frame_type == FRAME802154_DATAFRAME && RL_MEASURED_LINK(current_link)) 
   {
     ptk_rx.data_type = UNICAST_DATA;
     ptk_rx.packet_seqno = frame.seq;
@@ -1071,6 +1201,13 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
     // Track slot-level statistics for successful RX
     slot_record_rx(current_link->timeslot, &source_address);
   }
+#if FEDERATED_EB_SUMMARY
+  else if(frame.fcf.frame_type == FRAME802154_BEACONFRAME && frame.fcf.ie_list_present)
+  {
+    parse_eb_summary((const uint8_t *)current_input->payload + header_len,
+                     current_input->len - header_len);
+  }
+#endif /* FEDERATED_EB_SUMMARY */
 #endif /* RL_TSCH_ENABLED */
 /**************************** My modifications - End **********************************/
             /* Add current input to ringbuf */
@@ -1161,6 +1298,19 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
           do_skip_best_link = 1;
         }
       }
+/**************************** My modifications - Start ********************************/
+#if RL_TSCH_ENABLED && FEDERATED_SLOTFRAME
+      /* The model exchange cell overlaps a data cell: it takes the slot on
+       * every node, so the receivers listen on its channel offset */
+      if(backup_link != NULL) {
+        if(backup_link->slotframe_handle == FEDERATED_SLOTFRAME_HANDLE) {
+          do_skip_best_link = 1;
+        } else if(current_link->slotframe_handle == FEDERATED_SLOTFRAME_HANDLE) {
+          do_skip_best_link = 0;
+        }
+      }
+#endif /* RL_TSCH_ENABLED && FEDERATED_SLOTFRAME */
+/**************************** My modifications - End **********************************/
 
       if(do_skip_best_link) {
         /* skipped a Tx link, refresh its backoff */
@@ -1286,6 +1436,11 @@ tsch_slot_operation_start(void)
   rtimer_clock_t time_to_next_active_slot;
   rtimer_clock_t prev_slot_start;
   TSCH_DEBUG_INIT();
+/**************************** My modifications - Start ********************************/
+#if RL_TSCH_ENABLED && FEDERATED_EB_SUMMARY
+  ringbufindex_init(&summary_ringbuf, RL_EB_SUMMARY_QUEUE_LEN);
+#endif /* RL_TSCH_ENABLED && FEDERATED_EB_SUMMARY */
+/**************************** My modifications - End **********************************/
   do {
     uint16_t timeslot_diff;
     /* Get next active link */
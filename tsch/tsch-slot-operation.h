@@ -45,6 +45,7 @@
 #include "contiki.h"
 #include "lib/ringbufindex.h"
 #include "customized-tsch-file.h"
+#include "federated-learning.h"
 
 /***** External Variables *****/
 
@@ -110,6 +111,9 @@ void lock_queue_tx();
 // lock and unlock rx queue
 void unlock_queue_rx();
 void lock_queue_rx();
+
+// next model summary heard in an Enhanced Beacon (0 when none is pending)
+uint8_t pop_eb_summary(fed_summary_t *summary);
 // #endif /* RL_TSCH_ENABLED */
 /**************************** My modifications - End **********************************/
 